@@ -51,6 +51,16 @@ class FIFO
     inline operator bool() { return nextIn != nextOut; }
 
 
+    ///////////////////////////////////////////////////////////////////////////////
+    //  FIFO::count
+    //
+    // returns the number of entries in the FIFO
+    // The result is only a snapshot if another thread or core is adding or taking.
+    ///////////////////////////////////////////////////////////////////////////////
+
+    inline unsigned count() { return (nextIn + (N + 1) - nextOut) % (N + 1); }
+
+
     ///////////////////////////////////////////////////////////////////////////////
     //  FIFO::add
     //
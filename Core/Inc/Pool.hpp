@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////
+// Pool.hpp
+// A fixed number of objects of one type, and a free list of the ones not in use.
+//
+// acquire takes an object from the pool, and release gives it back, both in constant time.
+// create and destroy do the same and also run the object's constructor and destructor.
+// The free list is threaded through the unused objects themselves, so the pool costs
+// a pointer and a few counters besides the objects, and a bit per object that catches
+// releasing an object twice or releasing one that is not from the pool.
+//
+// The objects are handed out in order the first time, and after that the most recently
+// released first, which is the one most likely to be in the cache.
+//
+// With POOL_DEBUG set, a released object is filled with a pattern, which is checked when
+// the object is acquired again, to catch writes through a pointer that was kept after release.
+//
+// A pool has no lock. Threads are not preemptive, so it can be shared by threads, but not
+// with an interrupt handler.
+//
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <new>
+
+#ifndef POOL_DEBUG
+#define POOL_DEBUG 0                        // 1 to poison released objects and check them when acquired
+#endif
+
+#define POOL_POISON 0xDB                    // the pattern written over released objects
+
+
+///////////////////////////////////////////////////////////////////////////////
+// class Pool
+//
+// template parameter T      - Type of the objects.
+// template parameter N      - Number of objects.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+template<typename T, unsigned N>
+class Pool
+    {
+    union Slot
+        {
+        Slot *next;                         // the next free object, while this one is free
+        alignas(T) char object[sizeof(T)];
+        };
+
+    Slot slots[N];
+    Slot *free_list = 0;                    // objects that have been released
+    unsigned fresh = 0;                     // slots[fresh..N-1] have never been used
+    unsigned live = 0;                      // objects acquired and not released
+    unsigned high = 0;                      // the most objects in use at once
+    unsigned fails = 0;                     // times acquire found the pool empty
+    uint32_t owned[(N + 31) / 32] = {};     // a bit for each object that is acquired
+
+    bool test(unsigned i) { return owned[i / 32] & (1u << (i % 32)); }
+    void flip(unsigned i) { owned[i / 32] ^= 1u << (i % 32); }
+
+
+    public:
+
+    ///////////////////////////////////////////////////////////////////////////////
+    //  Pool::acquire
+    //
+    // Takes an unused object from the pool. The object is not constructed, its contents are undefined.
+    //
+    // return: the object, or 0 if the pool is empty
+    ///////////////////////////////////////////////////////////////////////////////
+
+    T *acquire()
+        {
+        Slot *slot;
+
+        if(free_list)
+            {
+            slot = free_list;
+            free_list = slot->next;
+#if POOL_DEBUG
+            for(unsigned i=sizeof(Slot *); i<sizeof(T); i++)
+                {
+                assert((unsigned char)slot->object[i] == POOL_POISON);     // written after it was released
+                }
+#endif
+            }
+        else if(fresh < N)
+            {
+            slot = &slots[fresh++];
+            }
+        else
+            {
+            ++fails;
+            return 0;
+            }
+
+        flip(slot - slots);
+        if(++live > high)
+            {
+            high = live;
+            }
+        return (T *)slot->object;
+        }
+
+
+    ///////////////////////////////////////////////////////////////////////////////
+    //  Pool::release
+    //
+    // Returns an object to the pool, without running its destructor.
+    //
+    // input: object  An object from acquire. Releasing one twice, or one from
+    //                elsewhere, fails an assert.
+    ///////////////////////////////////////////////////////////////////////////////
+
+    void release(T *object)
+        {
+        Slot *slot = (Slot *)object;
+
+        assert(contains(object) && test(slot - slots));
+        flip(slot - slots);
+        --live;
+#if POOL_DEBUG
+        memset(slot->object, POOL_POISON, sizeof(T));
+#endif
+        slot->next = free_list;
+        free_list = slot;
+        }
+
+
+    ///////////////////////////////////////////////////////////////////////////////
+    //  Pool::create, Pool::destroy
+    //
+    // acquire and construct an object with the given constructor arguments,
+    // and destruct and release it.
+    ///////////////////////////////////////////////////////////////////////////////
+
+    template<typename... Args>
+    T *create(Args&&... args)
+        {
+        T *object = acquire();
+
+        return object ? new(object) T(static_cast<Args&&>(args)...) : 0;
+        }
+
+    void destroy(T *object)
+        {
+        object->~T();
+        release(object);
+        }
+
+
+    // whether an address is one of the pool's objects
+    bool contains(const T *object) const
+        {
+        uintptr_t offset = (const char *)object - (const char *)slots;
+
+        return offset < sizeof(slots) && offset % sizeof(Slot) == 0;
+        }
+
+    // the number of an object, 0..N-1
+    unsigned index(const T *object) const { return (const Slot *)object - slots; }
+
+    inline operator bool() const { return available() != 0; }     // true if an object can be acquired
+    unsigned size() const { return N; }                             // the number of objects
+    unsigned available() const { return N - live; }                 // the number not in use
+    unsigned in_use() const { return live; }                        // the number in use
+    unsigned peak() const { return high; }                          // the most that have been in use at once
+    unsigned failures() const { return fails; }                     // the number of acquires that found none
+    };
+
+
+#endif // POOL_HPP
@@ -0,0 +1,188 @@
+// arena.hpp
+//
+// Arenas, for memory whose lifetime is a scope: one command, one parallel region, one file copy.
+//
+// An Arena hands out memory from a chunk by bumping a pointer. Freeing is not needed: an ArenaScope
+// records the pointer when it is entered, and puts it back when it exits, which releases everything
+// allocated in the scope at once. Scopes nest. An arena also counts the allocations made in the
+// current scope that have not been freed, and when the count returns to zero the scope's memory is
+// reclaimed early, so a long scope whose allocations come and go, such as a parallel region that
+// creates many tasks, keeps reusing the same memory.
+//
+// Each thread has a current arena, kept in its omp_thread, which ArenaScope selects. arena_malloc
+// allocates from it, or from the heap if there is none or it is full, and arena_free knows which
+// is which. libgomp allocates task data and taskgroups with these, and a parallel region shares the
+// arena of the thread that started it with the whole team.
+//
+// Threads are not preemptive, so an arena needs no lock, but it must not be used from an interrupt
+// handler. Memory from arena_malloc must be freed while the arena it came from, or an arena nested
+// in it, is current, or else given to arena_free along with the arena that was current when it
+// was allocated, as libgomp does for a task that is run by a thread outside the creator's team.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// the state of an arena saved by a scope
+struct ArenaMark
+    {
+    char *top;
+    char *floor;
+    unsigned live;
+    };
+
+
+class Arena
+    {
+    char *base;                             // the chunk
+    char *end;
+    char *top;                              // the next free byte
+    char *floor;                            // the start of the current scope's memory
+    char *high = 0;                         // the most of the chunk that has been in use
+    unsigned live = 0;                      // allocations made in the current scope that have not been freed
+    bool owned = false;                     // the chunk was malloced by the constructor
+
+    public:
+
+    Arena *parent = 0;                      // the arena this one's chunk came from, if any
+    unsigned shared = 0;                    // the number of parallel regions that share this arena with their team
+
+    // an arena over a buffer
+    Arena(void *mem, size_t size)
+        : base((char *)mem), end((char *)mem + size), top(base), floor(base)
+        {
+        high = base;
+        }
+
+    // an arena over a chunk of the heap, which is freed by the destructor
+    Arena(size_t size)
+        : Arena(malloc(size), size)
+        {
+        owned = true;
+        if(base == 0)                       // no room on the heap, every allocation will fail
+            {
+            end = 0;
+            }
+        }
+
+    // an arena nested in another, over a chunk allocated from it
+    Arena(Arena &outer, size_t size)
+        : Arena(outer.alloc(size), size)
+        {
+        parent = &outer;
+        if(base == 0)
+            {
+            end = 0;
+            }
+        }
+
+    ~Arena()
+        {
+        if(owned)
+            {
+            free(base);
+            }
+        else if(parent)
+            {
+            parent->release(base);
+            }
+        }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // allocate from the arena, returns 0 if it is full
+    void *alloc(size_t size, size_t align = 8)
+        {
+        char *p = (char *)(((uintptr_t)top + align - 1) & -(uintptr_t)align);
+
+        if(p + size > end || p < top)
+            {
+            return 0;
+            }
+
+        top = p + size;
+        if(top > high)
+            {
+            high = top;
+            }
+        ++live;
+        return p;
+        }
+
+    // return a block to the arena, returns false if it did not come from this arena
+    // A block of the current scope is counted, and when the scope has none left its memory is reused.
+    bool release(void *ptr)
+        {
+        char *p = (char *)ptr;
+
+        if(p < base || p >= end)
+            {
+            return false;
+            }
+        if(p >= floor && p < top && --live == 0)
+            {
+            top = floor;
+            }
+        return true;
+        }
+
+    // start a scope, everything allocated until leave is released by it
+    ArenaMark enter()
+        {
+        ArenaMark mark = {top, floor, live};
+        floor = top;
+        live = 0;
+        return mark;
+        }
+
+    void leave(const ArenaMark &mark)
+        {
+        top = mark.top;
+        floor = mark.floor;
+        live = mark.live;
+        }
+
+    size_t size() const { return end - base; }
+    size_t used() const { return top - base; }
+    size_t peak() const { return high - base; }
+    };
+
+
+extern Arena *arena_current();              // the current arena of the running thread, 0 if there is none
+extern Arena *arena_select(Arena *arena);   // make an arena current for the running thread, returns the previous one
+extern void *arena_malloc(size_t size);     // allocate from the current arena, or the heap
+extern void arena_free(void *ptr);          // free memory from arena_malloc
+extern void arena_free(void *ptr, Arena *arena);    // free memory from arena_malloc, made while arena was current
+
+
+// make an arena current for the life of the scope, and release what was allocated from it in the scope
+class ArenaScope
+    {
+    Arena &arena;
+    Arena *prev;
+    ArenaMark mark;
+
+    public:
+
+    ArenaScope(Arena &a) : arena(a), prev(arena_select(&a)), mark(a.enter())
+        {
+        }
+
+    ~ArenaScope()
+        {
+        arena.leave(mark);
+        arena_select(prev);
+        }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+    };
+
+#endif // ARENA_HPP
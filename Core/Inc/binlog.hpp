@@ -0,0 +1,170 @@
+// binlog.hpp
+//
+// A binary log, for messages from code where printing would cost too much time.
+//
+//      LOG("sent block %u, %u retries", block, retries);
+//
+// LOG formats nothing. It records the format's ID, the cycle counter, the thread, and the raw
+// arguments in a RAM ring buffer, which costs a few dozen cycles, so logging can be left in the
+// code and turned on in the field. The "log" command prints the ring as hex words, and
+// host/logdecode turns that back into text, using the format strings in the ELF file.
+//
+// The format strings are kept in the section "binlog", which the linker script places at address
+// 0 and does not load, so they cost no flash, and a string's address in the section is its ID.
+// The formats are those of format.hpp, and are checked the same way at compile time. An
+// argument is stored as one word, or two if it is bigger than 32 bits, and a mask in the record
+// says which are which. %s stores the pointer, which the decoder can only look up if it points
+// into the ELF file, so it is for string literals and other constant strings.
+//
+// When the ring is full the oldest records are overwritten. LOG may be called from an interrupt
+// handler. The whole log can be compiled out by defining BINLOG to 0.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef BINLOG_HPP
+#define BINLOG_HPP
+
+#include <stdint.h>
+#include <utility>
+#include <type_traits>
+#include "format.hpp"
+
+#ifndef BINLOG
+#define BINLOG 1                            // 1 to compile in the log, 0 to remove it
+#endif
+
+#ifndef BINLOG_WORDS
+#define BINLOG_WORDS 256                    // words in the ring buffer, must be a power of 2
+#endif
+
+#define BINLOG_MAX_ARGS 8                   // the most arguments of a LOG
+
+// A record is a header word, the ID of the format, the cycle counter, and the arguments.
+#define BINLOG_HEADER(words, thread, wide) ((uint32_t)(words) << 24 | (uint32_t)(thread) << 16 | (wide))
+#define BINLOG_WORDS_OF(header) ((header) >> 24)            // the number of argument words
+#define BINLOG_THREAD_OF(header) (((header) >> 16) & 0xFF)  // the index of the thread in omp_threads, or one of these:
+#define BINLOG_ISR 0xFF                                     //   logged by an interrupt handler
+#define BINLOG_OTHER 0xFE                                   //   a thread that is not an OpenMP thread
+#define BINLOG_WIDE_OF(header) ((header) & 0xFF)            // bit i set if argument i takes two words, low word first
+
+extern "C" const char __start_binlog[];     // the start of the section of format strings, from the linker
+
+extern bool binlog_enabled;                 // records are only written while this is true
+extern unsigned binlog_lost;                // records overwritten before the log was printed
+
+extern void binlog_write(uint32_t header, uint32_t id, const uint32_t *args);
+extern void binlog_clear();                 // empty the log
+extern void binlog_dump();                  // print the log in hex, for host/logdecode
+
+
+namespace binlog
+{
+
+template<typename T>
+constexpr bool address = std::is_pointer<T>::value || std::is_array<T>::value || std::is_null_pointer<T>::value;
+
+// whether an argument takes two words
+template<typename T>
+constexpr bool wide = (address<T> ? sizeof(void *) : sizeof(T)) > 4;
+
+// the conversion of the argument'th argument of the pieces
+constexpr format::Kind conversion(const format::Piece *pieces, unsigned argument)
+    {
+    for(unsigned i=0;; i++)
+        {
+        if(pieces[i].spec.kind != format::TEXT && argument-- == 0)
+            {
+            return pieces[i].spec.kind;
+            }
+        }
+    }
+
+template<typename S, typename T, unsigned I>
+constexpr bool suits()
+    {
+    constexpr format::Kind kind = conversion(format::Parsed<S>::table.piece, I);
+
+    if(kind == format::STRING)
+        return std::is_convertible<T, const char *>::value;
+    else if(address<T>)
+        return kind == format::UPPER_HEX;
+    else
+        return std::is_integral<T>::value || std::is_enum<T>::value;
+    }
+
+template<typename S, typename... Args, size_t... I>
+constexpr bool all_suit(std::index_sequence<I...>)
+    {
+    return (true && ... && suits<S, Args, I>());
+    }
+
+template<typename... Args>
+constexpr uint32_t wide_mask()
+    {
+    constexpr bool is_wide[] = {false, wide<Args>...};
+    uint32_t mask = 0;
+
+    for(unsigned i=0; i<sizeof...(Args); i++)
+        {
+        mask |= (uint32_t)is_wide[i + 1] << i;
+        }
+    return mask;
+    }
+
+// store an argument, and return where the next goes
+template<typename T>
+__attribute__((__always_inline__)) inline uint32_t *pack(uint32_t *p, const T &value)
+    {
+    uint64_t bits;
+
+    if constexpr(address<T>)
+        bits = (uintptr_t)(const void *)value;
+    else
+        bits = (uint64_t)value;
+
+    *p++ = (uint32_t)bits;
+    if constexpr(wide<T>)
+        {
+        *p++ = (uint32_t)(bits >> 32);
+        }
+    return p;
+    }
+
+template<typename S, typename... Args>
+__attribute__((__always_inline__)) inline void log(S, const char *string, const Args &... args)
+    {
+    static_assert(format::arguments(format::Parsed<S>::table.piece, format::Parsed<S>::size) == sizeof...(Args), "the number of arguments doesn't match the format");
+    static_assert(sizeof...(Args) <= BINLOG_MAX_ARGS, "too many arguments for LOG");
+    static_assert(all_suit<S, Args...>(std::index_sequence_for<Args...>{}), "an argument of LOG doesn't suit its conversion, or is floating point");
+
+    constexpr unsigned words = (0 + ... + (wide<Args> ? 2 : 1));
+    uint32_t record[words ? words : 1];
+    uint32_t *p = record;
+
+    ((p = pack(p, args)), ...);
+    (void)p;
+    binlog_write(BINLOG_HEADER(words, 0, wide_mask<Args...>()), string - __start_binlog, record);
+    }
+
+} // namespace binlog
+
+
+#if BINLOG
+
+#define LOG(f, ...)                                                                                 \
+    do  {                                                                                           \
+        static const char binlog_format_[] __attribute__((__section__("binlog"), __used__)) = f;    \
+        if(binlog_enabled)                                                                          \
+            {                                                                                       \
+            binlog::log(FMT(f), binlog_format_, ##__VA_ARGS__);                                     \
+            }                                                                                       \
+        } while(0)
+
+#else
+
+#define LOG(f, ...) do {} while(0)
+
+#endif
+
+#endif // BINLOG_HPP
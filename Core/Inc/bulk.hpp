@@ -0,0 +1,164 @@
+// bulk.hpp
+//
+// The framed binary protocol of the "bulk" command, which moves memory and files over the USB
+// link much faster than Xmodem through the console can. It is shared by the firmware,
+// Core/Src/bulk.cpp, and the Linux client, host/bulkclient.cpp.
+//
+// A frame is a header, up to BULK_PAYLOAD bytes of payload, and the CRC-32 of both:
+//
+//      0       BULK_MAGIC
+//      1       type
+//      2       seq             the number of a DATA frame in its transfer, modulo 256
+//      3       length          of the payload, 2 bytes
+//      5       check           the complement of the sum of bytes 0-4, so that a header can be
+//                              told from noise in the stream, such as console output
+//      6       payload
+//      6+length                the CRC-32 of the header and payload, 4 bytes
+//
+// Numbers are little endian. The host sends a request, and the device answers it with an END
+// frame, which carries a status and a count of bytes. Between the two, the data of the request
+// goes one way as DATA frames numbered from 0, each full but the last, and each acknowledged by
+// an ACK with its number. The sender may have a window of frames not yet acknowledged: the host
+// BULK_SLOTS, which the device gives in its HELLO, counting the request until the first ACK, and
+// the device BULK_WINDOW. A receiver drops a frame that is out of order or has a bad CRC, and
+// sends a NAK with the number it expected, and the sender goes back and sends again from there.
+// The NAK is sent once, and again only when the numbers of the frames received break, which is
+// the sender going back and losing that frame again. A sender that hears nothing for BULK_RESEND
+// microseconds goes back to the oldest frame not acknowledged. A duplicate is answered with an
+// ACK of the last frame received in order.
+//
+//      request     payload                     the device answers
+//      HELLO                                   HELLO: version, window, payload size (2 bytes)
+//      READ        address, length             DATA frames of the memory, then END
+//      WRITE       address, length             ACKs to the host's DATA frames, then END
+//      GET         path                        DATA frames of the file, then END
+//      PUT         length, path                ACKs to the host's DATA frames, then END
+//      EXIT                                    END, and the console takes the link back
+//
+// READ may reach the RAM and the flash, and WRITE only the RAM. A request for other memory is
+// answered at once with an END that says BAD_ADDRESS.
+//
+// The device also sends a HELLO when it enters the mode.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef BULK_HPP
+#define BULK_HPP
+
+#include <stdint.h>
+
+#define BULK_VERSION 1
+#define BULK_MAGIC 0xB5
+#define BULK_HEADER 6                       // bytes of the header
+#define BULK_TRAILER 4                      // bytes of the CRC
+#define BULK_PAYLOAD 512                    // the most bytes of payload in a frame
+#define BULK_SLOTS 2                        // frames the device can hold, the host's window, at least 2
+#define BULK_WINDOW 16                      // frames the device sends ahead of the acknowledgements, at most 128
+#define BULK_RESEND 200000                  // microseconds without an acknowledgement before a sender goes back
+#define BULK_TRIES 10                       // times a sender goes back without progress before it gives up
+#define BULK_IDLE 30000000                  // microseconds without a request before the device leaves the mode
+
+// frame types
+enum BulkType
+    {
+    BULK_HELLO = 1,
+    BULK_READ,
+    BULK_WRITE,
+    BULK_GET,
+    BULK_PUT,
+    BULK_EXIT,
+    BULK_DATA,
+    BULK_ACK,
+    BULK_NAK,
+    BULK_END,
+    };
+
+// the status in an END frame, a FatFs error is BULK_FILE plus its FRESULT
+enum BulkStatus
+    {
+    BULK_OK = 0,
+    BULK_BAD_REQUEST,                       // unknown, or the payload doesn't suit the type
+    BULK_TIMEOUT,                           // the other end stopped answering
+    BULK_ABORTED,                           // the host sent a request in the middle of the data
+    BULK_BAD_ADDRESS,                       // a READ or WRITE of memory that isn't there, or can't be written
+    BULK_FILE = 0x100,
+    };
+
+
+// what the device has done since it started, for the "bulk" command to show
+struct BulkStats
+    {
+    unsigned requests;
+    unsigned received;                      // frames, other than ACK and NAK
+    unsigned sent;
+    unsigned bad;                           // frames received with a bad CRC
+    unsigned dropped;                       // frames received with no slot for them
+    unsigned resent;                        // times the device went back to send frames again
+    uint32_t bytes;                         // of data moved
+    };
+
+extern BulkStats bulk_stats;
+extern void bulk_serve();                   // serve the host's requests until it sends EXIT
+extern bool bulk_addressable(uint32_t address, uint32_t length, bool write);    // whether a READ or WRITE may have the memory
+
+
+// the CRC-32 of IEEE 802.3, as zlib computes it, continued from crc, which is 0 to start
+struct BulkCrcTable
+    {
+    uint32_t entry[256];
+
+    constexpr BulkCrcTable() : entry()
+        {
+        for(uint32_t i=0; i<256; i++)
+            {
+            uint32_t c = i;
+
+            for(int k=0; k<8; k++)
+                {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                }
+            entry[i] = c;
+            }
+        }
+    };
+
+inline constexpr BulkCrcTable bulk_crc_table;
+
+inline uint32_t bulk_crc(uint32_t crc, const void *data, uint32_t n)
+    {
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+    while(n--)
+        {
+        crc = bulk_crc_table.entry[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        }
+    return ~crc;
+    }
+
+
+inline uint32_t bulk_get16(const uint8_t *p) { return p[0] | p[1] << 8; }
+inline uint32_t bulk_get32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+inline void bulk_put16(uint8_t *p, uint32_t x) { p[0] = x; p[1] = x >> 8; }
+inline void bulk_put32(uint8_t *p, uint32_t x) { p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24; }
+
+// make the header of a frame
+inline void bulk_header(uint8_t *h, unsigned type, unsigned seq, unsigned length)
+    {
+    h[0] = BULK_MAGIC;
+    h[1] = type;
+    h[2] = seq;
+    bulk_put16(&h[3], length);
+    h[5] = ~(h[0] + h[1] + h[2] + h[3] + h[4]);
+    }
+
+// whether six bytes are a header
+inline bool bulk_header_ok(const uint8_t *h)
+    {
+    return h[0] == BULK_MAGIC
+        && h[5] == (uint8_t)~(h[0] + h[1] + h[2] + h[3] + h[4])
+        && bulk_get16(&h[3]) <= BULK_PAYLOAD;
+    }
+
+#endif // BULK_HPP
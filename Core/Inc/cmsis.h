@@ -52,7 +52,7 @@ inline bool COMPILER_BARRIER()
 }
 #endif
 
-#ifdef __cplusplus
+#if defined(__cplusplus) && defined(__arm__)
 
 // Versions of the __LDREX and __STREX intrinsics that
 // work with reference variables and arbitrary types.
@@ -103,6 +103,24 @@ __STATIC_INLINE int __STREX(T value, T volatile &place)
     return sts;
     }
 
+#elif defined(__cplusplus)
+
+// The same for a host, which runs all the threads on one CPU and has no
+// interrupts, so nothing can come between the load and the store.
+
+template<typename T>
+static inline T __LDREX(T volatile &place)
+    {
+    return place;
+    }
+
+template<typename T>
+static inline int __STREX(T value, T volatile &place)
+    {
+    place = value;
+    return 0;
+    }
+
 #endif
 
 
@@ -169,6 +169,17 @@ class Context
         return r9;
         }
 
+    // set the context pointer, used at powerup to make the caller the background thread
+    static void pointer(Context *ctx)
+        {
+        __asm__ __volatile__(
+                "   mov r9, %[ctx]"          // init the thread pointer
+                :
+                : [ctx]"r"(ctx)
+                :
+                );
+        }
+
     };
 
 
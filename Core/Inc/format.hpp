@@ -0,0 +1,354 @@
+// format.hpp
+//
+// Formatted output with the format string parsed at compile time.
+//
+//      PRINT("%08x: %s\n", addr, name);            // to the console, like printf
+//      n = SPRINT(buf, "%4u", count);              // to a buffer, like sprintf
+//      n = SNPRINT(buf, sizeof(buf), "%d", x);     // to a buffer of a given size, like snprintf
+//
+// The format string is the printf subset that Core/Sprintf/sprintf.cpp handles: %d %i %u %x %X
+// %o %c %s %p and %%, with the - and 0 flags and a width. The l, ll, h, hh, and z modifiers are
+// accepted and ignored, since the size comes from the type of the argument: a short is printed
+// as the int it is promoted to, as printf would print it with %x. Precision and floating point
+// are not supported.
+//
+// The compiler parses the format, checks the number of arguments and that each suits its
+// conversion, and expands the call into a straight line of calls to a few small emitters in
+// format.cpp, one for each literal run of text and one for each conversion. Nothing walks the
+// format or va_list at run time, and a mistake in a format is a compile error rather than
+// garbage on the console. Arguments of up to 32 bits are converted with 32-bit arithmetic, and
+// 64-bit ones with a separate, slower path.
+//
+// Console output goes through a small buffer on the stack straight into the console output
+// ring (see _write in serial.cpp), in pieces if need be, so unlike printf it is not cut off at
+// MAXPRINTF characters, and it doesn't take the lock on printf's shared buffer.
+//
+// A format must be a string literal, because each one becomes a type. The same literal in two
+// places generates the same code twice, which is a few dozen bytes.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#define FORMAT_CHUNK 64                 // bytes staged on the stack by PRINT before they are copied to the console
+
+namespace format
+{
+
+// what a piece of a format does
+enum Kind : uint8_t
+    {
+    TEXT,                               // copy a run of the format
+    SIGNED,                             // %d %i
+    UNSIGNED,                           // %u
+    HEX,                                // %x
+    UPPER_HEX,                          // %X, and %p, which is upper case hex without a 0x, as in sprintf.cpp
+    OCTAL,                              // %o
+    CHAR,                               // %c
+    STRING,                             // %s
+    };
+
+enum
+    {
+    LEFT = 1,                           // - flag, pad on the right
+    ZERO = 2,                           // 0 flag, pad numbers with zeros
+    };
+
+// a conversion, as passed to the emitters
+struct Spec
+    {
+    Kind kind;
+    uint8_t flags;
+    uint8_t width;
+    };
+
+// a piece of a parsed format
+struct Piece
+    {
+    Spec spec;
+    uint16_t start;                     // TEXT: where the run starts in the format
+    uint16_t length;                    // and how long it is
+    };
+
+
+// where formatted output goes: a buffer, and for the console what to do when it is full
+class Out
+    {
+    char *base;
+    char *p;
+    char *end;
+    bool console;
+    unsigned done = 0;                  // characters already sent to the console, or that didn't fit
+
+    bool drain();                       // the buffer is full, make room if possible
+
+    public:
+
+    // a buffer of size bytes, which for a string includes the terminator
+    Out(char *buf, size_t size, bool to_console) : base(buf), p(buf), end(buf + size), console(to_console)
+        {
+        if(!console && size-- == 0)
+            {
+            base = p = end = 0;             // no room even for the terminator
+            }
+        else if(!console)
+            {
+            end = buf + size;
+            }
+        }
+
+    inline void put(char c)
+        {
+        if(p == end && !drain())
+            {
+            ++done;
+            return;
+            }
+        *p++ = c;
+        }
+
+    void write(const char *s, unsigned n);
+    void fill(char c, unsigned n);
+    unsigned finish();                  // send what is left to the console, or terminate the buffer, and return the length
+    };
+
+
+// the emitters, in format.cpp
+extern void put_signed(Out &out, int32_t value, Spec spec);
+extern void put_unsigned(Out &out, uint32_t value, Spec spec);
+extern void put_signed(Out &out, int64_t value, Spec spec);
+extern void put_unsigned(Out &out, uint64_t value, Spec spec);
+extern void put_char(Out &out, char c, Spec spec);
+extern void put_string(Out &out, const char *s, Spec spec);
+
+
+// called when a format is not understood, it isn't constexpr, so the compiler stops there
+extern void bad_format();
+
+constexpr bool digit(char c) { return '0' <= c && c <= '9'; }
+
+// break a format into pieces, or just count them if pieces is 0
+constexpr unsigned parse(const char *format, Piece *pieces)
+    {
+    unsigned n = 0;
+    unsigned i = 0;
+
+    while(format[i])
+        {
+        Piece piece = {{TEXT, 0, 0}, 0, 0};
+
+        if(format[i] != '%' || format[i + 1] == '%')
+            {
+            piece.start = i + (format[i] == '%');               // %% is a run of one %
+            i += 1 + (format[i] == '%');
+            while(format[i] && format[i] != '%')
+                {
+                ++i;
+                }
+            piece.length = i - piece.start;
+            }
+        else
+            {
+            unsigned width = 0;
+
+            ++i;
+            if(format[i] == '-')
+                {
+                piece.spec.flags |= LEFT;
+                ++i;
+                }
+            while(format[i] == '0')
+                {
+                piece.spec.flags |= ZERO;
+                ++i;
+                }
+            while(digit(format[i]))
+                {
+                width = width * 10 + format[i++] - '0';
+                }
+            if(width > 255)
+                {
+                bad_format();
+                }
+            piece.spec.width = width;
+            while(format[i] == 'l' || format[i] == 'h' || format[i] == 'z')
+                {
+                ++i;
+                }
+
+            switch(format[i++])
+                {
+            case 'd':
+            case 'i': piece.spec.kind = SIGNED;     break;
+            case 'u': piece.spec.kind = UNSIGNED;   break;
+            case 'x': piece.spec.kind = HEX;        break;
+            case 'X':
+            case 'p': piece.spec.kind = UPPER_HEX;  break;
+            case 'o': piece.spec.kind = OCTAL;      break;
+            case 'c': piece.spec.kind = CHAR;       break;
+            case 's': piece.spec.kind = STRING;     break;
+            default:  bad_format();
+                }
+            }
+
+        if(pieces)
+            {
+            pieces[n] = piece;
+            }
+        ++n;
+        }
+
+    return n;
+    }
+
+template<unsigned N>
+struct Table
+    {
+    Piece piece[N ? N : 1];
+    };
+
+template<unsigned N>
+constexpr Table<N> make_table(const char *format)
+    {
+    Table<N> table = {};
+
+    parse(format, table.piece);
+    return table;
+    }
+
+// the number of arguments used by the first n pieces
+constexpr unsigned arguments(const Piece *pieces, unsigned n)
+    {
+    unsigned count = 0;
+
+    for(unsigned i=0; i<n; i++)
+        {
+        count += pieces[i].spec.kind != TEXT;
+        }
+    return count;
+    }
+
+// the pieces of the format of S, which is a type with a static constexpr str(), see FMT
+template<typename S>
+struct Parsed
+    {
+    static constexpr unsigned size = parse(S::str(), 0);
+    static constexpr Table<size> table = make_table<size>(S::str());
+    };
+
+
+// convert one argument
+template<Kind K, typename T>
+inline void convert(Out &out, Spec spec, const T &value)
+    {
+    if constexpr(K == STRING)
+        {
+        static_assert(std::is_convertible<T, const char *>::value, "%s needs a string");
+        put_string(out, value, spec);
+        }
+    else if constexpr(std::is_pointer<T>::value || std::is_null_pointer<T>::value)
+        {
+        typedef typename std::conditional<sizeof(void *) == 4, uint32_t, uint64_t>::type address;
+
+        static_assert(K == UPPER_HEX, "a pointer needs %p");
+        put_unsigned(out, (address)(uintptr_t)value, spec);
+        }
+    else
+        {
+        static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "a number needs %d, %u, %x, %X, %o, or %c");
+
+        if constexpr(K == CHAR)
+            {
+            put_char(out, (char)value, spec);
+            }
+        else if constexpr(sizeof(T) > 4)
+            {
+            if constexpr(K == SIGNED)
+                put_signed(out, (int64_t)value, spec);
+            else
+                put_unsigned(out, (uint64_t)value, spec);
+            }
+        else if constexpr(K == SIGNED)
+            {
+            put_signed(out, (int32_t)value, spec);
+            }
+        else
+            {
+            put_unsigned(out, (uint32_t)value, spec);                   // a negative int is seen as unsigned, as printf does
+            }
+        }
+    }
+
+// emit piece I of the format of S
+template<typename S, unsigned I, typename Args>
+__attribute__((__always_inline__)) inline void emit(Out &out, const Args &args)
+    {
+    constexpr Piece piece = Parsed<S>::table.piece[I];
+
+    if constexpr(piece.spec.kind == TEXT)
+        {
+        if constexpr(piece.length == 1)
+            out.put(S::str()[piece.start]);
+        else
+            out.write(S::str() + piece.start, piece.length);
+        }
+    else
+        {
+        convert<piece.spec.kind>(out, piece.spec, std::get<arguments(Parsed<S>::table.piece, I)>(args));
+        }
+    }
+
+template<typename S, typename Args, size_t... I>
+__attribute__((__always_inline__)) inline void emit_all(Out &out, const Args &args, std::index_sequence<I...>)
+    {
+    (emit<S, I>(out, args), ...);
+    }
+
+template<typename S, typename... Args>
+inline unsigned run(Out &out, const Args &... args)
+    {
+    static_assert(arguments(Parsed<S>::table.piece, Parsed<S>::size) == sizeof...(Args), "the number of arguments doesn't match the format");
+
+    emit_all<S>(out, std::forward_as_tuple(args...), std::make_index_sequence<Parsed<S>::size>{});
+    return out.finish();
+    }
+
+
+// write to the console
+template<typename S, typename... Args>
+inline int print(S, const Args &... args)
+    {
+    char buf[FORMAT_CHUNK];
+    Out out(buf, sizeof(buf), true);
+
+    return run<S>(out, args...);
+    }
+
+// write to a buffer of size bytes, and terminate it, return the length it would have been, as snprintf does
+template<typename S, typename... Args>
+inline int snprint(char *buf, size_t size, S, const Args &... args)
+    {
+    Out out(buf, size, false);
+
+    return run<S>(out, args...);
+    }
+
+} // namespace format
+
+
+// A format string as a type, so that it can be parsed at compile time.
+#define FMT(s) ([]{ struct Format { static constexpr const char *str() { return s; } }; return Format{}; }())
+
+#define PRINT(f, ...)               format::print(FMT(f), ##__VA_ARGS__)
+#define SPRINT(buf, f, ...)         format::snprint(buf, 65535, FMT(f), ##__VA_ARGS__)
+#define SNPRINT(buf, size, f, ...)  format::snprint(buf, size, FMT(f), ##__VA_ARGS__)
+
+#endif // FORMAT_HPP
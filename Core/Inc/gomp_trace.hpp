@@ -0,0 +1,93 @@
+// gomp_trace.hpp
+//
+// An OMPT-style tool interface for the bare metal libgomp.
+//
+// libgomp calls GOMP_TOOL(event, arg) at interesting points in the runtime (parallel begin/end,
+// task create/schedule/complete, barrier enter/exit, critical acquire/release). If a tool callback
+// is installed it is called with the event and a small event-specific argument. The default tool
+// is the trace recorder, which writes a compact timestamped record into a RAM ring buffer without
+// printing anything, so it does not perturb the timing of the code being traced. The "trace"
+// command dumps the ring buffer.
+//
+// The whole interface can be compiled out by defining GOMP_TRACE to 0.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef GOMP_TRACE_HPP
+#define GOMP_TRACE_HPP
+
+#include <stdint.h>
+
+#ifndef GOMP_TRACE
+#define GOMP_TRACE 1                        // 1 to compile in the tool callbacks, 0 to remove them
+#endif
+
+#ifndef GOMP_TRACE_RECORDS
+#define GOMP_TRACE_RECORDS 32               // number of records in the trace ring buffer, must be a power of 2
+#endif
+
+
+// the events reported to the tool
+enum gomp_event : uint8_t
+    {
+    GOMP_EV_PARALLEL_BEGIN,                 // arg = requested number of threads
+    GOMP_EV_PARALLEL_END,                   // arg = number of threads in the team
+    GOMP_EV_IMPLICIT_CREATE,                // arg = task index
+    GOMP_EV_IMPLICIT_BEGIN,                 // arg = task index
+    GOMP_EV_IMPLICIT_END,                   // arg = task index
+    GOMP_EV_TASK_CREATE,                    // arg = task index
+    GOMP_EV_TASK_BEGIN,                     // arg = task index, or GOMP_TRACE_INLINE if the task was run undeferred
+    GOMP_EV_TASK_END,                       // arg = task index, or GOMP_TRACE_INLINE if the task was run undeferred
+    GOMP_EV_BARRIER_ENTER,                  // arg = thread number within the team
+    GOMP_EV_BARRIER_EXIT,                   // arg = thread number within the team
+    GOMP_EV_CRITICAL_ACQUIRE,               // arg = number of times the thread had to wait
+    GOMP_EV_CRITICAL_RELEASE,               // arg = thread number within the team
+    GOMP_EV_CANCEL,                         // arg = the construct being cancelled (GOMP_CANCEL_*)
+    GOMP_EV_TASK_DISCARD,                   // arg = task index of a queued task discarded by cancellation
+    GOMP_EV_NUM_EVENTS
+    };
+
+static const unsigned GOMP_TRACE_INLINE = 0xFFFF;  // task arg for a task that was executed immediately rather than queued
+
+
+// a trace record, eight bytes
+struct gomp_trace_rec
+    {
+    uint32_t time;                          // cycle counter when the event occurred
+    uint8_t event;                          // a gomp_event
+    uint8_t thread;                         // index of the thread in omp_threads
+    uint16_t arg;                           // event specific argument
+    };
+
+
+// the signature of a tool callback
+typedef void GOMP_TOOL_CALLBACK(gomp_event event, unsigned arg);
+
+
+#if GOMP_TRACE
+
+extern GOMP_TOOL_CALLBACK *gomp_tool_callback;      // the currently installed tool, 0 if none
+
+#define GOMP_TOOL(event, arg)                                   \
+    do  {                                                       \
+        if(gomp_tool_callback)                                  \
+            {                                                   \
+            gomp_tool_callback(event, (unsigned)(arg));         \
+            }                                                   \
+        } while(0)
+
+#else
+
+#define GOMP_TOOL(event, arg) do {} while(0)
+
+#endif
+
+
+// the default tool, records events in the trace buffer
+extern GOMP_TOOL_CALLBACK gomp_trace_record;
+
+extern void gomp_trace_clear();             // empty the trace buffer
+extern void gomp_trace_dump();              // print the trace buffer
+
+#endif // GOMP_TRACE_HPP
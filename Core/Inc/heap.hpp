@@ -0,0 +1,37 @@
+// heap.hpp
+//
+// The heap allocator's extras: giving it a region, the "mem" report, and the allocation profiler.
+//
+// The profiler tags each allocated block with the return address of the call to malloc and a
+// sequence number, and keeps the count, live bytes, peak bytes and a size histogram of each call
+// site in a fixed table. heap_report prints the sites holding the most memory, and heap_snapshot
+// followed later by heap_diff lists the blocks allocated in between that are still allocated,
+// which finds what a command leaks. The addresses can be turned into function names on the host
+// with host/heapsym.sh and the ELF file.
+//
+// The tag costs 8 bytes in every block, so the profiler is off unless MALLOC_PROFILE is 1.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MALLOC_PROFILE
+#define MALLOC_PROFILE 0                    // 1 to keep per call site heap statistics
+#endif
+
+#define HEAP_SITES 32                       // the number of call sites the profiler can tell apart
+#define HEAP_SIZE_CLASSES 8                 // the size histogram: up to 16, 32, ... 1024, and larger
+
+extern void malloc_pool(void *start, uintptr_t size);  // use a region for the heap instead of the linker's
+extern "C" void *malloc_at(size_t size, void *site);   // malloc, counted against site instead of the caller
+extern void mem();                                      // print heap use and fragmentation
+extern void heap_report(unsigned top);                  // print the top call sites
+extern void heap_snapshot();                            // start looking for leaks
+extern void heap_diff();                                // list what was allocated since the snapshot and not freed
+
+#endif // HEAP_HPP
@@ -10,19 +10,36 @@
 #include "context.hpp"
 #include "LinkedList.hpp"
 
-#define GOMP_STACK_SIZE 3072
+#define GOMP_STACK_SIZE 3072                        // the default stack size of a worker thread (OMP_STACKSIZE)
+#define GOMP_MIN_STACK_SIZE 512                     // the smallest stack OMP_STACKSIZE can ask for
+#define GOMP_STACK_ARENA (3*GOMP_STACK_SIZE)        // RAM reserved for worker stacks, the upper limit of GOMP_STACK_BUDGET
 
-#define GOMP_MAX_NUM_THREADS 6
+#define GOMP_MAX_NUM_THREADS 6                      // size of the thread table, including threads that have not been created yet
+#define GOMP_FIRST_WORKER 3                         // the threads below this one have static stacks, the rest are created on demand
 #define GOMP_NUM_TEAMS 4
 #define GOMP_NUM_TASKS 16
+#define GOMP_DOACROSS_DEPTH 4                       // doacross dependences are tracked per iteration in nests this deep, per outer iteration in deeper ones
+#define GOMP_TASK_RESERVE 4                         // tasks that GOMP_task leaves in the pool, for the implicit tasks of a parallel
 
 #define OMP_NUM_THREADS 4
+#define GOMP_IDLE_TIME 1000                         // default msec a created thread may be idle before it is retired, 0 = never
 
 extern void libgomp_init();
 extern void libgomp_reinit();
 
+// runtime configuration, the equivalent of the OpenMP environment variables
+extern bool gomp_setenv(const char *name, const char *value);  // set one variable, returns false if the name or value is bad
+extern bool gomp_putenv(char *line);                            // set a variable from a "NAME=value" line
+extern bool libgomp_config(const char *path);                   // read "NAME=value" lines from a file, returns false if there is no such file
+extern void gomp_print_env();                                   // print the settings and the state of the thread pool
+extern void gomp_trim_threads(bool all);                        // retire idle created threads, all of them or just those idle for GOMP_IDLE_TIME
+
 extern "C" int gomp_get_thread_id();
 
+struct omp_thread;
+class Arena;
+extern void gomp_tls_init(omp_thread &thread);                  // set up the thread local storage (threadprivate) of a thread that is being started
+
 
 extern int omp_verbose;
 #define OMP_VERBOSE_DEFAULT 0
@@ -31,12 +48,67 @@ extern int omp_verbose;
 typedef void TASKFN(void *);
 
 
+// a taskgroup, which waits for all the tasks created within it, and their descendants
+struct taskgroup
+    {
+    taskgroup *prev;        // the enclosing taskgroup, if any
+    int count;              // number of tasks in the group that have not completed
+    bool cancelled;         // the group has been cancelled, its queued tasks will be discarded
+    };
+
+// a taskloop, the shared state of the tasks that run its chunks
+// Each task claims chunks from "next" until there are none left, so the number of tasks
+// is independent of the number of chunks, and nothing is allocated per chunk.
+struct taskloop
+    {
+    TASKFN *fn;             // the loop body generated by OMP, the first two words of its data are the chunk bounds
+    char *data;             // the loop body's data, the creator's own or a copy following this struct
+    void (*cpyfn)(void *, void *);  // copies the data, if the body has firstprivate variables that need it
+    long arg_size;          // size and alignment of the data
+    long arg_align;
+    bool ull;               // the bounds are unsigned long long rather than long
+    uint64_t start;         // the first iteration
+    uint64_t step;          // the loop increment
+    unsigned chunks;        // number of chunks
+    unsigned base;          // iterations in each chunk
+    unsigned extra;         // the first "extra" chunks get one more iteration
+    unsigned next;          // the next chunk to be claimed
+    unsigned refs;          // number of tasks that still refer to this struct
+    bool heap;              // this struct was malloced, and is freed by the last task
+    };
+
+// a worksharing loop scheduled by the runtime: ordered loops, doacross loops, and the schedules that GCC does not inline
+// The iterations are numbered 0..n-1, and converted to values of the loop variable when they are handed out.
+// A team has one of these, used by one loop at a time. Each member's place in the loop is kept in its omp_thread.
+struct workshare
+    {
+    unsigned gen;           // the number of loops the team has started, compared with each member's loop_gen to find the first to arrive
+    unsigned ready;         // the loop whose state is in this struct, the others wait until it is the one they are starting
+    int users;              // members that have not yet ended the loop, the next loop can't be set up until this is 0
+    int sched;              // how the iterations are handed out, GOMP_SCHED_*
+    bool ordered;           // the loop has an ordered clause, and the chunks' ordered regions run in chunk order
+    bool ull;               // the loop variable is unsigned long long rather than long
+    uint64_t n;             // number of iterations
+    uint64_t chunk;         // iterations per chunk, with a static schedule 0 gives each member one block
+    uint64_t start;         // the loop variable of the first iteration
+    uint64_t incr;          // the loop increment
+    uint64_t next;          // the next iteration to be handed out (dynamic and guided)
+    unsigned next_chunk;    // the sequence number of the next chunk to be handed out (dynamic and guided)
+    unsigned ticket;        // the chunk whose thread may run its ordered region, passed on as each chunk ends
+    unsigned ncounts;       // doacross: number of loops in the nest, 0 if not a doacross loop
+    uint64_t counts[GOMP_DOACROSS_DEPTH];   // doacross: the iteration counts of the loops in the nest
+    uint64_t inner;         // doacross: number of iterations of the inner loops per iteration of the outer one
+    };
+
 // a task is defined by code and data
 struct task
     {
     TASKFN *fn;             // the thread function generated by OMP
     char *data;             // the thread's local data pointer
     task *next;             // pointer to the next task in a list
+    struct taskgroup *taskgroup;    // the taskgroup the task belongs to, if any
+    struct taskloop *loop;  // if the task runs chunks of a taskloop, the taskloop, and fn and data are unused
+    Arena *arena;           // the arena of the creating thread, which its data (or a nogroup taskloop) came from
     };
 
 // an omp_thread
@@ -44,12 +116,16 @@ struct omp_thread
     {
     // the thread's context
     Context context;        // the thread's registers
+    char *tls = 0;          // the thread pointer returned by __aeabi_read_tp, the thread's TLS block. Follows the Context so the load is one LDR from r9
 
     int id = 0;             // a unique ID for each thread, also the index into the thread table
     int team_id = 0;        // the number of a thread within the team
     const char *name = 0;   // optional thread name, for debug
 
     struct task *task = 0;  // the thread's implicit task, nonzero if running
+    struct taskgroup *taskgroup = 0;    // the innermost taskgroup of the running task
+    bool in_final = false;  // the running task is final, so every task it creates is run immediately
+    Arena *arena = 0;       // the arena that task data is allocated from, 0 to use the heap (see arena.hpp)
 
     omp_thread *team = 0;   // pointer to the master thread of the team this thread is a member of
     omp_thread *next = 0;   // link to the next team member
@@ -58,6 +134,19 @@ struct omp_thread
     bool arrived = false;   // arrived at a barrier, waiting for other threads to arrive
     bool mwaiting = false;  // waiting on a mutex
     bool twaiting = false;   // indicates when a thread is waiting for a task. Not affected by wait for event, etc.
+    bool retire = false;    // tells an idle thread to terminate, so its stack can be returned to the arena
+    uint32_t idle_since = 0;    // time the thread was returned to the thread pool, in usec
+
+    // this thread's place in the team's current worksharing loop
+    unsigned loop_gen = 0;  // the number of loops this thread has started
+    unsigned chunks = 0;    // the number of chunks it has taken from the current loop
+    unsigned chunk_seq = 0; // the sequence number of its current chunk, the ticket it needs for its ordered region
+    uint64_t chunk_start = 0;   // its current chunk of iterations, empty if it has none
+    uint64_t chunk_end = 0;
+    uint64_t posted = 0;    // doacross: the flattened iteration number after the last one it has posted
+    uint64_t wait_outer = 0;    // doacross: the outer iteration, and flattened iteration, it is waiting for
+    uint64_t wait_flat = 0;
+    bool owaiting = false;  // suspended waiting for its turn in an ordered region, or for a doacross dependence
 
     // stuff pertaining to this thread as a team master
     int team_count = 0;
@@ -69,6 +158,10 @@ struct omp_thread
     int section = 0;
     int task_count = 0;
     LinkedList<struct task, &task::next> task_list;  // list of explicit tasks for this team
+    int task_queued = 0;    // number of tasks in task_list
+    bool cancelled = false;         // the parallel region has been cancelled
+    bool ws_cancelled = false;      // the current worksharing construct (for, sections) has been cancelled
+    struct workshare loop = {};     // the current runtime scheduled loop
     void *copyprivate = 0;
 
     // debug data
@@ -81,11 +174,7 @@ extern omp_thread omp_threads[GOMP_MAX_NUM_THREADS];
 extern "C"
 inline omp_thread *omp_this_thread()
     {
-    omp_thread *thread;
-
-    __asm__ __volatile__("    mov %[thread], r9" : [thread]"=r"(thread));
-
-    return thread;
+    return (omp_thread *)Context::pointer();    // r9 points to the Context of the running thread, which is the first member of its omp_thread
     }
 
 
@@ -105,6 +194,14 @@ void libgomp_start_thread(omp_thread &thread, THREADFN *code, char (&stack)[N],
     thread.context.spawn(code, stack, arg);
     }
 
+// start a thread on a stack that was allocated at runtime
+inline void libgomp_start_thread(omp_thread &thread, THREADFN *code, char *stack, unsigned size, uintptr_t arg)
+    {
+    thread.stack_low = stack;
+    thread.stack_high = stack + size;
+    thread.context.start(code, &stack[size-8], arg);   // reserve two words at stack top, as spawn does
+    }
+
 // called by background to poll all the threads and resume them if they have something to do
 extern void gomp_poll_threads();
 
@@ -9,8 +9,27 @@
 #define MAXPRINTF 128
 #define INBUFLEN 64
 #define NHISTORY 8
+#define CMDARENA 512                    // bytes of the arena for the allocations of each command
+#define NFILES 2                        // FatFs files that can be open at once, see file_pool in interp.cpp
+#define CONSOLE_OVERFLOW CONSOLE_BLOCK  // when the output is full: CONSOLE_BLOCK, CONSOLE_DROP_OLDEST, or CONSOLE_DROP_NEW
+#define CONSOLE_COALESCE 64             // output that fills a USB packet is sent without waiting for the end of the line
+#define CONSOLE_IDLE 2000               // microseconds the start of a line waits for the rest before it is sent
+
+// what console output does when the ring is full, see serial.cpp, and VCP_TX_RING in usbd_cdc_if.h
+typedef enum
+    {
+    CONSOLE_BLOCK,                      // wait for room
+    CONSOLE_DROP_OLDEST,                // discard the oldest output, all that waits behind the transfer in progress
+    CONSOLE_DROP_NEW,                   // discard the new output
+    } ConsoleOverflowPolicy;
+
+extern ConsoleOverflowPolicy ConsoleOverflow;
+extern unsigned ConsoleDrops;           // characters discarded
+extern unsigned ConsolePeak;            // the most characters that have been waiting to be sent
+extern bool ConsoleCoalesce;            // false to send each write at once
 
 extern void dump(void *p, int size);
+extern char *dump_line(char *buf, const unsigned char *p, int size);
 extern void getline(char *buf, int size);
 extern int getdec(char **p);
 extern uint64_t getlong(char **p);
@@ -19,8 +38,6 @@ extern void skip(char **p);
 
 #define izdigit(p) (*p=='o' || ('0'<=*p&&*p<='9') || ('a'<=*p&&*p<='a') || ('A'<=*p&&*p<='A'))
 
-#define fflush(x)
-
 #if __cplusplus
 extern "C" {
 #endif
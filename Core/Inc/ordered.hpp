@@ -0,0 +1,29 @@
+// ordered.hpp
+//
+// A test and benchmark of "ordered" and doacross loops, see ordered.cpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef ORDERED_HPP
+#define ORDERED_HPP
+
+#include <stdint.h>
+
+// how crc_stream runs the loop
+enum
+    {
+    CRC_SERIAL,                             // no OpenMP, the baseline
+    CRC_STATIC,                             // ordered, schedule(static)
+    CRC_STATIC1,                            // ordered, schedule(static, 1)
+    CRC_DYNAMIC1,                           // ordered, schedule(dynamic, 1)
+    CRC_GUIDED,                             // ordered, schedule(guided)
+    CRC_DOACROSS,                           // ordered(1) with depend(sink: i-1), schedule(static, 1)
+    CRC_NUM_MODES
+    };
+
+extern const char *crc_stream_modes[CRC_NUM_MODES];     // the names of the modes
+
+extern uint32_t crc_stream(int blocks, int mode, int threads);
+
+#endif // ORDERED_HPP
@@ -0,0 +1,29 @@
+// palgo.hpp
+//
+// A test and benchmark of the parallel algorithms in parallel.hpp, see palgo.cpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef PALGO_HPP
+#define PALGO_HPP
+
+#include <stdint.h>
+
+#define PALGO_MAX (512/4)                   // largest array used by the for, scan, and sort benchmarks, the words of qbuf
+
+// which algorithm palgo_bench runs
+enum
+    {
+    PALGO_FOR,                              // parallel_for, fill an array with hashes
+    PALGO_REDUCE,                           // parallel_reduce, sum hashes without an array
+    PALGO_SCAN,                             // parallel_inclusive_scan of an array of hashes
+    PALGO_SORT,                             // parallel_sort of an array of hashes
+    PALGO_NUM_ALGOS
+    };
+
+extern const char *palgo_names[PALGO_NUM_ALGOS];        // the names of the algorithms
+
+extern uint32_t palgo_bench(int algo, int n, bool parallel);
+
+#endif // PALGO_HPP
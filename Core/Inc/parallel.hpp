@@ -0,0 +1,316 @@
+// parallel.hpp
+//
+// Parallel algorithms on top of the bare metal libgomp.
+//
+// parallel_for, parallel_reduce, parallel_inclusive_scan, and parallel_sort keep the OpenMP
+// pragmas, and the limits of the runtime, out of application code:
+// -- a team is no bigger than the number of grains of work, the OpenMP thread limit, or GOMP_MAX_NUM_THREADS
+// -- work of one grain or less runs serially, without starting a team
+// -- parallel_sort recurses on the smaller partition and loops on the larger, so its stack depth is
+//    logarithmic, and stops creating tasks PARALLEL_TASK_DEPTH levels down, so the worker stacks
+//    and the task pool are enough for any size of array
+//
+// The per-thread partial results of parallel_reduce and parallel_inclusive_scan are combined in
+// thread order, so the result does not depend on how the threads were scheduled.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <omp.h>
+#include "libgomp.hpp"
+
+#define PARALLEL_TASK_DEPTH 4               // parallel_sort creates tasks for this many levels of partitioning
+#define PARALLEL_SORT_SMALL 16              // partitions this small are insertion sorted
+
+
+// a range of indices
+struct Range
+    {
+    long first;                             // the first index
+    long last;                              // one past the last index
+
+    long size() const
+        {
+        return last > first ? last - first : 0;
+        }
+    };
+
+
+// the number of threads worth using for n items, with at least grain items for each
+inline int parallel_threads(long n, long grain)
+    {
+    long threads = omp_get_max_threads();
+
+    if(grain < 1)
+        {
+        grain = 1;
+        }
+    if(threads > GOMP_MAX_NUM_THREADS)
+        {
+        threads = GOMP_MAX_NUM_THREADS;
+        }
+    if(threads > n / grain)
+        {
+        threads = n / grain;
+        }
+
+    return threads < 1 ? 1 : threads;
+    }
+
+
+// the part of a range that member "id" of a team of "threads" works on, the same partition as a static schedule
+inline Range parallel_block(Range r, int id, int threads)
+    {
+    long q = r.size() / threads;
+    long rem = r.size() % threads;
+    long first = r.first + id*q + (id < rem ? id : rem);
+
+    return Range{first, first + q + (id < rem)};
+    }
+
+
+// call fn(i) for each i in the range, grain is the number of indices handed to a thread at a time
+template<typename F>
+void parallel_for(Range r, long grain, F fn)
+    {
+    int threads = parallel_threads(r.size(), grain);
+
+    if(threads == 1)
+        {
+        for(long i=r.first; i<r.last; i++)
+            {
+            fn(i);
+            }
+        return;
+        }
+
+    #pragma omp parallel for schedule(dynamic, grain) num_threads(threads)
+    for(long i=r.first; i<r.last; i++)
+        {
+        fn(i);
+        }
+    }
+
+
+// combine map(i) for each i in the range with reduce, starting from identity
+// Each thread reduces a contiguous block of the range, and the blocks' results are reduced in order,
+// so reduce must be associative, but need not be commutative.
+template<typename T, typename M, typename R>
+T parallel_reduce(Range r, long grain, T identity, M map, R reduce)
+    {
+    int threads = parallel_threads(r.size(), grain);
+    T partial[GOMP_MAX_NUM_THREADS];
+    T result = identity;
+
+    if(threads == 1)
+        {
+        for(long i=r.first; i<r.last; i++)
+            {
+            result = reduce(result, map(i));
+            }
+        return result;
+        }
+
+    #pragma omp parallel num_threads(threads)
+        {
+        int id = omp_get_thread_num();
+        Range block = parallel_block(r, id, omp_get_num_threads());
+        T sum = identity;
+
+        for(long i=block.first; i<block.last; i++)
+            {
+            sum = reduce(sum, map(i));
+            }
+        partial[id] = sum;
+
+        if(id == 0)
+            {
+            threads = omp_get_num_threads();    // the team may be smaller than asked for
+            }
+        }
+
+    for(int i=0; i<threads; i++)
+        {
+        result = reduce(result, partial[i]);
+        }
+
+    return result;
+    }
+
+
+// out[i] = in[0] op in[1] op ... op in[i], out may be the same as in
+// Each thread scans its block, the blocks' totals are scanned, and each thread adds the total
+// of the blocks before it to its own. This does about twice the work of a serial scan.
+template<typename T, typename Op>
+void parallel_inclusive_scan(const T *in, T *out, long n, long grain, Op op)
+    {
+    int threads = parallel_threads(n, grain);
+    T total[GOMP_MAX_NUM_THREADS];
+
+    if(threads == 1)
+        {
+        for(long i=0; i<n; i++)
+            {
+            out[i] = i ? op(out[i-1], in[i]) : in[i];
+            }
+        return;
+        }
+
+    #pragma omp parallel num_threads(threads)
+        {
+        int id = omp_get_thread_num();
+        int team = omp_get_num_threads();
+        Range block = parallel_block(Range{0, n}, id, team);
+
+        for(long i=block.first; i<block.last; i++)
+            {
+            out[i] = i > block.first ? op(out[i-1], in[i]) : in[i];
+            }
+        total[id] = block.size() ? out[block.last-1] : T();
+
+        #pragma omp barrier
+
+        if(id > 0 && block.size())
+            {
+            T before = total[0];                // the total of the blocks before this one
+            for(int k=1; k<id; k++)
+                {
+                before = op(before, total[k]);
+                }
+
+            for(long i=block.first; i<block.last; i++)
+                {
+                out[i] = op(before, out[i]);
+                }
+            }
+        }
+    }
+
+
+// partition [first, last) around the median of the first, middle, and last elements
+// returns the split, every element before it is not greater than every element from it on, and both parts are non-empty
+template<typename T, typename Less>
+T *parallel_partition(T *first, T *last, Less &less)
+    {
+    T *mid = first + (last - first) / 2;
+    T tmp;
+
+    if(less(*mid, *first))
+        {
+        tmp = *mid; *mid = *first; *first = tmp;
+        }
+    if(less(last[-1], *mid))
+        {
+        tmp = *mid; *mid = last[-1]; last[-1] = tmp;
+        if(less(*mid, *first))
+            {
+            tmp = *mid; *mid = *first; *first = tmp;
+            }
+        }
+
+    T pivot = *mid;
+    T *i = first - 1;
+    T *j = last;
+
+    while(true)
+        {
+        do ++i; while(less(*i, pivot));
+        do --j; while(less(pivot, *j));
+
+        if(i >= j)
+            {
+            return j + 1;
+            }
+
+        tmp = *i; *i = *j; *j = tmp;
+        }
+    }
+
+
+// sort [first, last) serially, with stack depth logarithmic in its size
+template<typename T, typename Less>
+void parallel_sort_serial(T *first, T *last, Less &less)
+    {
+    while(last - first > PARALLEL_SORT_SMALL)
+        {
+        T *split = parallel_partition(first, last, less);
+
+        if(split - first < last - split)        // recurse on the smaller part, and loop on the larger
+            {
+            parallel_sort_serial(first, split, less);
+            first = split;
+            }
+        else
+            {
+            parallel_sort_serial(split, last, less);
+            last = split;
+            }
+        }
+
+    for(T *p=first+1; p<last; p++)            // insertion sort what is left
+        {
+        T x = *p;
+        T *q = p;
+
+        for(; q>first && less(x, q[-1]); --q)
+            {
+            *q = q[-1];
+            }
+        *q = x;
+        }
+    }
+
+
+// sort [first, last), making a task of the smaller part of each partition, until the parts are smaller than grain
+template<typename T, typename Less>
+void parallel_sort_task(T *first, T *last, long grain, Less less, int depth)
+    {
+    while(last - first > grain && depth < PARALLEL_TASK_DEPTH)
+        {
+        T *split = parallel_partition(first, last, less);
+        T *sfirst = first;
+        T *slast = split;
+
+        if(split - first < last - split)
+            {
+            first = split;
+            }
+        else
+            {
+            sfirst = split;
+            slast = last;
+            last = split;
+            }
+
+        #pragma omp task firstprivate(sfirst, slast, grain, less, depth)
+        parallel_sort_task(sfirst, slast, grain, less, depth+1);
+
+        ++depth;
+        }
+
+    parallel_sort_serial(first, last, less);
+    }
+
+
+// sort [first, last) so that less(b, a) is false for every a before b
+// grain is the size below which a part is sorted by one thread
+template<typename T, typename Less>
+void parallel_sort(T *first, T *last, long grain, Less less)
+    {
+    int threads = parallel_threads(last - first, grain);
+
+    if(threads == 1)
+        {
+        parallel_sort_serial(first, last, less);
+        return;
+        }
+
+    #pragma omp parallel num_threads(threads)
+    #pragma omp single nowait                   // the other threads go straight to running the tasks
+    parallel_sort_task(first, last, grain, less, 0);
+    }
+
+#endif // PARALLEL_HPP
@@ -4,11 +4,8 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
-#include "Fifo.hpp"
-
 extern volatile bool ControlC;
 extern bool SerialRaw;
-extern FIFO<char, 64> ConsoleFifo;
 extern bool PollRx();
 extern bool __io_kbhit();
 extern bool __io_txrdy();
@@ -22,6 +19,9 @@ int __io_putchar(int ch);
 int __io_getchar();
 int __io_getchart(unsigned time);
 int _write(int file, const char *ptr, int len);
+void console_init();                    // start the thread that sends output left waiting for the rest of its line
+void console_flush();                   // wait until the console output has been sent
+int console_read(void *buf, int n, unsigned timeout);   // read n bytes, or fewer if none come for timeout us
 
 int vcp_kbhit();
 int vcp_getchar();
@@ -1,16 +1,18 @@
 // this is an extremely lightweight calloc
-// I assume that nothing is ever freed
 
-extern "C" void *malloc(unsigned s);
-extern "C" void *memset(void *dest, int c, unsigned n);
+#include <string.h>
+#include "heap.hpp"
 
 
 extern "C"
-void *calloc(unsigned num, unsigned size)
+void *calloc(size_t num, size_t size)
     {
     char *tmp;
 
-    tmp = (char *)malloc(num*size);     // get the block of memory
-    memset(tmp,0,num*size);             // set the memory to zero
+    tmp = (char *)malloc_at(num*size, __builtin_return_address(0));     // get the block of memory, charged to our caller
+    if(tmp)
+        {
+        memset(tmp,0,num*size);         // set the memory to zero
+        }
     return (void *)tmp;
     }
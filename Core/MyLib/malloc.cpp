@@ -1,8 +1,47 @@
+// malloc, free, memalign, and aligned_alloc
+//
+// A two-level segregated fit (TLSF) allocator. Every free block is on a list selected by its size:
+// the first level is the power of two, and the second level divides each power of two into
+// SL_COUNT equal ranges. A bitmap of the non-empty lists at each level lets malloc find a list of
+// blocks that are all big enough with two count-leading-zeros, so malloc and free take the same
+// time whatever the state of the heap.
+//
+// Each block starts with an 8 byte header, the address of the block physically before it and the
+// size of the block. A freed block is merged with free neighbours, so the heap does not fill up
+// with small fragments, and any size up to the size of the heap can be allocated. Memory is
+// returned 8-byte aligned, or aligned as asked by memalign.
+//
+// The heap is the region between _break and _heap_end in the linker script, taken on the first
+// call. malloc_pool can give the allocator some other region instead, as the host test does.
+// malloc returns 0 if there is not enough memory.
+//
+// Freed blocks of up to QUICK_MAX bytes are not merged right away, but pushed on a quick list of
+// blocks of their size, and malloc takes a block of that size from it. The quick lists are lock
+// free stacks updated with LDREX/STREX, so the common small allocations, libgomp's task data, don't
+// disable interrupts and can be made from interrupt handlers. An interrupt between the LDREX and
+// the STREX makes the STREX fail, because exception entry and return clear the exclusive monitor,
+// so a pop can't be fooled by a block that was popped and pushed again meanwhile (the ABA problem).
+// The quick lists hold at most an eighth of the heap, and their blocks are returned to the heap
+// and merged whenever malloc has to go to the heap, so they fragment it no more than before. The
+// blocks are popped from the lists like any other, and each one is merged with interrupts disabled
+// on its own, so draining the lists adds no more than one merge to the time that interrupts are
+// disabled. A block on a quick list has the QUICK bit set in its size, so freeing it again is caught.
+//
+// If MALLOC_PROFILE is set in heap.hpp, each allocated block is tagged with the place it was
+// allocated from and a sequence number, and the statistics of each place are kept in a small
+// open addressed table. heap_report prints the places that use the most memory, and heap_diff
+// lists the blocks allocated since heap_snapshot that have not been freed.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
 #include <stdio.h>
 #include <stdint.h>
-#include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 #include "CriticalRegion.hpp"
+#include "cmsis.h"
+#include "heap.hpp"
 
 extern int omp_verbose;
 #define DPRINT(level) if(omp_verbose>=level)printf
@@ -14,83 +53,798 @@ extern uintptr_t _break;
 
 struct MemBlock
     {
-    union
+    MemBlock *prev;                             // the block physically before this one, 0 for the first block
+    uintptr_t size;                             // the size of the block including this header, and the FREE and QUICK bits
+    MemBlock *next_free;                        // free blocks only, the links of the block's free list
+    MemBlock *prev_free;
+    };
+
+static const unsigned ALIGN = 8;                // the alignment and granularity of the blocks
+static const unsigned HEADER = offsetof(MemBlock, next_free);   // the part of MemBlock that is in every block, 8 bytes
+static const unsigned MINBLOCK = sizeof(MemBlock);  // a free block must hold the whole MemBlock
+static const uintptr_t FREE = 1;                // the block is on a free list
+static const uintptr_t QUICK = 2;               // the block is on a quick list, as far as the heap knows it is allocated
+static const unsigned PREFIX = MALLOC_PROFILE ? 8 : 0;     // the profiler's tag, between the header and the data
+static const unsigned DATA = HEADER + PREFIX;   // the offset of the data in an allocated block
+
+static const unsigned SL_LOG2 = 2;              // log2 of the number of second level lists
+static const unsigned SL_COUNT = 1 << SL_LOG2;
+static const unsigned FL_SHIFT = SL_LOG2 + 3;   // blocks smaller than 1<<FL_SHIFT are on the first level 0, in steps of ALIGN
+static const unsigned FL_MAX_LOG2 = 16;         // blocks must be smaller than 64K
+static const unsigned FL_COUNT = FL_MAX_LOG2 - FL_SHIFT + 1;
+
+static uint32_t fl_bitmap;                      // bit f is set if any of second level lists of first level f is non-empty
+static uint32_t sl_bitmap[FL_COUNT];            // bit s is set if FreeBlocks[f][s] is non-empty
+static MemBlock *FreeBlocks[FL_COUNT][SL_COUNT];
+
+static const unsigned QUICK_MAX = 128;          // freed blocks up to this size go on the quick lists
+static const unsigned QUICK_COUNT = (QUICK_MAX - MINBLOCK) / ALIGN + 1;
+static MemBlock *volatile quick[QUICK_COUNT];   // lock free stacks of freed blocks of each size, linked by next_free
+static uintptr_t volatile quick_bytes;          // bytes in the blocks on the quick lists
+static uintptr_t quick_limit;                   // the most the quick lists may hold, an eighth of the heap
+
+static char *heap_low = 0;                      // the region being managed
+static char *heap_high = 0;
+static uintptr_t heap_used = 0;                 // bytes in allocated blocks, including their headers
+
+
+static inline uintptr_t block_size(MemBlock *blk)
+    {
+    return blk->size & ~(FREE | QUICK);
+    }
+
+static inline bool block_free(MemBlock *blk)
+    {
+    return blk->size & FREE;
+    }
+
+static inline bool block_quick(MemBlock *blk)
+    {
+    return blk->size & QUICK;
+    }
+
+static inline MemBlock *block_next(MemBlock *blk)
+    {
+    return (MemBlock *)((char *)blk + block_size(blk));
+    }
+
+static inline int high_bit(uint32_t x)          // the number of the highest set bit
+    {
+    return 31 - __builtin_clz(x);
+    }
+
+static inline int low_bit(uint32_t x)           // the number of the lowest set bit
+    {
+    return __builtin_ctz(x);
+    }
+
+
+// the list that holds free blocks of a given size
+static inline void mapping(uintptr_t size, unsigned &fl, unsigned &sl)
+    {
+    if(size < (1u << FL_SHIFT))
+        {
+        fl = 0;
+        sl = size / ALIGN;
+        }
+    else
+        {
+        int t = high_bit(size);
+        sl = (size >> (t - SL_LOG2)) ^ SL_COUNT;
+        fl = t - FL_SHIFT + 1;
+        }
+    }
+
+
+// the first list whose blocks are all at least size bytes, or 0 if there is none
+static MemBlock **find_list(uintptr_t size, unsigned &fl, unsigned &sl)
+    {
+    if(size >= (1u << FL_SHIFT))
+        {
+        size += (1u << (high_bit(size) - SL_LOG2)) - 1;      // round up to the next list, smaller blocks share this one
+        }
+    mapping(size, fl, sl);
+    if(fl >= FL_COUNT)
+        {
+        return 0;
+        }
+
+    uint32_t map = sl_bitmap[fl] & (~0u << sl);
+    if(map == 0)
         {
-        MemBlock *next;
-        unsigned bucket;
-        };
-    uintptr_t useable;
+        map = fl_bitmap & (~0u << (fl + 1));
+        if(map == 0)
+            {
+            return 0;
+            }
+        fl = low_bit(map);
+        map = sl_bitmap[fl];
+        }
+    sl = low_bit(map);
+
+    return &FreeBlocks[fl][sl];
+    }
+
+
+static void insert_free(MemBlock *blk)
+    {
+    unsigned fl, sl;
+    mapping(block_size(blk), fl, sl);
+
+    blk->size |= FREE;
+    blk->prev_free = 0;
+    blk->next_free = FreeBlocks[fl][sl];
+    if(blk->next_free)
+        {
+        blk->next_free->prev_free = blk;
+        }
+    FreeBlocks[fl][sl] = blk;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+    }
+
+
+static void remove_free(MemBlock *blk)
+    {
+    unsigned fl, sl;
+    mapping(block_size(blk), fl, sl);
+
+    if(blk->next_free)
+        {
+        blk->next_free->prev_free = blk->prev_free;
+        }
+    if(blk->prev_free)
+        {
+        blk->prev_free->next_free = blk->next_free;
+        }
+    else
+        {
+        FreeBlocks[fl][sl] = blk->next_free;
+        if(FreeBlocks[fl][sl] == 0)
+            {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if(sl_bitmap[fl] == 0)
+                {
+                fl_bitmap &= ~(1u << fl);
+                }
+            }
+        }
+    blk->size &= ~FREE;
+    }
+
+
+// make a block that starts "size" bytes into blk of the rest of blk, and free it, if it is big enough to be a block
+static void split(MemBlock *blk, uintptr_t size)
+    {
+    uintptr_t rest = block_size(blk) - size;
+
+    if(rest >= MINBLOCK)
+        {
+        MemBlock *tail = (MemBlock *)((char *)blk + size);
+        tail->prev = blk;
+        tail->size = rest;
+        blk->size = size | (blk->size & FREE);
+        block_next(tail)->prev = tail;
+        insert_free(tail);
+        }
+    }
+
+
+// merge a free block that is not on a list with the free blocks around it, and put the result on its list
+static void release(MemBlock *blk)
+    {
+    MemBlock *next = block_next(blk);
+
+    if(block_free(next))
+        {
+        remove_free(next);
+        blk->size += next->size;
+        block_next(blk)->prev = blk;
+        }
+
+    MemBlock *prev = blk->prev;
+    if(prev && block_free(prev))
+        {
+        remove_free(prev);
+        prev->size += blk->size;
+        block_next(prev)->prev = prev;
+        blk = prev;
+        }
+
+    insert_free(blk);
+    }
+
+
+// use a region of memory for the heap
+// It becomes one free block, followed by an empty allocated block that stops merges past the end.
+void malloc_pool(void *start, uintptr_t size)
+    {
+    char *low = (char *)(((uintptr_t)start + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1));
+    char *high = (char *)(((uintptr_t)start + size) & ~(uintptr_t)(ALIGN - 1));
+
+    for(auto &list : FreeBlocks)
+        {
+        for(auto &blk : list)
+            {
+            blk = 0;
+            }
+        }
+    for(auto &map : sl_bitmap)
+        {
+        map = 0;
+        }
+    for(auto &list : quick)
+        {
+        list = 0;
+        }
+    quick_bytes = 0;
+    quick_limit = (high - low) / 8;
+    fl_bitmap = 0;
+    heap_used = 0;
+
+    heap_low = low;
+    heap_high = high;
+
+    MemBlock *blk = (MemBlock *)low;
+    MemBlock *end = (MemBlock *)(high - HEADER);
+
+    blk->prev = 0;
+    blk->size = (char *)end - low;
+    end->prev = blk;
+    end->size = 0;
+    assert(blk->size >= MINBLOCK && blk->size < (1u << FL_MAX_LOG2));
+    insert_free(blk);
+    }
+
+
+// take the heap from the linker script the first time it is needed
+static inline void malloc_init()
+    {
+    if(heap_low == 0)
+        {
+        malloc_pool((void *)_break, (uintptr_t)&_heap_end - _break);
+        _break = (uintptr_t)&_heap_end;         // the heap now belongs to malloc, sbrk has none left
+        }
+    }
+
+
+// the quick list of blocks of a size
+static inline MemBlock *volatile &quick_list(uintptr_t bsize)
+    {
+    return quick[(bsize - MINBLOCK) / ALIGN];
+    }
+
+
+// push a freed block on its quick list, without disabling interrupts
+// Returns false if the quick lists are full, and the block must be freed to the heap.
+static inline bool quick_push(MemBlock *blk)
+    {
+    MemBlock *volatile &head = quick_list(block_size(blk));
+    uintptr_t bytes;
+
+    do
+        {
+        bytes = __LDREX(quick_bytes) + block_size(blk);
+        if(bytes > quick_limit)
+            {
+            __CLREX();
+            return false;
+            }
+        }
+    while(__STREX(bytes, quick_bytes));
+
+    blk->size |= QUICK;
+    do
+        {
+        blk->next_free = __LDREX(head);
+        }
+    while(__STREX(blk, head));
+
+    return true;
+    }
+
+
+// pop a block of bsize bytes from its quick list, or return 0 if there is none
+static inline MemBlock *quick_pop(uintptr_t bsize)
+    {
+    MemBlock *volatile &head = quick_list(bsize);
+    MemBlock *blk;
+
+    do
+        {
+        blk = __LDREX(head);
+        if(blk == 0)
+            {
+            __CLREX();
+            return 0;
+            }
+        }
+    while(__STREX(blk->next_free, head));
+
+    uintptr_t bytes;
+    do
+        {
+        bytes = __LDREX(quick_bytes);
+        bytes = bytes > bsize ? bytes - bsize : 0;  // an interrupt may have drained the lists since the pop
+        }
+    while(__STREX(bytes, quick_bytes));
+
+    blk->size &= ~QUICK;
+    return blk;
+    }
+
+
+// return the blocks on the quick lists to the heap, and merge them with their neighbors
+// Interrupts are disabled for one block at a time, so it must be called with them enabled.
+// Returns false if there were none.
+static bool quick_drain()
+    {
+    bool any = false;
+
+    for(uintptr_t bsize = MINBLOCK; bsize <= QUICK_MAX; bsize += ALIGN)
+        {
+        MemBlock *blk;
+
+        while((blk = quick_pop(bsize)) != 0)
+            {
+            CRITICAL_REGION(InterruptLock)
+                {
+                heap_used -= bsize;
+                release(blk);
+                }
+            any = true;
+            }
+        }
+
+    return any;
+    }
+
+
+#if MALLOC_PROFILE
+
+// the statistics of one place that calls malloc
+struct HeapSite
+    {
+    uintptr_t site;                             // the return address of the call, 0 if the entry is unused
+    uint32_t allocs;                            // the number of blocks allocated
+    uint32_t frees;                             // the number of them that have been freed
+    uint32_t live;                              // bytes in the blocks that have not been freed, including their headers
+    uint32_t peak;                              // the most that "live" has been
+    uint16_t sizes[HEAP_SIZE_CLASSES];          // a histogram of the sizes asked for: up to 16, 32, ... 1024, and more than 1024 bytes
     };
 
-static const unsigned MINSIZE = 8;
-static const unsigned MAXSIZE = 1024;
-static const unsigned SIZES = 8;
+// the tag of an allocated block
+struct HeapTag
+    {
+    uint32_t site;                              // the index of its site in heap_sites
+    uint32_t seq;                               // when it was allocated
+    };
 
-MemBlock *FreeBlocks[SIZES];
+static HeapSite heap_sites[HEAP_SITES + 1];     // the last entry collects the sites that didn't fit
+static uint32_t heap_seq = 0;                   // the number of blocks allocated so far
+static uint32_t heap_snap = 0;                  // heap_seq when heap_snapshot was called
 
+static inline HeapTag *block_tag(MemBlock *blk)
+    {
+    return (HeapTag *)((char *)blk + HEADER);
+    }
 
 
-extern "C"
-void *malloc(unsigned size)
+// find the entry of a site, or add one
+static unsigned site_index(uintptr_t site)
     {
-    MemBlock *blk = 0;
-    unsigned bucket;
+    unsigned i = (uint32_t)(site * 0x9E3779B9) >> 24;
+
+    for(unsigned probe=0; probe<HEAP_SITES; probe++, i++)
+        {
+        HeapSite &entry = heap_sites[i % HEAP_SITES];
+
+        if(entry.site == site)
+            {
+            return i % HEAP_SITES;
+            }
+        if(entry.site == 0)
+            {
+            entry.site = site;
+            return i % HEAP_SITES;
+            }
+        }
+
+    return HEAP_SITES;
+    }
 
-    size = (size+7) & -8;                       // round size up to next 8 bytes
-    assert(size >= MINSIZE && size <= MAXSIZE); // make sure it's a valid block size
-    bucket = 31-__builtin_clz(size>>2);         // get the bucket number
+
+// count an allocation, called with interrupts enabled
+static void profile_alloc(MemBlock *blk, size_t size, void *site)
+    {
+    unsigned cls = size <= 16 ? 0 : high_bit(size - 1) - 3;
+
+    if(cls >= HEAP_SIZE_CLASSES)
+        {
+        cls = HEAP_SIZE_CLASSES - 1;
+        }
 
     CRITICAL_REGION(InterruptLock)
         {
-        blk = FreeBlocks[bucket];
-        if(blk != 0)
+        unsigned index = site_index((uintptr_t)site);
+        HeapSite &entry = heap_sites[index];
+
+        ++entry.allocs;
+        entry.live += block_size(blk);
+        if(entry.live > entry.peak)
             {
-            FreeBlocks[bucket] = blk->next;
-            DPRINT(1)("malloc old %8p %u %u\n", blk, size, 1<<(bucket+3));
+            entry.peak = entry.live;
             }
-        else
+        if(entry.sizes[cls] != 0xFFFF)
             {
-            blk = (MemBlock *)_break;
-            _break += (1<<(bucket+3))+4;
-            assert(_break < (uintptr_t)&_heap_end);                 // assert that the heap has not overflowed
-            DPRINT(1)("malloc new %8p %u %u\n", blk, size, 1<<(bucket+3));
+            ++entry.sizes[cls];
             }
+
+        block_tag(blk)->site = index;
+        block_tag(blk)->seq = ++heap_seq;
         }
+    }
+
 
-    blk->bucket = bucket;
+// count a free, called with interrupts enabled
+static void profile_free(MemBlock *blk)
+    {
+    CRITICAL_REGION(InterruptLock)
+        {
+        HeapSite &entry = heap_sites[block_tag(blk)->site];
 
-    return (void *)&(blk->useable);
+        ++entry.frees;
+        entry.live -= block_size(blk);
+        }
     }
 
-void free(void *ptr)
+
+static void print_site(const HeapSite &entry)
     {
-    MemBlock *blk = (MemBlock *)((uintptr_t)ptr - 4);
-    unsigned bucket = blk->bucket;
+    if(entry.site)
+        {
+        printf("%08lx ", (unsigned long)entry.site);
+        }
+    else
+        {
+        printf("other    ");
+        }
+    }
 
-    DPRINT(1)("free %8p %u\n", blk, 1<<(bucket+3));
 
+// print the top sites, by live bytes and then by peak
+void heap_report(unsigned top)
+    {
+    bool shown[HEAP_SITES + 1] = {};
+
+    printf("site        allocs    frees     live     peak  <=16  <=32  <=64 <=128 <=256 <=512  <=1K   >1K\n");
+
+    for(unsigned n=0; n<top; n++)
+        {
+        int best = -1;
+
+        for(unsigned i=0; i<=HEAP_SITES; i++)
+            {
+            const HeapSite &e = heap_sites[i];
+            if(!shown[i] && e.allocs && (best < 0
+                || e.live > heap_sites[best].live
+                || (e.live == heap_sites[best].live && e.peak > heap_sites[best].peak)))
+                {
+                best = i;
+                }
+            }
+        if(best < 0)
+            {
+            break;
+            }
+        shown[best] = true;
+
+        const HeapSite &e = heap_sites[best];
+        print_site(e);
+        printf("%9lu%9lu%9lu%9lu", (unsigned long)e.allocs, (unsigned long)e.frees, (unsigned long)e.live, (unsigned long)e.peak);
+        for(unsigned c=0; c<HEAP_SIZE_CLASSES; c++)
+            {
+            printf("%6u", e.sizes[c]);
+            }
+        printf("\n");
+        }
+    }
+
+
+// mark the allocations made so far, heap_diff reports those made after this
+void heap_snapshot()
+    {
+    heap_snap = heap_seq;
+    }
+
+
+// list, by site, the blocks allocated since heap_snapshot that have not been freed
+void heap_diff()
+    {
+    uint32_t count[HEAP_SITES + 1] = {};
+    uint32_t bytes[HEAP_SITES + 1] = {};
+    unsigned leaks = 0;
+
+    malloc_init();
+
+    quick_drain();                              // the blocks on the quick lists are free, and their tags are overwritten
     CRITICAL_REGION(InterruptLock)
         {
-        blk->next = FreeBlocks[bucket];
-        FreeBlocks[bucket] = blk;
+        for(MemBlock *blk = (MemBlock *)heap_low; block_size(blk) != 0; blk = block_next(blk))
+            {
+            if(!block_free(blk) && !block_quick(blk) && (int32_t)(block_tag(blk)->seq - heap_snap) > 0)
+                {
+                ++count[block_tag(blk)->site];
+                bytes[block_tag(blk)->site] += block_size(blk);
+                }
+            }
+        }
+
+    for(unsigned i=0; i<=HEAP_SITES; i++)
+        {
+        if(count[i])
+            {
+            print_site(heap_sites[i]);
+            printf("%u blocks, %u bytes not freed\n", (unsigned)count[i], (unsigned)bytes[i]);
+            ++leaks;
+            }
+        }
+    printf("%u blocks allocated since the snapshot, %u sites still hold some\n", (unsigned)(heap_seq - heap_snap), leaks);
+    }
+
+#else
+
+static inline void profile_alloc(MemBlock *, size_t, void *) {}
+static inline void profile_free(MemBlock *) {}
+
+void heap_report(unsigned)
+    {
+    printf("heap profiling is off, set MALLOC_PROFILE in heap.hpp\n");
+    }
+
+void heap_snapshot()
+    {
+    heap_report(0);
+    }
+
+void heap_diff()
+    {
+    heap_report(0);
+    }
+
+#endif // MALLOC_PROFILE
+
+
+// the size of the block that holds "size" bytes
+static inline uintptr_t block_for(size_t size)
+    {
+    uintptr_t bsize = (size + DATA + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+    return bsize < MINBLOCK ? MINBLOCK : bsize;
+    }
+
+
+// take a free block of at least bsize bytes off its list
+static MemBlock *take(uintptr_t bsize)
+    {
+    unsigned fl, sl;
+    MemBlock **list = find_list(bsize, fl, sl);
+    if(list == 0)
+        {
+        return 0;
         }
+
+    MemBlock *blk = *list;
+    remove_free(blk);
+    return blk;
     }
 
 
+// allocate size bytes, for the caller at "site"
+static void *allocate(size_t size, void *site)
+    {
+    MemBlock *blk = 0;
+    uintptr_t bsize = block_for(size);
+
+    if(size > (1u << FL_MAX_LOG2))
+        {
+        return 0;
+        }
+
+    if(bsize <= QUICK_MAX)
+        {
+        blk = quick_pop(bsize);                 // the fast path, with interrupts enabled
+        }
 
+    if(blk == 0)
+        {
+        quick_drain();                          // merge the cached blocks first, so they don't fragment the heap
+        CRITICAL_REGION(InterruptLock)
+            {
+            malloc_init();
+            blk = take(bsize);
+            if(blk)
+                {
+                split(blk, bsize);
+                heap_used += block_size(blk);
+                }
+            }
+        }
+
+    if(blk == 0)
+        {
+        DPRINT(1)("malloc %u failed\n", (unsigned)size);
+        return 0;
+        }
+
+    profile_alloc(blk, size, site);
+
+    DPRINT(1)("malloc %8p %u %u\n", blk, (unsigned)size, (unsigned)block_size(blk));
+
+    return (char *)blk + DATA;
+    }
+
+
+// allocate size bytes at an address that is a multiple of align, which must be a power of two
+static void *allocate_aligned(size_t align, size_t size, void *site)
+    {
+    if(align <= ALIGN)
+        {
+        return allocate(size, site);
+        }
+
+    MemBlock *blk = 0;
+    uintptr_t bsize = block_for(size);
+
+    if(size > (1u << FL_MAX_LOG2) || (align & (align - 1)) != 0)
+        {
+        return 0;
+        }
+
+    quick_drain();
+    CRITICAL_REGION(InterruptLock)
+        {
+        malloc_init();
+        blk = take(bsize + align + MINBLOCK);   // room to move the start up to an aligned address, and free what is skipped
+        if(blk)
+            {
+            char *data = (char *)blk + DATA;
+
+            if((uintptr_t)data & (align - 1))
+                {
+                char *aligned = (char *)(((uintptr_t)data + MINBLOCK + align - 1) & -(uintptr_t)align);
+                MemBlock *lead = blk;
+                uintptr_t gap = aligned - data;
+
+                blk = (MemBlock *)(aligned - DATA);
+                blk->prev = lead;
+                blk->size = block_size(lead) - gap;
+                lead->size = gap;
+                block_next(blk)->prev = blk;
+                insert_free(lead);              // the block before lead is not free, or it would have been merged with lead
+                }
+
+            split(blk, bsize);
+            heap_used += block_size(blk);
+            }
+        }
+
+    if(blk == 0)
+        {
+        DPRINT(1)("memalign %u %u failed\n", (unsigned)align, (unsigned)size);
+        return 0;
+        }
+
+    profile_alloc(blk, size, site);
+
+    DPRINT(1)("memalign %8p %u %u %u\n", blk, (unsigned)align, (unsigned)size, (unsigned)block_size(blk));
+
+    return (char *)blk + DATA;
+    }
+
+
+extern "C"
+void *malloc(size_t size)
+    {
+    return allocate(size, __builtin_return_address(0));
+    }
+
+
+// malloc on behalf of a caller, for allocators built on malloc, so the profiler sees who called them
+extern "C"
+void *malloc_at(size_t size, void *site)
+    {
+    return allocate(size, site);
+    }
+
+
+extern "C"
+void *memalign(size_t align, size_t size)
+    {
+    return allocate_aligned(align, size, __builtin_return_address(0));
+    }
+
+
+extern "C"
+void *aligned_alloc(size_t align, size_t size)
+    {
+    return allocate_aligned(align, size, __builtin_return_address(0));
+    }
+
+
+extern "C"
+void free(void *ptr)
+    {
+    if(ptr == 0)
+        {
+        return;
+        }
+
+    MemBlock *blk = (MemBlock *)((char *)ptr - DATA);
+
+    DPRINT(1)("free %8p %u\n", blk, (unsigned)block_size(blk));
+    assert(!block_free(blk) && !block_quick(blk));  // catch a double free, to the heap or to a quick list
+
+    profile_free(blk);
+
+    if(block_size(blk) <= QUICK_MAX && quick_push(blk))
+        {
+        return;                                 // the fast path, the block stays allocated as far as the heap knows
+        }
+
+    CRITICAL_REGION(InterruptLock)
+        {
+        heap_used -= block_size(blk);
+        release(blk);
+        }
+    }
+
+
+// print the use of the heap, and how fragmented the free memory is
+// Fragmentation is the part of the free memory that is not in the largest free block,
+// memory that is free but can't be had in one piece.
 void mem()
     {
-    printf("%u bytes of heap left\n", (uintptr_t)&_heap_end - _break);
+    uintptr_t total = 0;
+    uintptr_t largest = 0;
+    unsigned blocks = 0;
 
-    int size = MINSIZE;
-    for(unsigned i=0; i<SIZES; i++)
+    malloc_init();
+
+    quick_drain();                              // count the blocks on the quick lists as free
+    CRITICAL_REGION(InterruptLock)
         {
-        printf("%4d byte blocks: ", size);
-        for(MemBlock *blk = FreeBlocks[i]; blk != 0; blk = blk->next)
+        for(MemBlock *blk = (MemBlock *)heap_low; block_size(blk) != 0; blk = block_next(blk))
             {
-            printf("%p ", blk);
-            } 
-        printf("\n");
-        size *= 2;
+            if(block_free(blk))
+                {
+                total += block_size(blk);
+                if(block_size(blk) > largest)
+                    {
+                    largest = block_size(blk);
+                    }
+                ++blocks;
+                }
+            }
+        }
+
+    printf("heap %p-%p, %u bytes, %u used, %u free in %u blocks\n",
+        heap_low, heap_high, (unsigned)(heap_high - heap_low), (unsigned)heap_used, (unsigned)total, blocks);
+    printf("largest free block %u bytes, fragmentation %u%%\n",
+        (unsigned)largest, total ? (unsigned)((total - largest) * 100 / total) : 0);
+
+    for(unsigned fl=0; fl<FL_COUNT; fl++)
+        {
+        for(unsigned sl=0; sl<SL_COUNT; sl++)
+            {
+            if(FreeBlocks[fl][sl])
+                {
+                printf("%5u+ bytes: ", fl ? (1u << (fl + FL_SHIFT - 1)) + (sl << (fl + FL_SHIFT - 1 - SL_LOG2)) : sl * ALIGN);
+                for(MemBlock *blk = FreeBlocks[fl][sl]; blk != 0; blk = blk->next_free)
+                    {
+                    printf("%p/%u ", blk, (unsigned)block_size(blk));
+                    }
+                printf("\n");
+                }
+            }
         }
     }
@@ -0,0 +1,43 @@
+// memchr
+//
+// Bytes up to a word boundary, then a word at a time, then the bytes that are left. See word.hpp.
+
+#include "word.hpp"
+
+extern "C"
+void *memchr(const void *vs, int c, unsigned n)
+    {
+    const unsigned char *s = (const unsigned char *)vs;
+    unsigned char ch = c;
+
+    for(; n > 0 && !aligned(s); n--, s++)
+        {
+        if(*s == ch)
+            {
+            return (void *)s;
+            }
+        }
+
+    const word *w = (const word *)s;
+    uint32_t c4 = ch * ONES;
+
+    for(; n >= 4; n -= 4, w++)
+        {
+        uint32_t mark = has_byte(*w, c4);
+
+        if(mark)
+            {
+            return (unsigned char *)w + first_byte(mark);
+            }
+        }
+
+    for(s = (const unsigned char *)w; n > 0; n--, s++)
+        {
+        if(*s == ch)
+            {
+            return (void *)s;
+            }
+        }
+
+    return 0;
+    }
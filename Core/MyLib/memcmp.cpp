@@ -1,15 +1,39 @@
+// memcmp
+//
+// Compares a word at a time once the first buffer is aligned, loading the second unaligned
+// if need be, and finds the differing byte of a word that differs a byte at a time.
+// Bytes compare as unsigned char.
+
+#include "word.hpp"
+
 extern "C"
 int memcmp(const void *vs1, const void *vs2, unsigned n)
     {
-    int res = 0;
-    const char *s1 = (const char *)vs1;
-    const char *s2 = (const char *)vs2;
+    const unsigned char *s1 = (const unsigned char *)vs1;
+    const unsigned char *s2 = (const unsigned char *)vs2;
+
+    if(n >= 8)
+        {
+        for(; !aligned(s1); n--, s1++, s2++)
+            {
+            if(*s1 != *s2)
+                {
+                return *s1 - *s2;
+                }
+            }
+
+        for(; n >= 4 && *(const word *)s1 == *(const unaligned_word *)s2; n -= 4, s1 += 4, s2 += 4)
+            {
+            }
+        }
 
-    for(unsigned i=0; i < n && (res = *s1 - *s2) == 0; i++)
+    for(; n > 0; n--, s1++, s2++)
         {
-        s1++;
-        s2++;
+        if(*s1 != *s2)
+            {
+            return *s1 - *s2;
+            }
         }
 
-    return res;
+    return 0;
     }
@@ -1,10 +1,112 @@
+// memcpy, and memcpy32 for copies between word aligned buffers
+//
+// Bytes are copied until the destination is word aligned, then words, then the bytes that are left.
+// If the source is aligned too, 32 bytes at a time are moved with an LDM/STM pair of eight
+// registers, leaving out r7 and r9, the frame and thread pointers. If it is not, the words are
+// loaded unaligned, which the Cortex-M33 does in hardware for LDR, though not for LDM.
+// Copies of less than 8 bytes go a byte at a time, since lining up would cost more than it saves.
+//
+// memmove relies on memcpy copying forward, and loading each block before it stores it.
+//
+// The budget for memcpy, memcpy32, memmove, and memset together is 512 bytes of flash.
+// They are compiled without -ftree-loop-distribute-patterns, which would turn their loops
+// back into calls to memcpy and memset.
+
+#include <stdint.h>
+#include "word.hpp"
+
+
+// copy n bytes, a multiple of 32, between word aligned addresses, and advance the pointers
+static inline void copy_blocks(word *&d, const word *&s, unsigned n)
+    {
+#if defined(__arm__)
+    __asm__ __volatile__(
+        "1: ldmia   %[s]!, {r3-r6, r8, r10-r12}     \n"
+        "   stmia   %[d]!, {r3-r6, r8, r10-r12}     \n"
+        "   subs    %[n], %[n], #32                 \n"
+        "   bne     1b                              \n"
+        : [d] "+r" (d), [s] "+r" (s), [n] "+r" (n)
+        :
+        : "r3", "r4", "r5", "r6", "r8", "r10", "r11", "r12", "cc", "memory");
+#else
+    for(; n; n -= 32)
+        {
+        for(int i=0; i<8; i++)
+            {
+            *d++ = *s++;
+            }
+        }
+#endif
+    }
+
+
 extern "C"
+__attribute__((__optimize__("no-tree-loop-distribute-patterns")))
 void *memcpy(void *dest, const void *src, unsigned n)
     {
-    char *d = (char *)dest;
-    const char *s = (const char *)src;
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if(n >= 8)
+        {
+        while((uintptr_t)d & 3)                                 // up to a word boundary of the destination
+            {
+            *d++ = *s++;
+            --n;
+            }
+
+        if(((uintptr_t)s & 3) == 0)                             // both are aligned
+            {
+            word *dw = (word *)d;
+            const word *sw = (const word *)s;
 
-    while(n--)*d++ = *s++;
+            if(n >= 32)
+                {
+                copy_blocks(dw, sw, n & ~31u);
+                n &= 31;
+                }
+            for(; n >= 4; n -= 4)
+                {
+                *dw++ = *sw++;
+                }
+
+            d = (unsigned char *)dw;
+            s = (const unsigned char *)sw;
+            }
+        else                                                    // unaligned loads, aligned stores
+            {
+            for(; n >= 4; n -= 4, d += 4, s += 4)
+                {
+                *(word *)d = *(const unaligned_word *)s;
+                }
+            }
+        }
+
+    while(n--)
+        {
+        *d++ = *s++;
+        }
 
     return dest;
     }
+
+
+// copy size bytes, a multiple of 4, between word aligned buffers
+extern "C"
+__attribute__((__optimize__("no-tree-loop-distribute-patterns")))
+void memcpy32(uint32_t *dst, uint32_t *src, uint32_t size)
+    {
+    word *d = dst;
+    const word *s = src;
+
+    if(size >= 32)
+        {
+        copy_blocks(d, s, size & ~31u);
+        size &= 31;
+        }
+
+    for(; size >= 4; size -= 4)
+        {
+        *d++ = *s++;
+        }
+    }
@@ -1,22 +1,61 @@
+// memmove
+//
+// If the destination is below the source, or they don't overlap, memcpy does it.
+// Otherwise the copy goes backward, bytes to a word boundary of the destination,
+// then words, aligned or unaligned loads as the source allows, then bytes.
+
+#include <stdint.h>
+#include "word.hpp"
+
+extern "C" void *memcpy(void *dest, const void *src, unsigned n);
+
+
 extern "C"
+__attribute__((__optimize__("no-tree-loop-distribute-patterns")))
 void *memmove(void *dest, const void *src, unsigned n)
     {
-    char *d = (char *)dest;
-    const char *s = (const char *)src;
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
 
-    if(d <= s)
+    if(d <= s || d >= s + n)
         {
-        for(unsigned i = 0; i < n; i++)
-            {
-            d[i] = s[i];
-            }
+        return memcpy(dest, src, n);                            // memcpy copies forward
         }
-    else
+
+    d += n;
+    s += n;
+
+    if(n >= 8)
         {
-        for (unsigned i = n; i > 0 ; i--)
+        while((uintptr_t)d & 3)
             {
-            d[i-1] = s[i-1];
+            *--d = *--s;
+            --n;
             }
+
+        if(((uintptr_t)s & 3) == 0)
+            {
+            for(; n >= 4; n -= 4)
+                {
+                d -= 4;
+                s -= 4;
+                *(word *)d = *(const word *)s;
+                }
+            }
+        else
+            {
+            for(; n >= 4; n -= 4)
+                {
+                d -= 4;
+                s -= 4;
+                *(word *)d = *(const unaligned_word *)s;
+                }
+            }
+        }
+
+    while(n--)
+        {
+        *--d = *--s;
         }
 
     return dest;
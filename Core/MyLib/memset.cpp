@@ -1,9 +1,77 @@
+// memset
+//
+// Bytes up to a word boundary, then 32 bytes at a time with an STM of eight registers,
+// then words, then bytes. See memcpy.cpp.
+
+#include <stdint.h>
+#include "word.hpp"
+
+
+// fill n bytes, a multiple of 32, at a word aligned address, and advance the pointer
+static inline void fill_blocks(word *&d, uint32_t w, unsigned n)
+    {
+#if defined(__arm__)
+    __asm__ __volatile__(
+        "   mov     r3, %[w]                        \n"
+        "   mov     r4, %[w]                        \n"
+        "   mov     r5, %[w]                        \n"
+        "   mov     r6, %[w]                        \n"
+        "   mov     r8, %[w]                        \n"
+        "   mov     r10, %[w]                       \n"
+        "   mov     r11, %[w]                       \n"
+        "   mov     r12, %[w]                       \n"
+        "1: stmia   %[d]!, {r3-r6, r8, r10-r12}     \n"
+        "   subs    %[n], %[n], #32                 \n"
+        "   bne     1b                              \n"
+        : [d] "+r" (d), [n] "+r" (n)
+        : [w] "r" (w)
+        : "r3", "r4", "r5", "r6", "r8", "r10", "r11", "r12", "cc", "memory");
+#else
+    for(; n; n -= 32)
+        {
+        for(int i=0; i<8; i++)
+            {
+            *d++ = w;
+            }
+        }
+#endif
+    }
+
+
 extern "C"
+__attribute__((__optimize__("no-tree-loop-distribute-patterns")))
 void *memset(void *dest, int c, unsigned n)
     {
-    char *d = (char *)dest;
+    unsigned char *d = (unsigned char *)dest;
+
+    if(n >= 8)
+        {
+        while((uintptr_t)d & 3)
+            {
+            *d++ = c;
+            --n;
+            }
+
+        word *dw = (word *)d;
+        uint32_t w = (unsigned char)c * 0x01010101u;
+
+        if(n >= 32)
+            {
+            fill_blocks(dw, w, n & ~31u);
+            n &= 31;
+            }
+        for(; n >= 4; n -= 4)
+            {
+            *dw++ = w;
+            }
+
+        d = (unsigned char *)dw;
+        }
 
-    while(n--)*d++ = c;
+    while(n--)
+        {
+        *d++ = c;
+        }
 
     return dest;
     }
@@ -1,15 +1,16 @@
+static inline int lower(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c; }
+
 extern "C"
 int strcasecmp(const char *s1, const char *s2)
     {
-    while(   *s1
-          && *s2
-          && (   (*s1 == *s2)
-              || (*s1>='A' && *s1<='Z' && *s2-*s1 == 'a'-'A')
-              || (*s2>='A' && *s2<='Z' && *s1-*s2 == 'a'-'A')))
+    const unsigned char *u1 = (const unsigned char *)s1;
+    const unsigned char *u2 = (const unsigned char *)s2;
+
+    while(lower(*u1) == lower(*u2) && *u1)
         {
-        s1++;
-        s2++;
+        u1++;
+        u2++;
         }
 
-    return *s1 - *s2;
+    return lower(*u1) - lower(*u2);
     }
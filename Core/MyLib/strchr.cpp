@@ -1,11 +1,36 @@
+// strchr
+//
+// Bytes up to a word boundary, then a word at a time until one holds the character or the
+// terminator, whichever comes first. Searching for 0 finds the terminator. See word.hpp.
+
+#include "word.hpp"
+
 extern "C"
 char *strchr(const char *s, int c)
     {
-    while(*s)
+    char ch = c;
+
+    for(; !aligned(s); s++)
+        {
+        if(*s == ch)
+            {
+            return (char *)s;
+            }
+        if(*s == 0)
+            {
+            return 0;
+            }
+        }
+
+    const word *w = (const word *)s;
+    uint32_t c4 = (unsigned char)ch * ONES;
+    uint32_t mark;
+
+    while((mark = has_zero(*w) | has_byte(*w, c4)) == 0)
         {
-        if(*s==c)return (char *)s;
-        s++;
+        ++w;
         }
 
-    return 0;
+    s = (const char *)w + first_byte(mark);
+    return *s == ch ? (char *)s : 0;
     }
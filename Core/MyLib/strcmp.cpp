@@ -1,13 +1,14 @@
 extern "C"
 int strcmp(const char *s1, const char *s2)
     {
-    int res=0;
+    const unsigned char *u1 = (const unsigned char *)s1;
+    const unsigned char *u2 = (const unsigned char *)s2;
 
-    while((res=*s1-*s2)==0 && *s1 && *s2)
+    while(*u1 == *u2 && *u1)
         {
-        s1++;
-        s2++;
+        u1++;
+        u2++;
         }
 
-    return res;
+    return *u1 - *u2;
     }
@@ -1,13 +1,29 @@
+// strlen
+//
+// Bytes up to a word boundary, then a word at a time until one holds the terminator. See word.hpp.
+
+#include "word.hpp"
+
 extern "C"
-__attribute__((__optimize__("O2")))                 // HACK: for some reason -Os breaks this function
 unsigned strlen(const char *s)
     {
-    unsigned n=0;
+    const char *p = s;
+
+    for(; !aligned(p); p++)
+        {
+        if(*p == 0)
+            {
+            return p - s;
+            }
+        }
+
+    const word *w = (const word *)p;
+    uint32_t mark;
 
-    while(*s++ != 0)
+    while((mark = has_zero(*w)) == 0)
         {
-        ++n;
+        ++w;
         }
 
-    return n;
+    return (const char *)w + first_byte(mark) - s;
     }
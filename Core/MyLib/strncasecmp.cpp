@@ -1,19 +1,18 @@
+static inline int lower(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c; }
+
 extern "C"
 int strncasecmp(const char *s1, const char *s2, unsigned n)
     {
-    unsigned i = 0;
+    const unsigned char *u1 = (const unsigned char *)s1;
+    const unsigned char *u2 = (const unsigned char *)s2;
 
-    while(   i < n
-          && *s1
-          && *s2
-          && (   (*s1 == *s2)
-              || (*s1>='A' && *s1<='Z' && *s2-*s1 == 'a'-'A')
-              || (*s2>='A' && *s2<='Z' && *s1-*s2 == 'a'-'A')))
+    for(; n > 0; n--, u1++, u2++)
         {
-        s1++;
-        s2++;
-        i++;
+        if(lower(*u1) != lower(*u2) || *u1 == 0)
+            {
+            return lower(*u1) - lower(*u2);
+            }
         }
 
-    return *s1 - *s2;
+    return 0;
     }
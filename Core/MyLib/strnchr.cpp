@@ -1,13 +1,51 @@
+// strnchr
+//
+// strchr that looks at no more than n characters. It never finds the terminator, so
+// searching for 0 returns 0. _write uses it to look for newlines, see serial.cpp.
+
+#include "word.hpp"
+
 extern "C"
 const char *strnchr(const char *s, int n, int c)
     {
-    for(int i=0; i<n && *s!=0; i++)
+    char ch = c;
+
+    for(; n > 0 && !aligned(s); n--, s++)
+        {
+        if(*s == 0)
+            {
+            return 0;
+            }
+        if(*s == ch)
+            {
+            return s;
+            }
+        }
+
+    const word *w = (const word *)s;
+    uint32_t c4 = (unsigned char)ch * ONES;
+
+    for(; n >= 4; n -= 4, w++)
+        {
+        uint32_t mark = has_zero(*w) | has_byte(*w, c4);
+
+        if(mark)
+            {
+            s = (const char *)w + first_byte(mark);
+            return *s != 0 ? s : 0;
+            }
+        }
+
+    for(s = (const char *)w; n > 0; n--, s++)
         {
-        if(*s == c)
+        if(*s == 0)
+            {
+            return 0;
+            }
+        if(*s == ch)
             {
             return s;
             }
-        ++s;
         }
 
     return 0;
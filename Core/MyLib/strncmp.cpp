@@ -1,13 +1,16 @@
 extern "C"
 int strncmp(const char *s1, const char *s2, unsigned n)
     {
-    int res=0;
+    const unsigned char *u1 = (const unsigned char *)s1;
+    const unsigned char *u2 = (const unsigned char *)s2;
 
-    for(unsigned i=0; i<n && (res=*s1-*s2)==0 && *s1 && *s2; i++)
+    for(; n > 0; n--, u1++, u2++)
         {
-        s1++;
-        s2++;
+        if(*u1 != *u2 || *u1 == 0)
+            {
+            return *u1 - *u2;
+            }
         }
 
-    return res;
+    return 0;
     }
@@ -6,7 +6,7 @@ char *strrchr(const char *s, int c)
     int i;
     int n = strlen(s);
 
-    for(i=n-1;i>=0 && *s;i--)if(s[i]==c)return (char *)&s[i];
+    for(i=n; i>=0; i--)if(s[i]==(char)c)return (char *)&s[i];       // from the terminator, so that c==0 finds it
 
     return 0;
     }
@@ -6,7 +6,7 @@ unsigned strspn(const char *s, const char *accept)
     {
     unsigned n = 0;
 
-    while (strchr(accept, *s))
+    while (*s && strchr(accept, *s))                    // strchr finds the terminator, which is not accepted
         {
         n++;
         s++;
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
+#include "cmsis.h"
 
 #define UNUSED __attribute__((__unused__))
 
@@ -12,6 +13,10 @@ void __assert_func (
     const char      * __assertion)
     {
     printf("assert(%s) failed in function %s, file %s, at line %d\n",__assertion,__function,__file,__line);
+    if(__get_IPSR() == 0 && !__get_PRIMASK())           // the flush waits for the USB interrupt to
+        {                                               // empty the transmit ring, so it can't be
+        fflush(stdout);                                 // done in an ISR or with interrupts off
+        }
     while(true);
     }
 
@@ -0,0 +1,39 @@
+// word.hpp
+//
+// Helpers for the MyLib routines that work a word at a time.
+//
+// has_zero(w) is nonzero if any byte of w is zero, and the lowest byte it marks is the first zero
+// byte in memory. Bytes above the first zero may be marked falsely, when they are 0x01, so only the
+// lowest mark counts. has_byte(w, c) does the same for bytes equal to c. The processor is little
+// endian, so the first byte in memory is the lowest byte of the word.
+//
+// Aligned word loads never cross into the next word, so reading a whole word that holds the end of a
+// string or buffer can't fault, even if the rest of the word is beyond it.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef WORD_HPP
+#define WORD_HPP
+
+#include <stdint.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the MyLib word routines assume a little endian processor"
+#endif
+
+typedef uint32_t __attribute__((__may_alias__)) word;                               // a word of any type of data
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) unaligned_word;     // and at any address
+
+static const uint32_t ONES  = 0x01010101;
+static const uint32_t HIGHS = 0x80808080;
+
+inline bool aligned(const void *p) { return ((uintptr_t)p & 3) == 0; }
+
+inline uint32_t has_zero(uint32_t w) { return (w - ONES) & ~w & HIGHS; }
+
+inline uint32_t has_byte(uint32_t w, uint32_t c4) { return has_zero(w ^ c4); }     // c4 is the byte times ONES
+
+inline unsigned first_byte(uint32_t mark) { return __builtin_ctz(mark) >> 3; }      // which byte a has_ mark is in
+
+#endif // WORD_HPP
@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include "bulk.hpp"
+
+
+// bulk             hand the USB link to host/bulk, which reads and writes memory and files in
+//                  framed binary, until it sends EXIT or is quiet for 30 seconds, then show
+//                  what was done
+
+void BulkCommand(char *)
+    {
+    bulk_serve();
+
+    printf("requests        %u\n", bulk_stats.requests);
+    printf("frames received %u\n", bulk_stats.received);
+    printf("frames sent     %u\n", bulk_stats.sent);
+    printf("bad CRC         %u\n", bulk_stats.bad);
+    printf("dropped         %u\n", bulk_stats.dropped);
+    printf("went back       %u\n", bulk_stats.resent);
+    printf("bytes           %u\n", (unsigned)bulk_stats.bytes);
+    }
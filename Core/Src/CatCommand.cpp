@@ -8,21 +8,28 @@
 #include "serial.h"
 #include "diskio.h"
 #include "ff.h"
+#include "Pool.hpp"
 
 extern FATFS FatFs[3];
-extern FIL fil;
+extern Pool<FIL, NFILES> file_pool;
 extern uint32_t qbuf[512/4];
 
 void CatCommand(char *p)
     {
-    if(f_open(&fil, p, FA_READ) == FR_OK)
+    FIL *fil = file_pool.acquire();
+
+    if(fil == 0)
+        {
+        printf("too many open files\n");
+        }
+    else if(f_open(fil, p, FA_READ) == FR_OK)
         {
         unsigned br; // Bytes read
         FRESULT res;
 
         do
             {
-            res = f_read(&fil, qbuf, 512, &br);
+            res = f_read(fil, qbuf, 512, &br);
             if(res == FR_OK)
                 {
                 _write(1, (const char *)&qbuf, br);
@@ -37,10 +44,15 @@ void CatCommand(char *p)
             printf("res = %d\n", res);
             }
 
-        f_close(&fil);
+        f_close(fil);
         }
     else
         {
         printf("file %s could not be opened\n", p);
         }
+
+    if(fil)
+        {
+        file_pool.release(fil);
+        }
     }
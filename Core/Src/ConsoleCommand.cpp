@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include "local.h"
+#include "main.h"
+#include "tim.h"
+#include "usbd_cdc_if.h"
+
+extern "C" int _write(int file, const char *ptr, int len);
+
+
+// con                      show the console output and input rings
+// con block|oldest|new     set what happens when it is full: wait for room, drop the oldest output, or drop the new
+// con t                    dump 4K of flash with each write sent at once, and again with output coalesced
+//                          into lines and packets, and show the characters per second and transfers of each
+// con b [<kbytes>]         send lines of text, 256K by default, filled in place in the USB transmit ring, and
+//                          again through _write, and show the bytes per second of each
+
+static const unsigned TEST_SIZE = 4096;
+
+static void speed_test()
+    {
+    unsigned rate[2], transfers[2], sent[2];
+    bool save = ConsoleCoalesce;
+
+    for(unsigned way=0; way<2; way++)
+        {
+        ConsoleCoalesce = way;
+        fflush(stdout);
+
+        unsigned first_transfer = vcp_tx_transfers;
+        unsigned first_sent = vcp_tx_bytes;
+        uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
+
+        dump((void *)FLASH_BASE, TEST_SIZE);
+        fflush(stdout);
+
+        uint32_t us = __HAL_TIM_GET_COUNTER(&htim2) - start;
+
+        transfers[way] = vcp_tx_transfers - first_transfer;
+        sent[way] = vcp_tx_bytes - first_sent;
+        rate[way] = (uint64_t)sent[way] * 1000000 / (us ? us : 1);
+        }
+
+    ConsoleCoalesce = save;
+
+    printf("                 chars/s  transfers  bytes per transfer\n");
+    for(unsigned way=0; way<2; way++)
+        {
+        printf("%-12s %11u %10u %19u\n", way ? "coalesced" : "each write", rate[way], transfers[way], sent[way] / (transfers[way] ? transfers[way] : 1));
+        }
+    }
+
+
+static const unsigned FS_LIMIT = 19 * 64 * 1000;                   // bytes per second: 19 bulk packets in each 1 ms frame
+
+static const char text[] = "The quick brown fox jumps over the lazy dog, 0123456789 ABCDEF";    // and "\r\n", 64 bytes
+
+static void throughput_test(unsigned kbytes)
+    {
+    uint32_t total = kbytes * 1024;
+    unsigned us[2], transfers[2];
+
+    for(unsigned way=0; way<2; way++)
+        {
+        fflush(stdout);
+
+        unsigned first_transfer = vcp_tx_transfers;
+        uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
+
+        if(way == 0)                                                // in place, a line at a time as the space allows
+            {
+            for(uint32_t done=0; done<total; )
+                {
+                uint32_t room;
+                uint8_t *p = vcp_reserve(&room);
+
+                if(room == 0)
+                    {
+                    vcp_txwait();
+                    continue;
+                    }
+                if(room > total - done)
+                    {
+                    room = total - done;
+                    }
+                for(uint32_t i=0; i<room; i++)
+                    {
+                    unsigned column = (done + i) % 64;
+
+                    p[i] = column < 62 ? text[column] : column == 62 ? '\r' : '\n';
+                    }
+                vcp_commit(room);
+                done += room;
+                }
+            }
+        else                                                        // through the console, which adds the "\r"
+            {
+            char line[64];
+
+            memcpy(line, text, 62);
+            line[62] = '\n';
+            for(uint32_t done=0; done<total; done+=64)
+                {
+                _write(1, line, 63);
+                }
+            }
+
+        fflush(stdout);
+        us[way] = __HAL_TIM_GET_COUNTER(&htim2) - start;
+        transfers[way] = vcp_tx_transfers - first_transfer;
+        }
+
+    printf("                 bytes/s  of FS limit  transfers  bytes per transfer\n");
+    for(unsigned way=0; way<2; way++)
+        {
+        unsigned rate = (uint64_t)total * 1000000 / (us[way] ? us[way] : 1);
+
+        printf("%-12s %11u %11u%% %10u %19u\n", way ? "_write" : "in place", rate, (unsigned)((uint64_t)rate * 100 / FS_LIMIT),
+               transfers[way], total / (transfers[way] ? transfers[way] : 1));
+        }
+    }
+
+
+void ConsoleCommand(char *p)
+    {
+    static const char *const policies[] = {"block", "oldest", "new"};
+
+    if(*p == 't')
+        {
+        speed_test();
+        return;
+        }
+
+    if(*p == 'b')
+        {
+        unsigned kbytes = 256;
+
+        ++p;
+        skip(&p);
+        if(*p)
+            {
+            kbytes = getdec(&p);
+            }
+        throughput_test(kbytes);
+        return;
+        }
+
+    for(unsigned i=0; i<sizeof(policies)/sizeof(policies[0]); i++)
+        {
+        if(*p && strncmp(p, policies[i], strlen(policies[i])) == 0)
+            {
+            ConsoleOverflow = (ConsoleOverflowPolicy)i;
+            }
+        }
+
+    printf("output ring %u bytes, transfers of up to %u\n", VCP_TX_RING, VCP_TX_MAX);
+    printf("peak        %u\n", ConsolePeak);
+    printf("dropped     %u\n", ConsoleDrops);
+    printf("when full   %s\n", policies[ConsoleOverflow]);
+    printf("transfers   %u, %u bytes\n", (unsigned)vcp_tx_transfers, (unsigned)vcp_tx_bytes);
+    printf("input ring  %u bytes, host held off %u times\n", VCP_RX_RING, (unsigned)vcp_rx_stalls);
+    }
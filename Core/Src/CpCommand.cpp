@@ -8,9 +8,10 @@
 #include "serial.h"
 #include "diskio.h"
 #include "ff.h"
+#include "Pool.hpp"
 
 extern FATFS FatFs[3];
-extern FIL fil;
+extern Pool<FIL, NFILES> file_pool;
 extern uint32_t qbuf[512/4];
 
 void CpCommand(char *p)
@@ -20,55 +21,67 @@ void CpCommand(char *p)
     p[-1] = 0;
     char *dst_path = p;
 
-    FIL src_file, dst_file;
+    FIL *src_file = file_pool.acquire();
+    FIL *dst_file = file_pool.acquire();
     FRESULT res;
     UINT br, bw;
 
+    if(dst_file == 0)
+        {
+        printf("too many open files\n");
+        goto release;
+        }
+
     // Open the source file
-    res = f_open(&src_file, src_path, FA_READ);
+    res = f_open(src_file, src_path, FA_READ);
     if (res != FR_OK)
         {
         printf("Failed to open source file: %s\n", src_path);
-        return;
+        goto release;
         }
 
     // Open or create the destination file
-    res = f_open(&dst_file, dst_path, FA_WRITE | FA_CREATE_ALWAYS);
+    res = f_open(dst_file, dst_path, FA_WRITE | FA_CREATE_ALWAYS);
     if (res != FR_OK)
         {
         printf("Failed to open destination file: %s\n", dst_path);
-        f_close(&src_file);
-        return;
+        f_close(src_file);
+        goto release;
         }
 
     // Copy data from source to destination
     while (1)
         {
         // Read a chunk of data from the source file
-        res = f_read(&src_file, qbuf, 512, &br);
+        res = f_read(src_file, qbuf, 512, &br);
         if (res != FR_OK || br == 0) break;  // Check for end of file or read error
 
         // Write the chunk of data to the destination file
-        res = f_write(&dst_file, qbuf, br, &bw);
+        res = f_write(dst_file, qbuf, br, &bw);
         if (res != FR_OK || bw < br)
             {
             printf("Failed to write to destination file: %s\n", dst_path);
-            f_close(&src_file);
-            f_close(&dst_file);
-            return;
+            f_close(src_file);
+            f_close(dst_file);
+            goto release;
             }
         }
 
     // Close both files
-    f_close(&src_file);
-    f_close(&dst_file);
+    f_close(src_file);
+    f_close(dst_file);
 
     // Check if the loop exited due to an error
     if (res != FR_OK)
         {
         printf("Failed to copy file: %s to %s\n", src_path, dst_path);
-        return;
+        }
+    else
+        {
+        printf("File copied successfully: %s to %s\n", src_path, dst_path);
         }
 
-    printf("File copied successfully: %s to %s\n", src_path, dst_path);
+release:
+    if(src_file) file_pool.release(src_file);
+    if(dst_file) file_pool.release(dst_file);
     }
@@ -9,9 +9,10 @@
 #include "serial.h"
 #include "diskio.h"
 #include "ff.h"
+#include "Pool.hpp"
 
 extern FATFS FatFs[3];
-extern FIL fil;
+extern Pool<FIL, NFILES> file_pool;
 extern uint32_t qbuf[512/4];
 
 void DiffCommand(char *p)
@@ -21,42 +22,48 @@ void DiffCommand(char *p)
     p[-1] = 0;
     char *path2 = p;
 
-    FIL f1, f2;
+    FIL *f1 = file_pool.acquire();
+    FIL *f2 = file_pool.acquire();
     FRESULT res;
+    DWORD offset = 0;
+    UINT br1, br2;
+
+    if(f2 == 0)
+        {
+        printf("too many open files\n");
+        goto release;
+        }
 
     // Open the file 1
-    res = f_open(&f1, path1, FA_READ);
+    res = f_open(f1, path1, FA_READ);
     if (res != FR_OK)
         {
         printf("Failed to open first file: %s\n", path1);
-        return;
+        goto release;
         }
 
     // Open file 2
-    res = f_open(&f2, path2, FA_READ);
+    res = f_open(f2, path2, FA_READ);
     if (res != FR_OK)
         {
         printf("Failed to open file 2: %s\n", path2);
-        f_close(&f1);
-        return;
+        f_close(f1);
+        goto release;
         }
 
-    DWORD offset = 0;
-    UINT br1, br2;
-
 
     // Compare the files byte by byte
     while (1)
         {
         // Read a chunk from each file
-        res = f_read(&f1, (uint8_t *)&qbuf[0], 16, &br1);
+        res = f_read(f1, (uint8_t *)&qbuf[0], 16, &br1);
         if (res != FR_OK)
             {
             printf("Failed to read from file: %s\n", path1);
             break;
             }
 
-        res = f_read(&f2, (uint8_t *)&qbuf[32], 16, &br2);
+        res = f_read(f2, (uint8_t *)&qbuf[32], 16, &br2);
         if (res != FR_OK)
             {
             printf("Failed to read from file: %s\n", path2);
@@ -101,6 +108,10 @@ void DiffCommand(char *p)
         }
 
     // Close both files
-    f_close(&f1);
-    f_close(&f2);
+    f_close(f1);
+    f_close(f2);
+
+release:
+    if(f1) file_pool.release(f1);
+    if(f2) file_pool.release(f2);
     }
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <string.h>
+#include "local.h"
+#include "libgomp.hpp"
+
+// env                      print the OpenMP settings and the created threads
+// env <name>=<value>       change a setting
+// env <path>               read settings from a file
+// env trim                 retire all idle created threads
+
+void EnvCommand(char *p)
+    {
+    if(*p == 0)
+        {
+        gomp_print_env();
+        }
+    else if(strcmp(p, "trim") == 0)
+        {
+        gomp_trim_threads(true);
+        }
+    else if(strchr(p, '='))
+        {
+        if(!gomp_putenv(p))
+            {
+            printf("bad setting\n");
+            }
+        }
+    else if(!libgomp_config(p))
+        {
+        printf("file %s could not be opened\n", p);
+        }
+    }
@@ -8,17 +8,27 @@
 #include "serial.h"
 #include "diskio.h"
 #include "ff.h"
+#include "Pool.hpp"
 
 extern FATFS FatFs[3];
-extern FIL fil;
+extern Pool<FIL, NFILES> file_pool;
 extern uint32_t qbuf[512/4];
 
 void FdumpCommand(char *p)
     {
+    FIL *fil = file_pool.acquire();
+
+    if(fil == 0)
+        {
+        printf("too many open files\n");
+        return;
+        }
+
     // Read from the file
-     if(f_open(&fil, p, FA_READ) != FR_OK)
+     if(f_open(fil, p, FA_READ) != FR_OK)
          {
          printf("file %s could not be opened\n", p);
+         file_pool.release(fil);
          return;
          }
 
@@ -27,7 +37,7 @@ void FdumpCommand(char *p)
 
      do
          {
-         res = f_read(&fil, qbuf, 512, &br);
+         res = f_read(fil, qbuf, 512, &br);
          if(res == FR_OK)
              {
              dump(qbuf, br);
@@ -39,5 +49,6 @@ void FdumpCommand(char *p)
 
      printf("res = %d\n", res);
 
-     f_close(&fil);
+     f_close(fil);
+     file_pool.release(fil);
     }
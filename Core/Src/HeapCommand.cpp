@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "local.h"
+#include "main.h"
+#include "cmsis.h"
+#include "cyccnt.hpp"
+#include "random.hpp"
+#include "heap.hpp"
+
+
+// heap             list the ten call sites holding the most heap memory
+// heap <n>         list the top n call sites
+// heap snap        remember what is allocated now
+// heap diff        list the blocks allocated since "heap snap" that have not been freed
+// heap stress <n>  malloc and free n times from a thread while an interrupt handler does too
+//
+// The sites are return addresses, host/heapsym.sh turns them into function names.
+
+
+extern "C" void (*volatile SysTickHook)(void);  // see stm32h5xx_it.c
+
+static const unsigned STRESS_SLOTS = 4;         // blocks each side keeps allocated at a time
+static const unsigned STRESS_PERIOD = 1009;     // cycles between interrupts, a prime so they land everywhere in the loop
+
+enum
+    {
+    STRESS_IDLE,                                // no allocation, the latency of the interrupt on its own
+    STRESS_QUICK,                               // small blocks, from the quick lists without disabling interrupts
+    STRESS_HEAP,                                // large blocks, from the heap with interrupts disabled
+    STRESS_PHASES
+    };
+
+static const char *const stress_names[STRESS_PHASES] = {"idle", "quick", "heap"};
+
+static volatile unsigned stress_phase;
+static uint32_t stress_latency[STRESS_PHASES];  // the worst interrupt latency of each phase, in cycles
+static void *isr_blocks[STRESS_SLOTS];
+static unsigned isr_mallocs;
+static unsigned isr_fails;
+static uint32_t isr_seed;
+
+
+// the interrupt's side of the test, called from the SysTick handler
+static void stress_tick()
+    {
+    uint32_t latency = SysTick->LOAD - SysTick->VAL;   // cycles since the counter wrapped and raised the interrupt
+    unsigned i = random32(isr_seed) >> 30;
+
+    if(latency > stress_latency[stress_phase])
+        {
+        stress_latency[stress_phase] = latency;
+        }
+
+    if(isr_blocks[i])
+        {
+        free(isr_blocks[i]);
+        isr_blocks[i] = 0;
+        }
+    else if((isr_blocks[i] = malloc(8 + (random32(isr_seed) >> 28) * 4)) != 0)
+        {
+        ++isr_mallocs;
+        }
+    else
+        {
+        ++isr_fails;
+        }
+    }
+
+
+// The thread's side. The cycles of malloc and free include any interrupts that hit them.
+static void stress(unsigned n)
+    {
+    uint32_t saved_load = SysTick->LOAD;
+    uint32_t saved_ctrl = SysTick->CTRL;
+    void *blocks[STRESS_SLOTS] = {};
+    uint32_t seed = 1;
+
+    memset(stress_latency, 0, sizeof(stress_latency));
+    isr_mallocs = isr_fails = 0;
+    isr_seed = 12345;
+
+    printf("phase    mallocs   cycles    frees   cycles   failed  worst irq latency\n");
+
+    SysTick->LOAD = STRESS_PERIOD - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL = saved_ctrl | SysTick_CTRL_CLKSOURCE_Msk;    // count CPU cycles
+    SysTickHook = stress_tick;
+
+    for(unsigned phase=0; phase<STRESS_PHASES; phase++)
+        {
+        unsigned mallocs = 0, frees = 0, fails = 0;
+        uint32_t malloc_cycles = 0, free_cycles = 0;
+
+        stress_phase = phase;
+        for(unsigned k=0; k<n; k++)
+            {
+            unsigned i = random32(seed) >> 30;
+            size_t size = phase == STRESS_QUICK ? 8 + (random32(seed) >> 28) * 4 : 136 + (random32(seed) >> 28) * 4;
+            uint32_t start = xCYCCNT;
+
+            if(phase == STRESS_IDLE)
+                {
+                COMPILER_BARRIER();
+                }
+            else if(blocks[i])
+                {
+                free(blocks[i]);
+                free_cycles += xCYCCNT - start;
+                blocks[i] = 0;
+                ++frees;
+                }
+            else
+                {
+                blocks[i] = malloc(size);
+                malloc_cycles += xCYCCNT - start;
+                ++mallocs;
+                if(blocks[i] == 0)
+                    {
+                    ++fails;
+                    }
+                }
+            }
+
+        printf("%-6s %9u %8u %8u %8u %8u %10u\n", stress_names[phase],
+            mallocs, mallocs ? (unsigned)(malloc_cycles / mallocs) : 0,
+            frees, frees ? (unsigned)(free_cycles / frees) : 0,
+            fails, (unsigned)stress_latency[phase]);
+        }
+
+    SysTickHook = 0;
+    SysTick->LOAD = saved_load;
+    SysTick->VAL = 0;
+    SysTick->CTRL = saved_ctrl;
+
+    for(unsigned i=0; i<STRESS_SLOTS; i++)
+        {
+        free(blocks[i]);
+        free(isr_blocks[i]);
+        isr_blocks[i] = 0;
+        }
+
+    printf("interrupt handler: %u mallocs, %u failed\n", isr_mallocs, isr_fails);
+    mem();
+    }
+
+
+void HeapCommand(char *p)
+    {
+    if(p[0] == 's' && p[1] == 'n')
+        {
+        heap_snapshot();
+        }
+    else if(p[0] == 's' && p[1] == 't')
+        {
+        skip(&p);
+        int n = getdec(&p);
+        stress(n > 0 ? n : 10000);
+        }
+    else if(p[0] == 'd')
+        {
+        heap_diff();
+        }
+    else
+        {
+        int top = getdec(&p);
+
+        heap_report(top > 0 ? top : 10);
+        }
+    }
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#include "local.h"
+#include "cmsis.h"
+#include "cyccnt.hpp"
+#include "binlog.hpp"
+
+
+// log              print the binary log, for host/logdecode
+// log c            clear the log
+// log on           record LOG messages
+// log off          ignore them
+// log t            time a LOG, and a sprintf of the same message for comparison
+
+static const unsigned LOG_RUNS = 8;
+
+void LogCommand(char *p)
+    {
+    if(*p == 'c')
+        {
+        binlog_clear();
+        }
+    else if(p[0] == 'o' && p[1] == 'n')
+        {
+        binlog_enabled = true;
+        }
+    else if(p[0] == 'o' && p[1] == 'f')
+        {
+        binlog_enabled = false;
+        }
+    else if(*p == 't')
+        {
+        char line[40];
+        uint32_t cycles[2] = {~0u, ~0u};
+        bool save = binlog_enabled;
+
+        binlog_enabled = true;
+        for(unsigned run=0; run<LOG_RUNS; run++)
+            {
+            for(unsigned way=0; way<2; way++)
+                {
+                __disable_irq();
+                uint32_t start = xCYCCNT;
+                if(way == 0)
+                    {
+                    LOG("log timing run %u of %u", run, LOG_RUNS);
+                    }
+                else
+                    {
+                    sprintf(line, "log timing run %u of %u", run, LOG_RUNS);
+                    }
+                uint32_t time = xCYCCNT - start;
+                __enable_irq();
+
+                if(time < cycles[way])
+                    {
+                    cycles[way] = time;
+                    }
+                }
+            }
+        binlog_enabled = save;
+
+        printf("cycles per message: %u LOG, %u sprintf\n", (unsigned)cycles[0], (unsigned)cycles[1]);
+        }
+    else
+        {
+        binlog_dump();
+        }
+    }
@@ -10,7 +10,6 @@
 #include "ff.h"
 
 extern FATFS FatFs[3];
-extern FIL fil;
 extern uint32_t qbuf[512/4];
 
 void LsCommand(char *p)
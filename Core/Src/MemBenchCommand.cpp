@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include "local.h"
+#include "cmsis.h"
+#include "cyccnt.hpp"
+
+
+// mb       time memcpy, memmove, memset, and a byte loop for comparison, and strlen, memchr,
+//          and memcmp, in cycles per byte, for small and large sizes, with the buffers
+//          aligned and misaligned, and a line of the memory dump formatted by format.hpp
+//          and by sprintf
+//
+// The buffers are in qbuf, which is free while no file command is running. Each time is
+// the best of several runs with interrupts disabled, less the cost of reading the counter.
+
+extern uint32_t qbuf[512/4];
+
+static const unsigned bench_sizes[] = {1, 4, 7, 16, 64, 200};
+static const unsigned BENCH_RUNS = 8;
+static volatile uintptr_t bench_result;         // so the scans aren't optimized away
+
+enum
+    {
+    BENCH_MEMCPY,
+    BENCH_MEMMOVE,                              // overlapping, so it copies backward
+    BENCH_MEMSET,
+    BENCH_BYTES,                                // a byte at a time, what the library did before
+    BENCH_STRLEN,                               // the scans run to the end of a string of 'a'
+    BENCH_MEMCHR,
+    BENCH_MEMCMP,                               // equal buffers
+    BENCH_FUNCTIONS
+    };
+
+
+__attribute__((__noinline__, __optimize__("no-tree-loop-distribute-patterns")))
+static void byte_copy(unsigned char *d, const unsigned char *s, unsigned n)
+    {
+    while(n--)
+        {
+        *d++ = *s++;
+        }
+    }
+
+
+// a line of the dump formatted the way dump.cpp did before it used format.hpp
+__attribute__((__noinline__))
+static char *sprintf_line(char *b, const unsigned char *p, int size)
+    {
+    b += sprintf(b,"%08x: ",(int)(uintptr_t)p);
+    for(int i=0;i<16;i+=4)
+        {
+        if(i<size)sprintf(b,"%08x ",*(int *)&p[i]);
+        else sprintf(b,"         ");
+        b += 9;
+        }
+    *b++ = ' ';
+    *b++ = '|';
+    for(int i=0;i<16 && i<size;i++)
+        {
+        *b++ = ' '<=p[i]&&p[i]<0x7f ? p[i] : '.';
+        }
+    *b++ = '|';
+    *b = 0;
+    return b;
+    }
+
+
+// the fewest cycles one call took
+static uint32_t bench(unsigned function, unsigned char *d, unsigned char *s, unsigned n, uint32_t overhead)
+    {
+    uint32_t best = ~0u;
+
+    if(function >= BENCH_STRLEN)
+        {
+        memset(s, 'a', n);
+        s[n] = 0;
+        memcpy(d, s, n);
+        }
+
+    for(unsigned run=0; run<BENCH_RUNS; run++)
+        {
+        __disable_irq();
+        uint32_t start = xCYCCNT;
+
+        switch(function)
+            {
+        case BENCH_MEMCPY:  memcpy(d, s, n);                                   break;
+        case BENCH_MEMMOVE: memmove(s + 4, s, n);                              break;
+        case BENCH_MEMSET:  memset(d, run, n);                                 break;
+        case BENCH_BYTES:   byte_copy(d, s, n);                                break;
+        case BENCH_STRLEN:  bench_result = strlen((char *)s);              break;
+        case BENCH_MEMCHR:  bench_result = (uintptr_t)memchr(s, 'x', n);   break;
+        case BENCH_MEMCMP:  bench_result = memcmp(s, d, n);                break;
+            }
+
+        uint32_t cycles = xCYCCNT - start;
+        __enable_irq();
+
+        if(cycles < best)
+            {
+            best = cycles;
+            }
+        }
+
+    return best > overhead ? best - overhead : 0;
+    }
+
+
+void MemBenchCommand(char *p)
+    {
+    unsigned char *src = (unsigned char *)qbuf;
+    unsigned char *dst = (unsigned char *)qbuf + 256;
+    static const char *const names[] = {"aligned", "src+1", "dst+1"};
+    uint32_t overhead = ~0u;
+
+    for(unsigned run=0; run<BENCH_RUNS; run++)
+        {
+        __disable_irq();
+        uint32_t start = xCYCCNT;
+        COMPILER_BARRIER();
+        uint32_t cycles = xCYCCNT - start;
+        __enable_irq();
+
+        if(cycles < overhead)
+            {
+            overhead = cycles;
+            }
+        }
+
+    printf("cycles per byte\n");
+    printf("size  buffers     memcpy  memmove   memset    bytes   strlen   memchr   memcmp\n");
+
+    for(unsigned size : bench_sizes)
+        {
+        for(unsigned align=0; align<3; align++)
+            {
+            unsigned char *s = src + (align == 1);
+            unsigned char *d = dst + (align == 2);
+
+            printf("%4u  %-8s", size, names[align]);
+            for(unsigned function=0; function<BENCH_FUNCTIONS; function++)
+                {
+                uint32_t hundredths = bench(function, d, s, size, overhead) * 100 / size;
+
+                printf(" %5u.%02u", (unsigned)(hundredths / 100), (unsigned)(hundredths % 100));
+                }
+            printf("\n");
+            }
+        }
+
+    char line[80];
+    uint32_t cycles[2] = {~0u, ~0u};
+
+    for(unsigned run=0; run<BENCH_RUNS; run++)
+        {
+        for(unsigned way=0; way<2; way++)
+            {
+            __disable_irq();
+            uint32_t start = xCYCCNT;
+            bench_result = (uintptr_t)(way ? sprintf_line(line, src, 16) : dump_line(line, src, 16));
+            uint32_t time = xCYCCNT - start;
+            __enable_irq();
+
+            if(time < cycles[way])
+                {
+                cycles[way] = time;
+                }
+            }
+        }
+
+    printf("\ncycles per dump line: %u format.hpp, %u sprintf\n", (unsigned)(cycles[0] - overhead), (unsigned)(cycles[1] - overhead));
+    }
@@ -5,6 +5,10 @@
 #include "local.h"
 #include "main.h"
 #include "cmsis.h"
+#include "cyccnt.hpp"
+#include "ordered.hpp"
+#include "palgo.hpp"
+#include "arena.hpp"
 
 
 void OmpTestCommand(char *p)
@@ -12,7 +16,11 @@ void OmpTestCommand(char *p)
             extern void omp_hello(int);
             extern void omp_for(int);
             extern void omp_single(int);
-            extern void permute(int colors_arg, int balls, int plevel_arg, int verbose_arg);
+            extern int permute(int colors_arg, int balls, int plevel_arg, int verbose_arg);
+            extern int search(int n, int pos, bool cancel, int *scanned);
+            extern long taskloop_sum(int n, int grainsize);
+            extern long parallel_for_sum(int n);
+            extern int threadprivate_test(int n, bool shared);
 
             int test = 0;
 
@@ -22,6 +30,12 @@ void OmpTestCommand(char *p)
                 printf("1: omp_for,    test #pragma omp parallel for num_threads(arg)\n");
                 printf("2: omp_single, test #pragma omp single, arg is team size\n");
                 printf("3: permute(colors, ball, plevel, verbose), test omp_task\n");
+                printf("4: search(n, pos), test omp cancel, time a search with and without cancellation\n");
+                printf("5: taskloop(n, grainsize), time a taskloop and a parallel for of uneven cost\n");
+                printf("6: threadprivate(n), count to n in each thread with a threadprivate and a shared counter\n");
+                printf("7: ordered(blocks), checksum blocks in parallel and output in order, vs serial\n");
+                printf("8: palgo(n), time parallel_for/reduce/scan/sort of n elements vs serial\n");
+                printf("9: arena(colors, balls), time permute with its task data from the command's arena vs the heap\n");
                 }
             else
                 {
@@ -34,6 +48,7 @@ void OmpTestCommand(char *p)
                 case 1: omp_for(getdec(&p));        break;
                 case 2: omp_single(getdec(&p));     break;
                 case 3:
+                    {
                     int colors = getdec(&p);
                     skip(&p);
                     int balls = getdec(&p);
@@ -42,6 +57,121 @@ void OmpTestCommand(char *p)
                     skip(&p);
                     int v = *p?getdec(&p):0;
                     permute(colors, balls, plevel, v);
+                    }
+                    break;
+                case 4:
+                    {
+                    int n = getdec(&p);
+                    skip(&p);
+                    int pos = *p?getdec(&p):n/4;
+                    int scanned;
+                    int found;
+                    unsigned us;
+
+                    Elapsed();
+                    found = search(n, pos, false, &scanned);
+                    us = Elapsed();
+                    printf("full:   found %d, scanned %d keys, %u usec\n", found, scanned, us);
+
+                    Elapsed();
+                    found = search(n, pos, true, &scanned);
+                    us = Elapsed();
+                    printf("cancel: found %d, scanned %d keys, %u usec\n", found, scanned, us);
+                    }
+                    break;
+                case 5:
+                    {
+                    int n = getdec(&p);
+                    skip(&p);
+                    int grainsize = *p?getdec(&p):0;
+                    long sum;
+                    unsigned us;
+
+                    Elapsed();
+                    sum = parallel_for_sum(n);
+                    us = Elapsed();
+                    printf("parallel for: sum %08lx, %u usec\n", sum, us);
+
+                    Elapsed();
+                    sum = taskloop_sum(n, grainsize);
+                    us = Elapsed();
+                    printf("taskloop:     sum %08lx, %u usec\n", sum, us);
+                    }
+                    break;
+
+                case 6:
+                    {
+                    int n = getdec(&p);
+                    int good;
+                    unsigned us;
+
+                    Elapsed();
+                    good = threadprivate_test(n, false);
+                    us = Elapsed();
+                    printf("threadprivate: %d threads correct, %u usec\n", good, us);
+
+                    Elapsed();
+                    good = threadprivate_test(n, true);
+                    us = Elapsed();
+                    printf("shared array:  %d threads correct, %u usec\n", good, us);
+                    }
+                    break;
+
+                case 7:
+                    {
+                    int blocks = getdec(&p);
+                    uint32_t expect = 0;
+
+                    for(int mode=0; mode<CRC_NUM_MODES; mode++)     // serial first, it provides the expected digest
+                        {
+                        Elapsed();
+                        uint32_t digest = crc_stream(blocks, mode, 0);
+                        unsigned us = Elapsed();
+
+                        if(mode == CRC_SERIAL)
+                            {
+                            expect = digest;
+                            }
+
+                        printf("%-10s digest %08lx %s, %u usec\n", crc_stream_modes[mode], (unsigned long)digest, digest==expect ? "ok" : "FAIL", us);
+                        }
+                    }
+                    break;
+
+                case 8:
+                    {
+                    int n = getdec(&p);
+
+                    for(int algo=0; algo<PALGO_NUM_ALGOS; algo++)
+                        {
+                        Elapsed();
+                        uint32_t expect = palgo_bench(algo, n, false);
+                        unsigned serial = Elapsed();
+                        uint32_t result = palgo_bench(algo, n, true);
+                        unsigned parallel = Elapsed();
+
+                        printf("%-7s %08lx %s, serial %u usec, parallel %u usec\n", palgo_names[algo], (unsigned long)result, result && result==expect ? "ok" : "FAIL", serial, parallel);
+                        }
+                    }
+                    break;
+
+                case 9:
+                    {
+                    int colors = getdec(&p);
+                    skip(&p);
+                    int balls = getdec(&p);
+                    Arena *arena = arena_select(0);             // the command's arena
+
+                    Elapsed();
+                    permute(colors, balls, 32, 0);
+                    unsigned heap = Elapsed();
+
+                    arena_select(arena);
+                    permute(colors, balls, 32, 0);
+                    unsigned us = Elapsed();
+
+                    printf("heap %u usec, arena %u usec, arena peak %u bytes\n", heap, us, arena ? (unsigned)arena->peak() : 0);
+                    }
                     break;
                     }
                 }
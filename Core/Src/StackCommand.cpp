@@ -12,6 +12,7 @@ void StackCommand(char *p)
     for(int i=0; i<GOMP_MAX_NUM_THREADS; i++)
         {
         extern const char *thread_names[];
+        if(omp_threads[i].stack_low == 0)continue;      // a thread that has not been created
         printf("\%s stack, %d bytes:\n", thread_names[i], omp_threads[i].stack_high - omp_threads[i].stack_low);
         dump(omp_threads[i].stack_low, omp_threads[i].stack_high - omp_threads[i].stack_low);
         }
@@ -8,6 +8,12 @@
 #include "boundaries.h"
 
 extern void summary(unsigned char *, unsigned, unsigned, int);
+extern void summary_snap(unsigned char *, unsigned, unsigned);
+extern void summary_diff();
+
+// sum {v} {<addr> {<size> {<block>}}}     summarize memory, the default is flash and RAM
+// sum snap {<addr> {<size> {<block>}}}    remember a hash of each block, the default is RAM
+// sum diff                                show the blocks that have changed since the snapshot
 
 void SumCommand(char *p)
     {
@@ -17,6 +23,35 @@ void SumCommand(char *p)
     int values = 0;
     bool defaults = false;
 
+    if(strncmp(p, "diff", 4) == 0)
+        {
+        summary_diff();
+        return;
+        }
+
+    if(strncmp(p, "snap", 4) == 0)
+        {
+        addr = (unsigned char *)&_memory2_start;
+        size = (unsigned char *)&_memory2_end - (unsigned char *)&_memory2_start;
+        skip(&p);
+        if(isxdigit(*p))
+            {
+            addr = (unsigned char *)gethex(&p);
+            skip(&p);
+            if(isxdigit(*p))
+                {
+                size = gethex(&p);
+                skip(&p);
+                if(isxdigit(*p))
+                    {
+                    inc = gethex(&p);
+                    }
+                }
+            }
+        summary_snap(addr, size, inc);
+        return;
+        }
+
     if(*p == 'v')                                       // flag, if specified print value of RAM if all bytes are the same
         {
         values = 1;
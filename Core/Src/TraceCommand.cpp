@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "local.h"
+#include "main.h"
+#include "cmsis.h"
+#include "gomp_trace.hpp"
+
+
+// trace            dump the OpenMP trace buffer
+// trace c          clear the trace buffer
+// trace on         install the trace recorder as the libgomp tool
+// trace off        remove the libgomp tool
+
+void TraceCommand(char *p)
+    {
+    if(*p == 'c')
+        {
+        gomp_trace_clear();
+        }
+#if GOMP_TRACE
+    else if(p[0] == 'o' && p[1] == 'n')
+        {
+        gomp_tool_callback = gomp_trace_record;
+        }
+    else if(p[0] == 'o' && p[1] == 'f')
+        {
+        gomp_tool_callback = 0;
+        }
+#endif
+    else
+        {
+        gomp_trace_dump();
+        }
+    }
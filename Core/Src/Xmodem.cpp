@@ -5,6 +5,7 @@
 #include "serial.h"  // serial communication functions
 #include "local.h"
 #include "tim.h"
+#include "binlog.hpp"               // the console is busy with the transfer, so errors are logged rather than printed
 
 
 static const int NHIST = 100;
@@ -57,15 +58,14 @@ static inline void putx(uint8_t ch)
 // discard input bytes until a timeout occurs
 // this is part of recovering from a protocol error
 // if we get confused in the middle of a packet, we want to wait until the host stops sending before we send a NAK and start processing input
+// the bytes go to a buffer of their own, so the packet in xbuffer can still be logged
 static void xflush()
     {
-    int c;                                  // the character we got from the input stream
+    uint8_t junk[64];
 
-    do
+    while(console_read(junk, sizeof(junk), 20'000) == (int)sizeof(junk))
         {
-        c = __io_getchart(20'000);
         }
-    while(c != -1);
     }
 
 
@@ -79,6 +79,7 @@ static void xflush()
 // functions used:
 // int __io_getchart(unsigned timeout)  get a raw console character, with timeout in microseconds.
 //                                      returns a character (0-255) or -1 for timeout
+// int console_read(buf, n, timeout)    read n raw bytes, returns fewer if the input stops for timeout microseconds
 
 
 void xmodem_receive(uint8_t *qbuffer)
@@ -108,6 +109,7 @@ void xmodem_receive(uint8_t *qbuffer)
             {
             putx(NAK);                          // on timeout request to (re)send the packet
             ++timeouts;
+            LOG("xmodem: timeout waiting for packet %u", packet);
             }
 
         else if (c == SOH)                      // start receiving a packet
@@ -115,23 +117,23 @@ void xmodem_receive(uint8_t *qbuffer)
             timeout = 20'000;                   // once a packet has been started, set timeout shorter
             checksum = 0;                       // init the packet checksum
 
-            for (int i = 0; i < PACKET_SIZE + 3; i++) // for each character in the packet
+            hstart();
+            if(console_read(xbuffer, PACKET_SIZE + 3, timeout) < PACKET_SIZE + 3)   // the rest of the packet, in as few pieces as it comes
                 {
-                hstart();
-                c = __io_getchart(timeout);     // get the next character
-                hstop();
-                if(c == -1)break;               // abort packet if timeout
-                xbuffer[i] = c;                 // save the data in the packet buffer
-                if(i>1 && i<PACKET_SIZE+2)      // if this is a header or payload byte
-                    {
-                    checksum += xbuffer[i];     // add it to the checksum
-                    }
+                c = -1;                         // abort packet if timeout
+                }
+            hstop();
+
+            for (int i = 2; i < PACKET_SIZE + 2; i++) // for each payload byte
+                {
+                checksum += xbuffer[i];         // add it to the checksum
                 }
 
             if(c == -1)
                 {
                 putx(NAK);                          // on timeout request to (re)send the packet
                 ++timeouts;
+                LOG("xmodem: timeout in packet %u", packet);
                 continue;
                 }
 
@@ -143,6 +145,7 @@ void xmodem_receive(uint8_t *qbuffer)
                 xflush();                           // wait until the host stops sending data
                 putx(NAK);
                 ++badseq;
+                LOG("xmodem: packet %u, bad number check %u", xbuffer[0], xbuffer[1]);
                 continue;
                 }
 
@@ -151,6 +154,7 @@ void xmodem_receive(uint8_t *qbuffer)
                 xflush();                               // wait until the host stops sending data
                 putx(NAK);
                 ++badchecksum;
+                LOG("xmodem: packet %u, checksum %02x, expected %02x", xbuffer[0], xbuffer[PACKET_SIZE + 2], checksum);
                 continue;
                 }
 
@@ -158,6 +162,7 @@ void xmodem_receive(uint8_t *qbuffer)
                 {
                 putx(ACK);
                 ++duplicates;
+                LOG("xmodem: packet %u again", xbuffer[0]);
                 continue;
                 }
 
@@ -166,6 +171,7 @@ void xmodem_receive(uint8_t *qbuffer)
                 xflush();                               // wait until the host stops sending data
                 putx(NAK);
                 ++outoforder;
+                LOG("xmodem: packet %u, expected %u", xbuffer[0], packet & 255);
                 continue;
                 }
 
@@ -0,0 +1,65 @@
+// arena.cpp
+//
+// The per-thread current arena, and allocation from it, see arena.hpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdlib.h>
+#include "libgomp.hpp"
+#include "arena.hpp"
+#include "heap.hpp"
+
+
+Arena *arena_current()
+    {
+    return omp_this_thread()->arena;
+    }
+
+
+Arena *arena_select(Arena *arena)
+    {
+    omp_thread &thread = *omp_this_thread();
+    Arena *prev = thread.arena;
+
+    thread.arena = arena;
+    return prev;
+    }
+
+
+void *arena_malloc(size_t size)
+    {
+    Arena *arena = omp_this_thread()->arena;
+
+    if(arena)
+        {
+        void *p = arena->alloc(size);
+        if(p)
+            {
+            return p;
+            }
+        }
+
+    return malloc_at(size, __builtin_return_address(0));   // no arena, or it is full, charged to the caller
+    }
+
+
+void arena_free(void *ptr, Arena *arena)
+    {
+    for(; arena; arena = arena->parent)
+        {
+        if(arena->release(ptr))
+            {
+            return;
+            }
+        }
+
+    free(ptr);
+    }
+
+
+void arena_free(void *ptr)
+    {
+    arena_free(ptr, omp_this_thread()->arena);
+    }
@@ -30,8 +30,7 @@
 
 ContextFIFO DeferFIFO;
 
-extern Port txPort;                              // ports for use by the console (serial or USB VCP)
-extern Port rxPort;
+extern Port rxPort;                              // port for use by the console (serial or USB VCP)
 extern Port tempPort;
 extern bool waiting_for_command;
 
@@ -80,6 +79,8 @@ void background()                                       // powerup init and back
 
     libgomp_init();                                     // init the OpenMP threading system, including setting background as thread 0
 
+    console_init();                                     // start the thread that sends console output
+
     #pragma omp parallel num_threads(3)
     if(omp_get_thread_num() == 0)                       // thread 0 runs this:
         {
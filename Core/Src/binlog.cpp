@@ -0,0 +1,107 @@
+// binlog.cpp
+//
+// The ring buffer of the binary log. See binlog.hpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cmsis.h"
+#include "cyccnt.hpp"
+#include "libgomp.hpp"
+#include "binlog.hpp"
+
+#ifndef CPU_FREQ_MHZ
+#define CPU_FREQ_MHZ 1000                   // the host port counts nanoseconds
+#endif
+
+static_assert((BINLOG_WORDS & (BINLOG_WORDS-1)) == 0, "BINLOG_WORDS must be a power of 2");
+
+static uint32_t log_buf[BINLOG_WORDS];      // the ring buffer
+static unsigned log_head = 0;               // free running count of words written
+static unsigned log_tail = 0;               // where the oldest record starts
+
+bool binlog_enabled = true;
+unsigned binlog_lost = 0;
+
+
+// the thread that is logging, for the record header
+static inline unsigned log_thread()
+    {
+    uintptr_t offset = (uintptr_t)Context::pointer() - (uintptr_t)omp_threads;
+
+    if(__get_IPSR() != 0)
+        {
+        return BINLOG_ISR;
+        }
+    if(offset < sizeof(omp_threads) && offset % sizeof(omp_thread) == 0)
+        {
+        return offset / sizeof(omp_thread);
+        }
+    return BINLOG_OTHER;
+    }
+
+
+// Add a record to the ring, overwriting the oldest records if there isn't room.
+// Interrupts are disabled, rather than enabled and disabled, so LOG works in a handler
+// and in a critical region.
+
+void binlog_write(uint32_t header, uint32_t id, const uint32_t *args)
+    {
+    unsigned words = BINLOG_WORDS_OF(header);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    unsigned head = log_head;
+
+    while(head + 3 + words - log_tail > BINLOG_WORDS)
+        {
+        log_tail += 3 + BINLOG_WORDS_OF(log_buf[log_tail & (BINLOG_WORDS-1)]);
+        ++binlog_lost;
+        }
+
+    log_buf[head++ & (BINLOG_WORDS-1)] = header | log_thread() << 16;
+    log_buf[head++ & (BINLOG_WORDS-1)] = id;
+    log_buf[head++ & (BINLOG_WORDS-1)] = Now();
+    while(words--)
+        {
+        log_buf[head++ & (BINLOG_WORDS-1)] = *args++;
+        }
+    log_head = head;
+
+    __set_PRIMASK(primask);
+    }
+
+
+void binlog_clear()
+    {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    log_tail = log_head;
+    binlog_lost = 0;
+    __set_PRIMASK(primask);
+    }
+
+
+// Print the log, oldest record first, as hex words for host/logdecode. Logging is
+// turned off while printing, so that the records can't be overwritten as they are printed.
+
+void binlog_dump()
+    {
+    bool save = binlog_enabled;
+    binlog_enabled = false;
+
+    unsigned head = log_head;
+    unsigned tail = log_tail;
+
+    printf("binlog %u MHz, %u words, %u records lost\n", (unsigned)CPU_FREQ_MHZ, head - tail, binlog_lost);
+    for(unsigned i=0; tail+i != head; i++)
+        {
+        printf("%08x%c", (unsigned)log_buf[(tail + i) & (BINLOG_WORDS-1)], i % 8 == 7 || tail+i+1 == head ? '\n' : ' ');
+        }
+    printf("end\n");
+
+    binlog_enabled = save;
+    }
@@ -0,0 +1,649 @@
+// bulk.cpp
+//
+// The device end of the binary protocol of bulk.hpp. bulk_serve takes the USB link from the
+// console and serves the host's requests until it sends EXIT, or sends nothing for BULK_IDLE.
+//
+// Packets from the host don't go through the console's receive ring. The USB interrupt hands
+// each to bulk_consume, which finds the frames in it and copies their payloads into slots, and
+// takes acknowledgements at once, so the sender sees them without waiting for the thread. When
+// the slots fill, the host is held off by USB until the thread has taken one. Frames to the host
+// are written in place in the transmit ring, the data straight from memory or the file.
+//
+// The console must not print while the link is in this mode. What it does print is seen by the
+// host as noise between frames, or as a frame with a bad CRC, and is dropped.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#include <stdint.h>
+#include <string.h>
+#include "local.h"
+#include "serial.h"
+#include "tim.h"
+#include "ContextFIFO.hpp"
+#include "usbd_cdc_if.h"
+#include "ff.h"
+#include "Pool.hpp"
+#include "bulk.hpp"
+
+extern Pool<FIL, NFILES> file_pool;
+
+BulkStats bulk_stats;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// frames from the host, found by the USB interrupt
+//////////////////////////////////////////////////////////////////////////////
+
+struct Slot
+    {
+    uint8_t header[BULK_HEADER];
+    uint8_t payload[BULK_PAYLOAD];
+    bool good;                                                  // the CRC matched
+    };
+
+static Slot slots[BULK_SLOTS];
+static volatile unsigned slot_head = 0;                         // the next slot the interrupt fills, free running
+static volatile unsigned slot_tail = 0;                         // the next the thread takes
+
+// the frame being received
+static uint8_t rx_header[BULK_HEADER];
+static uint8_t rx_trailer[BULK_TRAILER];
+static unsigned rx_have = 0;                                    // bytes of it so far
+static unsigned rx_length = 0;                                  // of its payload
+static uint32_t rx_crc = 0;
+static uint8_t *rx_payload = 0;                                 // where its payload goes, 0 to drop it
+static uint32_t rx_stamp = 0;                                   // when the last packet came, or the host was let send
+
+// The last ACK or NAK from the host, as one word so it is read whole: a count of them in the
+// upper half, 1 for a NAK in bit 8, and the number of the next frame the host expects below.
+static volatile uint32_t ack_word = 0;
+
+
+// the end of a frame
+static void frame_end()
+    {
+    unsigned type = rx_header[1];
+    bool good = rx_crc == bulk_get32(rx_trailer);
+
+    if(!good)
+        {
+        ++bulk_stats.bad;
+        }
+
+    if(type == BULK_ACK || type == BULK_NAK)
+        {
+        if(good)
+            {
+            unsigned next = type == BULK_ACK ? rx_header[2] + 1 : rx_header[2];
+
+            ack_word = ((ack_word >> 16) + 1) << 16 | (type == BULK_NAK) << 8 | (next & 0xFF);
+            }
+        }
+    else if(rx_payload)
+        {
+        Slot &s = slots[slot_head % BULK_SLOTS];
+
+        memcpy(s.header, rx_header, BULK_HEADER);
+        s.good = good;
+        COMPILER_BARRIER();                                     // the slot is filled before the thread can see it
+        ++slot_head;
+        }
+    else
+        {
+        ++bulk_stats.dropped;                                   // the host sent more than its window
+        }
+    }
+
+
+// Find the frames in a packet from the host, called from the USB interrupt. It returns whether
+// there is room for another packet, a free slot. The host never has more frames in flight than
+// there are slots, so whatever frame the packet starts or ends has a slot of its own.
+static uint32_t bulk_consume(uint8_t *buf, uint32_t len)
+    {
+    uint32_t now = __HAL_TIM_GET_COUNTER(&htim2);
+
+    if(rx_have && now - rx_stamp >= BULK_RESEND)                // the rest of a frame cut short by a lost packet isn't
+        {                                                       // coming, and would swallow the next request
+        ++bulk_stats.bad;
+        rx_have = 0;
+        }
+    rx_stamp = now;
+
+    while(len)
+        {
+        if(rx_have < BULK_HEADER)                               // the header, found by its magic number and check
+            {
+            if(rx_have == 0 && *buf != BULK_MAGIC)
+                {
+                ++buf;
+                --len;
+                continue;
+                }
+
+            rx_header[rx_have++] = *buf++;
+            --len;
+            if(rx_have < BULK_HEADER)
+                {
+                continue;
+                }
+
+            if(!bulk_header_ok(rx_header))                      // not a header, look again from its second byte
+                {
+                unsigned i = 1;
+
+                while(i < BULK_HEADER && rx_header[i] != BULK_MAGIC)
+                    {
+                    ++i;
+                    }
+                rx_have = BULK_HEADER - i;
+                memmove(rx_header, rx_header + i, rx_have);
+                continue;
+                }
+
+            unsigned type = rx_header[1];
+
+            rx_length = bulk_get16(&rx_header[3]);
+            rx_crc = bulk_crc(0, rx_header, BULK_HEADER);
+            rx_payload = 0;
+            if(type != BULK_ACK && type != BULK_NAK && slot_head - slot_tail < BULK_SLOTS)
+                {
+                rx_payload = slots[slot_head % BULK_SLOTS].payload;
+                }
+            }
+
+        else if(rx_have < BULK_HEADER + rx_length)              // the payload
+            {
+            unsigned offset = rx_have - BULK_HEADER;
+            unsigned n = rx_length - offset < len ? rx_length - offset : len;
+
+            rx_crc = bulk_crc(rx_crc, buf, n);
+            if(rx_payload)
+                {
+                memcpy(rx_payload + offset, buf, n);
+                }
+            rx_have += n;
+            buf += n;
+            len -= n;
+            }
+
+        else                                                    // the CRC
+            {
+            rx_trailer[rx_have++ - BULK_HEADER - rx_length] = *buf++;
+            --len;
+            if(rx_have == BULK_HEADER + rx_length + BULK_TRAILER)
+                {
+                frame_end();
+                rx_have = 0;
+                }
+            }
+        }
+
+    return slot_head - slot_tail < BULK_SLOTS;
+    }
+
+
+// wait for the next frame from the host, for up to timeout microseconds
+static Slot *next_frame(unsigned timeout)
+    {
+    uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
+
+    while(slot_head == slot_tail)
+        {
+        if(__HAL_TIM_GET_COUNTER(&htim2) - start >= timeout)
+            {
+            return 0;
+            }
+        yield();
+        }
+
+    ++bulk_stats.received;
+    return &slots[slot_tail % BULK_SLOTS];
+    }
+
+// give back the slot of the frame next_frame returned
+static void release_frame()
+    {
+    ++slot_tail;
+    rx_stamp = __HAL_TIM_GET_COUNTER(&htim2);                   // the host was held off, not slow
+    vcp_rx_ready();                                             // a slot is free, let the host send again
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// frames to the host
+//////////////////////////////////////////////////////////////////////////////
+
+// Where the payload of a frame comes from: n bytes at offset in the data of a transfer are put
+// at dst. It returns false if they can't be had, and the frame is sent with what dst held.
+typedef bool Source(void *ctx, uint32_t offset, uint8_t *dst, uint32_t n);
+
+static bool memory_source(void *ctx, uint32_t offset, uint8_t *dst, uint32_t n)
+    {
+    memcpy(dst, (const uint8_t *)ctx + offset, n);
+    return true;
+    }
+
+
+// Put a frame in the transmit ring. The payload is length bytes from the source, starting at
+// offset, written in place in the ring. Returns false if the source failed.
+static bool send_frame(unsigned type, unsigned seq, uint32_t length, Source *source, void *ctx, uint32_t offset)
+    {
+    uint8_t header[BULK_HEADER];
+    uint8_t trailer[BULK_TRAILER];
+    bool ok = true;
+
+    bulk_header(header, type, seq, length);
+    uint32_t crc = bulk_crc(0, header, BULK_HEADER);
+
+    for(unsigned part=0; part<3; part++)                        // the header, the payload, and the CRC
+        {
+        uint32_t size = part == 0 ? BULK_HEADER : part == 1 ? length : BULK_TRAILER;
+
+        if(part == 2)
+            {
+            bulk_put32(trailer, crc);
+            }
+
+        for(uint32_t done=0; done<size; )
+            {
+            uint32_t room;
+            uint8_t *dst = vcp_reserve(&room);
+
+            if(room == 0)
+                {
+                vcp_txwait();
+                continue;
+                }
+            if(room > size - done)
+                {
+                room = size - done;
+                }
+
+            if(part == 0)
+                memcpy(dst, header + done, room);
+            else if(part == 1)
+                {
+                ok = source(ctx, offset + done, dst, room) && ok;
+                crc = bulk_crc(crc, dst, room);
+                }
+            else
+                memcpy(dst, trailer + done, room);
+
+            vcp_commit(room);
+            done += room;
+            }
+        }
+
+    ++bulk_stats.sent;
+    return ok;
+    }
+
+static void send_small(unsigned type, unsigned seq, const void *payload = 0, uint32_t length = 0)
+    {
+    send_frame(type, seq, length, memory_source, (void *)payload, 0);
+    }
+
+static void send_end(uint32_t status, uint32_t count)
+    {
+    uint8_t end[8];
+
+    bulk_put32(&end[0], status);
+    bulk_put32(&end[4], count);
+    send_small(BULK_END, 0, end, sizeof(end));
+    }
+
+static void send_hello()
+    {
+    uint8_t hello[4] = {BULK_VERSION, BULK_SLOTS};
+
+    bulk_put16(&hello[2], BULK_PAYLOAD);
+    send_small(BULK_HELLO, 0, hello, sizeof(hello));
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// transfers
+//////////////////////////////////////////////////////////////////////////////
+
+// Send length bytes from the source as DATA frames, going back N on a NAK or a silence. Returns
+// a BulkStatus, and the bytes the host has acknowledged in *count.
+static uint32_t send_stream(Source *source, void *ctx, uint32_t length, uint32_t *count)
+    {
+    uint32_t frames = (length + BULK_PAYLOAD - 1) / BULK_PAYLOAD;
+    uint32_t base = 0;                                          // the oldest frame not acknowledged
+    uint32_t next = 0;                                          // the next frame to send
+    uint32_t seen = ack_word;
+    uint32_t heard = __HAL_TIM_GET_COUNTER(&htim2);             // when the host last made progress, or was last prodded
+    unsigned tries = 0;
+    uint32_t status = BULK_OK;
+
+    while(base < frames)
+        {
+        uint32_t word = ack_word;
+
+        if(word != seen)                                        // an ACK or NAK
+            {
+            uint32_t advance = (word - base) & 0xFF;
+
+            seen = word;
+            if(advance <= next - base)                          // ignore one that doesn't fit the window
+                {
+                base += advance;
+                if(advance)
+                    {
+                    heard = __HAL_TIM_GET_COUNTER(&htim2);
+                    tries = 0;
+                    }
+                if(word & 0x100)
+                    {
+                    next = base;
+                    ++bulk_stats.resent;
+                    }
+                }
+            }
+        else if(next < frames && next - base < BULK_WINDOW)
+            {
+            uint32_t offset = next * BULK_PAYLOAD;
+            uint32_t n = length - offset < BULK_PAYLOAD ? length - offset : BULK_PAYLOAD;
+
+            if(!send_frame(BULK_DATA, next & 0xFF, n, source, ctx, offset) && status == BULK_OK)
+                {
+                status = BULK_FILE;                             // the file failed, the host learns it from the END
+                }
+            ++next;
+            }
+        else if(__HAL_TIM_GET_COUNTER(&htim2) - heard >= BULK_RESEND)
+            {
+            if(++tries > BULK_TRIES)
+                {
+                status = BULK_TIMEOUT;
+                break;
+                }
+            next = base;
+            heard = __HAL_TIM_GET_COUNTER(&htim2);
+            ++bulk_stats.resent;
+            }
+        else
+            {
+            yield();
+            }
+        }
+
+    *count = base * BULK_PAYLOAD < length ? base * BULK_PAYLOAD : length;
+    return status;
+    }
+
+
+// Where received data goes: n bytes at offset in the data of the transfer. Returns false if
+// they can't be written.
+typedef bool Sink(void *ctx, uint32_t offset, const uint8_t *src, uint32_t n);
+
+// Take length bytes of DATA frames from the host into the sink. Returns a BulkStatus, and the
+// bytes taken in *count.
+static uint32_t receive_stream(Sink *sink, void *ctx, uint32_t length, uint32_t *count)
+    {
+    uint32_t got = 0;
+    uint32_t expected = 0;                                      // the number of the next frame
+    bool naked = false;                                         // a NAK has been sent for it
+    unsigned last = 0xFF;                                       // the number of the frame before
+    uint32_t status = BULK_OK;
+
+    while(got < length)
+        {
+        Slot *s = next_frame(BULK_RESEND * BULK_TRIES);
+
+        if(s == 0)
+            {
+            status = BULK_TIMEOUT;
+            break;
+            }
+
+        unsigned type = s->header[1];
+        unsigned seq = s->header[2];
+        uint32_t n = bulk_get16(&s->header[3]);
+
+        if(type != BULK_DATA && s->good)                        // a request, the host has given up on this one
+            {
+            --bulk_stats.received;                              // it is taken again by bulk_serve
+            status = BULK_ABORTED;
+            break;
+            }
+
+        if(s->good && seq == (expected & 0xFF) && n <= length - got && (n == BULK_PAYLOAD || got + n == length))
+            {
+            if(status == BULK_OK && !sink(ctx, got, s->payload, n))
+                {
+                status = BULK_FILE;                             // take the rest, and say so in the END
+                }
+            release_frame();
+            got += n;
+            ++expected;
+            naked = false;
+            send_small(BULK_ACK, seq);
+            }
+        else if(s->good && ((expected - seq - 1) & 0xFF) < BULK_SLOTS * 2 && expected)
+            {
+            release_frame();                                    // one already taken, sent again
+            send_small(BULK_ACK, expected - 1);
+            }
+        else
+            {
+            release_frame();
+            if(!naked || seq != ((last + 1) & 0xFF))            // the first out of order, or the host went back and lost it again
+                {
+                send_small(BULK_NAK, expected);
+                naked = true;
+                }
+            }
+        last = seq;
+        }
+
+    *count = got;
+    return status;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// memory and files
+//////////////////////////////////////////////////////////////////////////////
+
+// The memory of the STM32H503, as in STM32H503RBTX_FLASH.ld. It is weak, so that the test on the
+// host can give its own.
+static const uint32_t RAM_ORIGIN = 0x20000000;
+static const uint32_t RAM_LENGTH = 32*1024;
+static const uint32_t FLASH_ORIGIN = 0x08000000;
+static const uint32_t FLASH_LENGTH = 128*1024;
+
+static bool within(uint32_t address, uint32_t length, uint32_t base, uint32_t size)
+    {
+    return address >= base && length <= size && address - base <= size - length;
+    }
+
+__attribute__((weak)) bool bulk_addressable(uint32_t address, uint32_t length, bool write)
+    {
+    return within(address, length, RAM_ORIGIN, RAM_LENGTH)
+        || (!write && within(address, length, FLASH_ORIGIN, FLASH_LENGTH));
+    }
+
+static bool memory_sink(void *ctx, uint32_t offset, const uint8_t *src, uint32_t n)
+    {
+    memcpy((uint8_t *)ctx + offset, src, n);
+    return true;
+    }
+
+static bool file_source(void *ctx, uint32_t offset, uint8_t *dst, uint32_t n)
+    {
+    FIL *fil = (FIL *)ctx;
+    UINT br;
+
+    if(f_tell(fil) != offset && f_lseek(fil, offset) != FR_OK)  // back, to send a frame again
+        {
+        return false;
+        }
+    return f_read(fil, dst, n, &br) == FR_OK && br == n;
+    }
+
+static bool file_sink(void *ctx, uint32_t, const uint8_t *src, uint32_t n)
+    {
+    UINT bw;
+
+    return f_write((FIL *)ctx, src, n, &bw) == FR_OK && bw == n;
+    }
+
+
+// the path in a request, made a string
+static bool get_path(char *path, unsigned size, const uint8_t *p, unsigned n)
+    {
+    if(n == 0 || n >= size)
+        {
+        return false;
+        }
+    memcpy(path, p, n);
+    path[n] = 0;
+    return true;
+    }
+
+
+// GET and PUT
+static uint32_t file_request(unsigned type, const char *path, uint32_t length, uint32_t *count)
+    {
+    FIL *fil = file_pool.acquire();
+    uint32_t status;
+
+    *count = 0;
+    if(fil == 0)
+        {
+        return BULK_FILE + FR_TOO_MANY_OPEN_FILES;
+        }
+
+    FRESULT res = f_open(fil, path, type == BULK_GET ? FA_READ : FA_WRITE | FA_CREATE_ALWAYS);
+
+    if(res != FR_OK)
+        {
+        status = BULK_FILE + res;
+        }
+    else
+        {
+        if(type == BULK_GET)
+            status = send_stream(file_source, fil, f_size(fil), count);
+        else
+            status = receive_stream(file_sink, fil, length, count);
+
+        res = f_close(fil);
+        if(status == BULK_OK && res != FR_OK)
+            {
+            status = BULK_FILE + res;
+            }
+        }
+
+    file_pool.release(fil);
+    return status;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// the mode
+//////////////////////////////////////////////////////////////////////////////
+
+void bulk_serve()
+    {
+    uint8_t discard[64];
+
+    console_flush();                                            // the console's output goes before the HELLO,
+    while(vcp_read(discard, sizeof(discard)))                   // and its input is the command that got here
+        {
+        }
+
+    slot_head = slot_tail = 0;
+    rx_have = 0;
+    vcp_rx_divert(bulk_consume);
+    send_hello();
+
+    while(true)
+        {
+        Slot *s = next_frame(BULK_IDLE);
+
+        if(s == 0)
+            {
+            break;
+            }
+
+        unsigned type = s->header[1];
+        uint32_t n = bulk_get16(&s->header[3]);
+        uint8_t request[8 + _MAX_LFN + 1];                      // the payload of a request is short
+        bool good = s->good && n <= sizeof(request);
+
+        if(good)
+            {
+            memcpy(request, s->payload, n);
+            }
+        release_frame();
+
+        if(!good || type == BULK_DATA)                          // left over from a transfer that was given up
+            {
+            continue;
+            }
+
+        ++bulk_stats.requests;
+
+        uint32_t status = BULK_BAD_REQUEST;
+        uint32_t count = 0;
+        char path[_MAX_LFN + 1];
+
+        switch(type)
+            {
+        case BULK_HELLO:
+            send_hello();
+            continue;
+
+        case BULK_READ:
+        case BULK_WRITE:
+            if(n == 8)
+                {
+                uint32_t at = bulk_get32(&request[0]);
+                uint8_t *address = (uint8_t *)(uintptr_t)at;
+                uint32_t length = bulk_get32(&request[4]);
+
+                if(!bulk_addressable(at, length, type == BULK_WRITE))
+                    status = BULK_BAD_ADDRESS;
+                else if(type == BULK_READ)
+                    status = send_stream(memory_source, address, length, &count);
+                else
+                    status = receive_stream(memory_sink, address, length, &count);
+                }
+            break;
+
+        case BULK_GET:
+            if(get_path(path, sizeof(path), request, n))
+                {
+                status = file_request(type, path, 0, &count);
+                }
+            break;
+
+        case BULK_PUT:
+            if(n > 4 && get_path(path, sizeof(path), request + 4, n - 4))
+                {
+                status = file_request(type, path, bulk_get32(&request[0]), &count);
+                }
+            break;
+
+        case BULK_EXIT:
+            status = BULK_OK;
+            break;
+
+        default:
+            break;
+            }
+
+        bulk_stats.bytes += count;
+        send_end(status, count);
+        if(type == BULK_EXIT)
+            {
+            break;
+            }
+        }
+
+    console_flush();                                            // the last frame goes before anything the console says
+    vcp_rx_divert(0);
+    }
@@ -1,6 +1,7 @@
 #include <ContextFIFO.hpp>
 #include <stdio.h>
 #include "local.h"
+#include "format.hpp"
 
 // memory dump
 
@@ -11,36 +12,42 @@
 static char buf[BUFLEN];
 extern bool ControlC;
 
-void dump(void *pp, int size)
+// format a line of the dump, up to 16 bytes at p, and return the end of the string
+char *dump_line(char *b, const unsigned char *p, int size)
     {
     int i;
     int c;
-    unsigned char *p = (unsigned char *)pp;
-    char *b;
 
-    while(size>0 && !ControlC)
+    b += SPRINT(b,"%08x: ",(uintptr_t)p);
+    for(i=0;i<16;i+=4)
         {
-        b = buf;
-        b += sprintf(b,"%08x: ",(int)p);
-        for(i=0;i<16;i+=4)
-            {
-            if(i<size)sprintf(b,"%08x ",*(int *)&p[i]);
-            else sprintf(b,"         ");
-            b += 9;
-            }
-        *b++ = ' ';
-        *b++ = '|';
-        for(i=0;i<16;i++)
+        if(i<size)SPRINT(b,"%08x ",*(uint32_t *)&p[i]);
+        else SPRINT(b,"         ");
+        b += 9;
+        }
+    *b++ = ' ';
+    *b++ = '|';
+    for(i=0;i<16;i++)
+        {
+        if(i<size)
             {
-            if(i<size)
-                {
-                c=p[i];
-                if(' '<=c&&c<0x7f)*b++ = c;
-                else *b++ = '.';
-                }
+            c=p[i];
+            if(' '<=c&&c<0x7f)*b++ = c;
+            else *b++ = '.';
             }
-        *b++ = '|';
-        *b++ = 0;
+        }
+    *b++ = '|';
+    *b = 0;
+    return b;
+    }
+
+void dump(void *pp, int size)
+    {
+    unsigned char *p = (unsigned char *)pp;
+
+    while(size>0 && !ControlC)
+        {
+        dump_line(buf, p, size);
         p += 16;
         size -= 16;
         puts(buf);
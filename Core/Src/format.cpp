@@ -0,0 +1,233 @@
+// The emitters of format.hpp, one small function for each kind of conversion.
+//
+// A number is converted backward into a scratch buffer, and then padded and copied out. The
+// code that format.hpp expands at a call site only passes a value and a constant Spec.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#include <string.h>
+#include "format.hpp"
+
+extern "C" int _write(int file, const char *ptr, int len);
+
+namespace format
+{
+
+static const char lower_digits[] = "0123456789abcdef";
+static const char upper_digits[] = "0123456789ABCDEF";
+
+
+// The buffer is full. The console's is sent and reused, a string's is the end of the output.
+bool Out::drain()
+    {
+    if(!console)
+        {
+        return false;
+        }
+
+    _write(1, base, p - base);
+    done += p - base;
+    p = base;
+    return true;
+    }
+
+
+void Out::write(const char *s, unsigned n)
+    {
+    while(n)
+        {
+        if(p == end && !drain())
+            {
+            done += n;
+            return;
+            }
+
+        unsigned room = end - p;
+        unsigned chunk = n < room ? n : room;
+
+        memcpy(p, s, chunk);
+        p += chunk;
+        s += chunk;
+        n -= chunk;
+        }
+    }
+
+
+void Out::fill(char c, unsigned n)
+    {
+    while(n--)
+        {
+        put(c);
+        }
+    }
+
+
+unsigned Out::finish()
+    {
+    unsigned length = done + (p - base);
+
+    if(console)
+        {
+        drain();
+        }
+    else if(p)
+        {
+        *p = 0;
+        }
+
+    return length;
+    }
+
+
+// pad and copy out a converted number, digits..end, with its sign if any
+static void put_number(Out &out, const char *digits, const char *end, bool negative, Spec spec)
+    {
+    unsigned length = end - digits + negative;
+    unsigned pad = spec.width > length ? spec.width - length : 0;
+
+    if(spec.flags & LEFT)
+        {
+        if(negative)
+            {
+            out.put('-');
+            }
+        out.write(digits, end - digits);
+        out.fill(' ', pad);
+        }
+    else if(spec.flags & ZERO)
+        {
+        if(negative)
+            {
+            out.put('-');
+            }
+        out.fill('0', pad);
+        out.write(digits, end - digits);
+        }
+    else
+        {
+        out.fill(' ', pad);
+        if(negative)
+            {
+            out.put('-');
+            }
+        out.write(digits, end - digits);
+        }
+    }
+
+
+// convert a value into the characters before end, returns where they start
+static char *convert32(char *end, uint32_t value, Kind kind)
+    {
+    const char *set = kind == UPPER_HEX ? upper_digits : lower_digits;
+
+    if(kind == HEX || kind == UPPER_HEX)
+        {
+        do *--end = set[value & 15]; while(value >>= 4);
+        }
+    else if(kind == OCTAL)
+        {
+        do *--end = '0' + (value & 7); while(value >>= 3);
+        }
+    else
+        {
+        do *--end = '0' + value % 10; while(value /= 10);
+        }
+
+    return end;
+    }
+
+static char *convert64(char *end, uint64_t value, Kind kind)
+    {
+    const char *set = kind == UPPER_HEX ? upper_digits : lower_digits;
+
+    if(kind == HEX || kind == UPPER_HEX)
+        {
+        do *--end = set[value & 15]; while(value >>= 4);
+        }
+    else if(kind == OCTAL)
+        {
+        do *--end = '0' + (value & 7); while(value >>= 3);
+        }
+    else
+        {
+        do *--end = '0' + value % 10; while(value /= 10);
+        }
+
+    return end;
+    }
+
+
+void put_unsigned(Out &out, uint32_t value, Spec spec)
+    {
+    char buf[12];
+    char *end = buf + sizeof(buf);
+
+    put_number(out, convert32(end, value, spec.kind), end, false, spec);
+    }
+
+void put_signed(Out &out, int32_t value, Spec spec)
+    {
+    char buf[12];
+    char *end = buf + sizeof(buf);
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+
+    put_number(out, convert32(end, magnitude, spec.kind), end, value < 0, spec);
+    }
+
+void put_unsigned(Out &out, uint64_t value, Spec spec)
+    {
+    char buf[23];
+    char *end = buf + sizeof(buf);
+
+    put_number(out, convert64(end, value, spec.kind), end, false, spec);
+    }
+
+void put_signed(Out &out, int64_t value, Spec spec)
+    {
+    char buf[23];
+    char *end = buf + sizeof(buf);
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : value;
+
+    put_number(out, convert64(end, magnitude, spec.kind), end, value < 0, spec);
+    }
+
+
+void put_char(Out &out, char c, Spec spec)
+    {
+    unsigned pad = spec.width > 1 ? spec.width - 1 : 0;
+
+    if(!(spec.flags & LEFT))
+        {
+        out.fill(' ', pad);
+        }
+    out.put(c);
+    if(spec.flags & LEFT)
+        {
+        out.fill(' ', pad);
+        }
+    }
+
+
+void put_string(Out &out, const char *s, Spec spec)
+    {
+    if(s == 0)
+        {
+        s = "(null)";
+        }
+
+    unsigned length = strlen(s);
+    unsigned pad = spec.width > length ? spec.width - length : 0;
+
+    if(!(spec.flags & LEFT))
+        {
+        out.fill(' ', pad);
+        }
+    out.write(s, length);
+    if(spec.flags & LEFT)
+        {
+        out.fill(' ', pad);
+        }
+    }
+
+} // namespace format
@@ -0,0 +1,52 @@
+// gomp_config.cpp
+//
+// Read libgomp settings from a file on a FatFs volume.
+// The file contains lines of the form
+//      NAME=value
+// using the names of the OpenMP environment variables, such as OMP_NUM_THREADS, OMP_THREAD_LIMIT,
+// and OMP_STACKSIZE, plus GOMP_STACK_BUDGET and GOMP_IDLE_TIME. Lines starting with '#' are comments.
+// See gomp_setenv in libgomp.cpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include "libgomp.hpp"
+#include "ff.h"
+#include "local.h"
+#include "Pool.hpp"
+
+extern Pool<FIL, NFILES> file_pool;         // file objects, a FIL is too big for a thread stack
+
+
+bool libgomp_config(const char *path)
+    {
+    char line[80];
+    int lineno = 0;
+    FIL *fil = file_pool.acquire();
+
+    if(fil == 0)
+        {
+        return false;
+        }
+
+    if(f_open(fil, path, FA_READ) != FR_OK)
+        {
+        file_pool.release(fil);
+        return false;
+        }
+
+    while(f_gets(line, sizeof(line), fil))
+        {
+        ++lineno;
+        if(!gomp_putenv(line))
+            {
+            printf("%s:%d: bad setting \"%s\"\n", path, lineno, line);
+            }
+        }
+
+    f_close(fil);
+    file_pool.release(fil);
+    return true;
+    }
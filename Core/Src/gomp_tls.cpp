@@ -0,0 +1,185 @@
+// gomp_tls.cpp
+//
+// Thread local storage for the bare metal threads, which is what "#pragma omp threadprivate"
+// and "thread_local" variables compile into.
+//
+// The linker script collects the TLS template sections (.tdata and .tbss) and reserves one TLS
+// block per slot of the thread table, sized at link time. Each omp_thread points to its block
+// with its "tls" member, which follows the Context, so r9 (the current thread) locates it.
+//
+// GCC reads the thread pointer with a call to __aeabi_read_tp, which here is two instructions,
+// a load relative to r9 and a return. It only clobbers r0, as the ABI requires. The variable is
+// then at a fixed offset from the thread pointer, filled in by the linker. The block has the ARM
+// "variant 1" layout: two words reserved for the TCB, then a copy of .tdata, then .tbss zeroed.
+//
+// If the toolchain was built with emulated TLS instead, GCC calls __emutls_get_address with a
+// control object for each variable. The first call for a variable gives it a slot in the emutls
+// area at the end of each block, and initializes it in every thread; after that the lookup is an
+// add. The emutls area is sized by _gomp_emutls_size in the linker script, which is 0 unless set.
+//
+// A thread's block is initialized when the thread is started, so a worker that is retired and
+// created again starts with fresh copies of the variables.
+//
+// The host port uses the native TLS of its one host thread, so every bare thread shares it there.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "cmsis.h"
+#include "libgomp.hpp"
+
+#if defined(__arm__)
+
+// symbols from the linker script
+extern char _tdata_start[], _tdata_end[];       // the template of the initialized variables, in flash
+extern char _tbss_start[], _tbss_end[];         // the zeroed variables, which take no space in flash
+extern char _tls_blocks_start[];                // the TLS blocks, one for each slot of the thread table
+extern char _tls_blocks_end[];
+extern char _tls_block_size[];                  // absolute symbols, the address is the value
+extern char _gomp_emutls_size[];
+
+#define GOMP_TLS_TCB 8                          // the part of the block that the ABI reserves for the runtime, the variables follow it
+#define GOMP_EMUTLS_OBJECTS 16                  // the number of distinct emutls variables
+
+
+// GCC's control object for an emulated TLS variable (see libgcc/emutls.c)
+struct __emutls_object
+    {
+    uintptr_t size;
+    uintptr_t align;
+    uintptr_t offset;                           // 0 until the variable is first used, then 1 + its offset in the emutls area
+    void *templ;                                // the initial value, or 0 if it is zero
+    };
+
+static __emutls_object *emutls_objects[GOMP_EMUTLS_OBJECTS];   // the variables that have been given a slot
+static unsigned emutls_count = 0;
+static uintptr_t emutls_used = 0;               // bytes of the emutls area in use
+
+
+// the start of the emutls area in a block
+static inline char *emutls_area(char *tp)
+    {
+    return tp + GOMP_TLS_TCB + (_tbss_end - _tdata_start);
+    }
+
+
+// set one emutls variable in one block to its initial value
+static void emutls_init(char *tp, __emutls_object *obj)
+    {
+    char *var = emutls_area(tp) + obj->offset - 1;
+
+    if(obj->templ)
+        {
+        memcpy(var, obj->templ, obj->size);
+        }
+    else
+        {
+        memset(var, 0, obj->size);
+        }
+    }
+
+
+extern "C"
+void *__emutls_get_address(__emutls_object *obj)
+    {
+    if(obj->offset == 0)                        // the first use of the variable by any thread
+        {
+        uintptr_t offset = (emutls_used + obj->align - 1) & -obj->align;
+
+        if(emutls_count >= GOMP_EMUTLS_OBJECTS || offset + obj->size > (uintptr_t)_gomp_emutls_size)
+            {
+            printf("emutls: no room for a %u byte variable, increase _gomp_emutls_size\n", (unsigned)obj->size);
+            return 0;
+            }
+
+        emutls_used = offset + obj->size;
+        emutls_objects[emutls_count++] = obj;
+        obj->offset = offset + 1;
+
+        for(auto &thread : omp_threads)
+            {
+            if(thread.tls)
+                {
+                emutls_init(thread.tls, obj);
+                }
+            }
+        }
+
+    return emutls_area(omp_this_thread()->tls) + obj->offset - 1;
+    }
+
+
+// called by GCC's startup code for emulated TLS variables in common, which have no template
+extern "C"
+void __emutls_register_common(__emutls_object *obj, uintptr_t size, uintptr_t align, void *templ)
+    {
+    if(obj->size < size)
+        {
+        obj->size = size;
+        obj->templ = 0;
+        }
+    if(obj->align < align)
+        {
+        obj->align = align;
+        }
+    if(templ && size == obj->size)
+        {
+        obj->templ = templ;
+        }
+    }
+
+
+// return the thread pointer of the running thread in r0, without touching any other register
+extern "C" __NAKED __USED
+void __aeabi_read_tp()
+    {
+    __asm__ __volatile__(
+"   ldr r0, [r9, %[tls]]                    \n"
+"   bx lr                                   \n"
+    :
+    : [tls]"i"(offsetof(omp_thread, tls)));
+    }
+
+
+// set up the TLS block of a thread that is being started
+void gomp_tls_init(omp_thread &thread)
+    {
+    uintptr_t size = (uintptr_t)_tls_block_size;
+
+    if(size == 0)                               // there are no TLS variables
+        {
+        thread.tls = 0;
+        return;
+        }
+
+    char *tp = _tls_blocks_start + thread.id * size;
+    char *data = tp + GOMP_TLS_TCB;
+
+    assert(tp + size <= _tls_blocks_end);       // else the linker script has fewer blocks than GOMP_MAX_NUM_THREADS
+
+    memset(tp, 0, GOMP_TLS_TCB);
+    memcpy(data, _tdata_start, _tdata_end - _tdata_start);
+    memset(data + (_tdata_end - _tdata_start), 0, _tbss_end - _tdata_end);
+
+    for(unsigned i=0; i<emutls_count; i++)
+        {
+        emutls_init(tp, emutls_objects[i]);
+        }
+
+    thread.tls = tp;
+    }
+
+#else
+
+void gomp_tls_init(omp_thread &thread)
+    {
+    thread.tls = 0;
+    }
+
+#endif
@@ -0,0 +1,151 @@
+// gomp_trace.cpp
+//
+// The default libgomp tool: a RAM ring buffer of compact, timestamped trace records.
+// See gomp_trace.hpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cyccnt.hpp"
+#include "libgomp.hpp"
+#include "gomp_trace.hpp"
+
+
+static_assert((GOMP_TRACE_RECORDS & (GOMP_TRACE_RECORDS-1)) == 0, "GOMP_TRACE_RECORDS must be a power of 2");
+
+static gomp_trace_rec trace_buf[GOMP_TRACE_RECORDS];   // the ring buffer
+static unsigned trace_next = 0;                         // free running count of records written
+
+#if GOMP_TRACE
+GOMP_TOOL_CALLBACK *gomp_tool_callback = gomp_trace_record;
+#endif
+
+
+static const char *event_names[GOMP_EV_NUM_EVENTS] =
+    {
+    "parallel begin",
+    "parallel end",
+    "implicit create",
+    "implicit begin",
+    "implicit end",
+    "task create",
+    "task begin",
+    "task end",
+    "barrier enter",
+    "barrier exit",
+    "critical acquire",
+    "critical release",
+    "cancel",
+    "task discard",
+    };
+
+
+// Record an event in the trace buffer.
+// There is no locking. The threads are non-preemptive and libgomp is never called from an ISR,
+// so a record can not be interrupted by another record.
+
+void gomp_trace_record(gomp_event event, unsigned arg)
+    {
+    gomp_trace_rec &rec = trace_buf[trace_next++ & (GOMP_TRACE_RECORDS-1)];
+
+    rec.time = Now();
+    rec.event = event;
+    rec.thread = omp_this_thread()->id;
+    rec.arg = arg;
+    }
+
+
+void gomp_trace_clear()
+    {
+    trace_next = 0;
+    }
+
+
+// Print the trace buffer, oldest record first, followed by the time each thread
+// spent in implicit and explicit tasks. The tool is turned off while printing,
+// so that the dump does not trace itself, or overwrite the records being printed.
+
+void gomp_trace_dump()
+    {
+#if GOMP_TRACE
+    GOMP_TOOL_CALLBACK *save = gomp_tool_callback;
+    gomp_tool_callback = 0;
+#endif
+
+    unsigned end = trace_next;
+    unsigned start = end > GOMP_TRACE_RECORDS ? end - GOMP_TRACE_RECORDS : 0;
+
+    uint32_t implicit_time[GOMP_MAX_NUM_THREADS] = {};     // cycles spent in implicit tasks, by thread
+    uint32_t explicit_time[GOMP_MAX_NUM_THREADS] = {};     // cycles spent in explicit tasks, by thread
+    unsigned explicit_count[GOMP_MAX_NUM_THREADS] = {};    // number of explicit tasks run, by thread
+    uint32_t begin[GOMP_MAX_NUM_THREADS] = {};             // time the current implicit task started
+    uint32_t tbegin[GOMP_MAX_NUM_THREADS] = {};            // time the outermost explicit task started
+    unsigned depth[GOMP_MAX_NUM_THREADS] = {};             // nesting of explicit tasks run undeferred
+
+    printf("%u records, %u lost\n", end-start, start);
+    printf("  index       cycles   +delta thr event             arg\n");
+
+    uint32_t t0 = trace_buf[start & (GOMP_TRACE_RECORDS-1)].time;
+    uint32_t last = t0;
+
+    for(unsigned i=start; i<end; i++)
+        {
+        gomp_trace_rec &rec = trace_buf[i & (GOMP_TRACE_RECORDS-1)];
+        unsigned thr = rec.thread < GOMP_MAX_NUM_THREADS ? rec.thread : 0;
+
+        printf("%7u %12lu %8lu %3u %-17s %u\n",
+            i,
+            (unsigned long)(rec.time - t0),
+            (unsigned long)(rec.time - last),
+            rec.thread,
+            rec.event < GOMP_EV_NUM_EVENTS ? event_names[rec.event] : "?",
+            rec.arg);
+
+        switch(rec.event)
+            {
+        case GOMP_EV_IMPLICIT_BEGIN:
+            begin[thr] = rec.time;
+            break;
+
+        case GOMP_EV_IMPLICIT_END:
+            implicit_time[thr] += rec.time - begin[thr];
+            break;
+
+        case GOMP_EV_TASK_BEGIN:
+            if(depth[thr]++ == 0)
+                {
+                tbegin[thr] = rec.time;
+                }
+            ++explicit_count[thr];
+            break;
+
+        case GOMP_EV_TASK_END:
+            if(depth[thr] > 0 && --depth[thr] == 0)
+                {
+                explicit_time[thr] += rec.time - tbegin[thr];
+                }
+            break;
+
+        default:
+            break;
+            }
+
+        last = rec.time;
+        }
+
+    printf("thr    implicit    explicit  tasks\n");
+    for(unsigned i=0; i<GOMP_MAX_NUM_THREADS; i++)
+        {
+        if(implicit_time[i] || explicit_count[i])
+            {
+            printf("%3u %11lu %11lu %6u\n", i, (unsigned long)implicit_time[i], (unsigned long)explicit_time[i], explicit_count[i]);
+            }
+        }
+
+#if GOMP_TRACE
+    gomp_tool_callback = save;
+#endif
+    }
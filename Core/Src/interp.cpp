@@ -11,6 +11,8 @@
 #include "serial.h"
 #include "ContextFIFO.hpp"
 #include "libgomp.hpp"
+#include "arena.hpp"
+#include "Pool.hpp"
 #include "ff.h"
 
 
@@ -20,9 +22,12 @@ char buf[INBUFLEN];
 bool waiting_for_command = false;
 
 FATFS FatFs[_VOLUMES];
-FIL fil;
+Pool<FIL, NFILES> file_pool;                                    // file objects, a FIL is too big for a thread stack
 uint32_t qbuf[512/4];
 
+static char command_arena_mem[CMDARENA] __ALIGNED(8);
+Arena command_arena(command_arena_mem, sizeof(command_arena_mem));     // what a command allocates is released when it returns
+
 // print help string, see usage below
 #define HELP(s) else if(buf[0]=='?' && puts(s) && 0){}
 
@@ -50,6 +55,11 @@ void interp()
         printf("FATFS mount OK on SPI-NOR\n");
         }
 
+    if(libgomp_config("0:/omp.cfg") || libgomp_config("1:/omp.cfg"))      // OpenMP settings, like the environment variables on a PC
+        {
+        printf("OpenMP settings loaded from omp.cfg\n");
+        }
+
 
     while(1)
         {
@@ -64,6 +74,7 @@ void interp()
         waiting_for_command = true;
         getline(buf, INBUFLEN);                                                 // get a command line
         waiting_for_command = false;
+        ArenaScope scope(command_arena);                                        // the command allocates from its arena
         p = buf;
         skip(&p);                                                               // skip command and following whitespace
 
@@ -177,6 +188,7 @@ void interp()
             }
 
         HELP(   "sum {<addr> <size> <block>}     summarize memory")
+        HELP(   "sum snap|diff                   snapshot RAM, show the blocks changed since")
         else if(buf[0]=='s' && buf[1]=='u' && buf[2]=='m')
             {
             extern void SumCommand(char *p);
@@ -204,6 +216,20 @@ void interp()
             OmpTestCommand(p);
             }
 
+        HELP(  "env {<name>=<value>|<path>|trim} OpenMP settings and threads")
+        else if(buf[0]=='e' && buf[1]=='n' && buf[2]=='v')
+            {
+            extern void EnvCommand(char *p);
+            EnvCommand(p);
+            }
+
+        HELP(  "trace {c|on|off}                dump/clear/enable the OpenMP trace")
+        else if(buf[0]=='t' && buf[1]=='r')
+            {
+            extern void TraceCommand(char *p);
+            TraceCommand(p);
+            }
+
         HELP(  "v <type> <num>                  set verbosity level")
         else if(buf[0]=='v' && (buf[1]==' ' || buf[1]==0))
             {
@@ -218,13 +244,50 @@ void interp()
             StackCommand(p);
             }
 
-        HELP(  "mem                             display free memory")
+        HELP(  "mem                             display heap use and fragmentation")
         else if(buf[0]=='m' && buf[1]=='e' && buf[2]=='m')
             {
             extern void mem();
             mem();
             }
 
+        HELP(  "heap {<n>|snap|diff|stress <n>} heap use by call site, leaks since a snapshot, ISR stress test")
+        else if(buf[0]=='h' && buf[1]=='e' && buf[2]=='a' && buf[3]=='p')
+            {
+            extern void HeapCommand(char *p);
+            HeapCommand(p);
+            }
+
+        HELP(  "mb                              memcpy, memmove, and memset cycles per byte")
+        else if(buf[0]=='m' && buf[1]=='b')
+            {
+            extern void MemBenchCommand(char *p);
+            MemBenchCommand(p);
+            }
+
+        HELP(  "con {block|oldest|new}          console output and input statistics, and what to do when output is full")
+        HELP(  "con t                           console characters per second, each write sent at once and coalesced")
+        HELP(  "con b [<kbytes>]                USB transmit bytes per second, filled in place and through _write")
+        else if(buf[0]=='c' && buf[1]=='o' && buf[2]=='n')
+            {
+            extern void ConsoleCommand(char *p);
+            ConsoleCommand(p);
+            }
+
+        HELP(  "log {c|on|off|t}                print/clear/enable the binary log, or time LOG")
+        else if(buf[0]=='l' && buf[1]=='o' && buf[2]=='g')
+            {
+            extern void LogCommand(char *p);
+            LogCommand(p);
+            }
+
+        HELP(  "bulk                            binary transfer mode for host/bulk, memory and files")
+        else if(buf[0]=='b' && buf[1]=='u' && buf[2]=='l' && buf[3]=='k')
+            {
+            extern void BulkCommand(char *p);
+            BulkCommand(p);
+            }
+
         HELP(  "q                               QSPI tests")
         else if(buf[0]=='q' && buf[1]==' ')
             {
@@ -14,14 +14,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
+#include <assert.h>
 #include <omp.h>
 #include "main.h"
 #include "FIFO.hpp"
+#include "Pool.hpp"
 #include "context.hpp"
 #include "ContextFIFO.hpp"
 #include "libgomp.hpp"
+#include "arena.hpp"
+#include "gomp_trace.hpp"
 #include "boundaries.h"
 #include "tim.h"
 
@@ -31,13 +37,13 @@
 
 static char TemperatureStack[512];                      // the stack for the interpreter thread
 static char InterpStack[3072];                          // the stack for the interpreter thread
-static char gomp_stacks[GOMP_MAX_NUM_THREADS-3][GOMP_STACK_SIZE] __ALIGNED(16);
 
-// An array of tasks.
-static task tasks[GOMP_NUM_TASKS];
+// The stacks of the threads that are created on demand are allocated from this arena.
+// The arena is carved up at runtime, so its space can go to a few big stacks or many small ones.
+static char gomp_stack_arena[GOMP_STACK_ARENA] __ALIGNED(16);
 
-// A pool of idle tasks
-static FIFO<task *, GOMP_NUM_TASKS> task_pool;
+// The tasks, and the idle ones among them
+static Pool<task, GOMP_NUM_TASKS> task_pool;
 
 // an array of omp_threads
 omp_thread omp_threads[GOMP_MAX_NUM_THREADS];
@@ -48,12 +54,72 @@ static FIFO<omp_thread *, GOMP_MAX_NUM_THREADS> thread_pool;
 
 int dyn_var = 0;
 
+// whether cancellation is enabled (OMP_CANCELLATION). There is no environment on bare metal, so it defaults to on.
+static int gomp_cancel_var = 1;
+
+// the "which" argument of GOMP_cancel and GOMP_cancellation_point, from GCC's gomp-constants.h
+#define GOMP_CANCEL_PARALLEL    1
+#define GOMP_CANCEL_LOOP        2
+#define GOMP_CANCEL_FOR         GOMP_CANCEL_LOOP
+#define GOMP_CANCEL_DO          GOMP_CANCEL_LOOP
+#define GOMP_CANCEL_SECTIONS    4
+#define GOMP_CANCEL_TASKGROUP   8
+
 // the default number of parallel threads
 static int gomp_nthreads_var = OMP_NUM_THREADS;
 
+// the settings of the runtime, which can be changed by gomp_setenv
+static int gomp_nthreads_default = OMP_NUM_THREADS;                         // OMP_NUM_THREADS, gomp_nthreads_var is reset to this between commands
+static int gomp_thread_limit_var = GOMP_MAX_NUM_THREADS-GOMP_FIRST_WORKER+1;    // OMP_THREAD_LIMIT, max team size, the master plus every created thread
+static unsigned gomp_stacksize_var = GOMP_STACK_SIZE;                       // OMP_STACKSIZE, the stack size of newly created threads
+static unsigned gomp_stack_budget = GOMP_STACK_ARENA;                       // GOMP_STACK_BUDGET, how much of the arena may be used for stacks
+static unsigned gomp_idle_time = GOMP_IDLE_TIME;                            // GOMP_IDLE_TIME, msec before an idle created thread is retired
+static int gomp_task_cutoff_var = 1;                                        // GOMP_TASK_CUTOFF, run tasks immediately when queuing them would not help
+
 int omp_verbose = OMP_VERBOSE_DEFAULT;
 #define DPRINT(level) if(omp_verbose>=level)printf
 
+
+// add an explicit task to the team's queue, and take one from it
+static inline void gomp_queue_task(omp_thread &team, task *task)
+    {
+    team.task_list.add(task);
+    ++team.task_queued;
+    }
+
+static inline bool gomp_dequeue_task(omp_thread &team, task *&task)
+    {
+    if(!team.task_list.take(task))
+        {
+        return false;
+        }
+
+    --team.task_queued;
+    return true;
+    }
+
+
+// test whether a task in the given taskgroup should not be run, because its team
+// or its taskgroup or any enclosing taskgroup has been cancelled
+
+static inline bool gomp_cancelled(omp_thread &team, taskgroup *group)
+    {
+    if(team.cancelled)
+        {
+        return true;
+        }
+
+    for(; group; group = group->prev)
+        {
+        if(group->cancelled)
+            {
+            return true;
+            }
+        }
+
+    return false;
+    }
+
 // either run the implicit task, or try to get one from the pool of ready tasks
 // TODO -- each team needs its own private ready task pool
 
@@ -66,31 +132,118 @@ void run_implicit(task *task)
     char *data;
 
     DPRINT(2)("start implicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+    GOMP_TOOL(GOMP_EV_IMPLICIT_BEGIN, task_pool.index(task));
     fn = task->fn;                      // run the assigned implicit task
     data = task->data;
     fn(data);
+    GOMP_TOOL(GOMP_EV_IMPLICIT_END, task_pool.index(task));
     DPRINT(2)("end   implicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
-    task_pool.add(task);                // return the task to the pool
+    task_pool.release(task);            // return the task to the pool
     team.task_count--;
     thread.task = 0;                    // forget the completed task
     }
 
+// Run chunks of a taskloop until there are none left, or the taskgroup is cancelled.
+// Each chunk runs on a private copy of the loop's data, with the chunk's bounds
+// in the first two words, as GCC expects.
+
+static void gomp_taskloop_run(taskloop &loop)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    while(loop.next < loop.chunks && !gomp_cancelled(team, thread.taskgroup))
+        {
+        unsigned k = loop.next++;                                           // claim a chunk
+        uint64_t first = k*loop.base + (k < loop.extra ? k : loop.extra);   // the chunk's first iteration number
+        uint64_t count = loop.base + (k < loop.extra);                      // and number of iterations
+        uint64_t start = loop.start + first*loop.step;
+        uint64_t end = start + count*loop.step;
+
+        char buf[loop.arg_size + loop.arg_align - 1];
+        char *arg = (char *)((uintptr_t)&buf[loop.arg_align-1] & ~(uintptr_t)(loop.arg_align-1));
+
+        if(loop.cpyfn)
+            {
+            loop.cpyfn(arg, loop.data);
+            }
+        else
+            {
+            memcpy(arg, loop.data, loop.arg_size);
+            }
+
+        if(loop.ull)
+            {
+            ((unsigned long long *)arg)[0] = start;
+            ((unsigned long long *)arg)[1] = end;
+            }
+        else
+            {
+            ((long *)arg)[0] = start;
+            ((long *)arg)[1] = end;
+            }
+
+        loop.fn(arg);
+        }
+    }
+
+
 void run_explicit(task *task)
     {
     omp_thread &thread = *omp_this_thread();
     omp_thread &team = *omp_this_team();
 
     TASKFN *fn;
-    char *data;
+    char *data = task->data;
+    taskgroup *group = task->taskgroup;
 
-    DPRINT(2)("start explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
-    fn = task->fn;                      // run the explicit task
-    data = task->data;
-    fn(data);
-    DPRINT(2)("end   explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
-    data = data - data[-1];             // undo the arg alignment to recover the address returned from malloc
-    free(data);                         // free the data
-    task_pool.add(task);                // free the task
+    if(gomp_cancelled(team, group))     // if the task was cancelled while it was queued, discard it
+        {
+        DPRINT(2)("discard explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+        GOMP_TOOL(GOMP_EV_TASK_DISCARD, task_pool.index(task));
+        }
+    else
+        {
+        taskgroup *save = thread.taskgroup;
+        bool save_final = thread.in_final;
+        thread.taskgroup = group;       // the task runs in the taskgroup it was created in
+        thread.in_final = false;        // a queued task is never final, even if it is run by a thread that is in one
+
+        DPRINT(2)("start explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+        GOMP_TOOL(GOMP_EV_TASK_BEGIN, task_pool.index(task));
+        if(task->loop)
+            {
+            gomp_taskloop_run(*task->loop);    // run chunks of a taskloop
+            }
+        else
+            {
+            fn = task->fn;              // run the explicit task
+            fn(data);
+            }
+        GOMP_TOOL(GOMP_EV_TASK_END, task_pool.index(task));
+        DPRINT(2)("end   explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+
+        thread.taskgroup = save;
+        thread.in_final = save_final;
+        }
+
+    if(task->loop)
+        {
+        if(--task->loop->refs == 0 && task->loop->heap)
+            {
+            arena_free(task->loop, task->arena);    // the last task of a nogroup taskloop frees it
+            }
+        }
+    else
+        {
+        data = data - data[-1];         // undo the arg alignment to recover the address returned from malloc
+        arena_free(data, task->arena);  // free the data, into the creator's arena, which need not be this thread's
+        }
+    task_pool.release(task);            // free the task
+    if(group)
+        {
+        group->count--;                 // the taskgroup has one less task to wait for
+        }
     team.task_count--;
     }
 
@@ -108,6 +261,11 @@ static uint32_t gomp_worker(uintptr_t id)
         Context::suspend();
         thread.twaiting = false;
 
+        if(thread.retire)                       // returning terminates the thread, and the next pending thread runs
+            {
+            break;
+            }
+
         task *task;
 
         if((task=thread.task) != 0)
@@ -117,7 +275,7 @@ static uint32_t gomp_worker(uintptr_t id)
         else
             {
             omp_thread &team = *omp_this_team();
-            if(team.task_list.take(task))         // if there are any explicit tasks waiting for a context
+            if(gomp_dequeue_task(team, task))  // if there are any explicit tasks waiting for a context
                 {
                 run_explicit(task);
                 }
@@ -152,6 +310,14 @@ void gomp_poll_threads()
                 }
             }
         }
+
+    static uint32_t last_trim = 0;                  // look for idle threads to retire every 10 msec
+    uint32_t now = __HAL_TIM_GET_COUNTER(&htim2);
+    if(now - last_trim > 10000)
+        {
+        last_trim = now;
+        gomp_trim_threads(false);
+        }
     }
 
 
@@ -173,7 +339,165 @@ const char *thread_names[] =
 // clean up and re-initialize between tests
 void libgomp_reinit()
     {
-    gomp_nthreads_var = OMP_NUM_THREADS;
+    gomp_nthreads_var = gomp_nthreads_default;
+    }
+
+
+///////////////////////////////
+// Creating threads on demand //
+///////////////////////////////
+
+// Allocate a stack from the arena.
+// A stack can start at the bottom of the arena, or just above any existing stack.
+// The lowest of those places where the stack does not overlap any existing stack is chosen.
+// Returns 0 if there is no room.
+
+static char *gomp_stack_alloc(unsigned size)
+    {
+    char *arena_end = &gomp_stack_arena[GOMP_STACK_ARENA];
+    char *best = 0;
+
+    for(int i=GOMP_FIRST_WORKER-1; i<GOMP_MAX_NUM_THREADS; i++)
+        {
+        char *low = i<GOMP_FIRST_WORKER ? &gomp_stack_arena[0] : omp_threads[i].stack_high;    // the candidate place
+
+        if(low == 0 || low + size > arena_end || (best && low >= best))
+            {
+            continue;
+            }
+
+        bool fits = true;
+        for(int j=GOMP_FIRST_WORKER; j<GOMP_MAX_NUM_THREADS; j++)
+            {
+            omp_thread &other = omp_threads[j];
+            if(other.stack_low && other.stack_low < low + size && low < other.stack_high)
+                {
+                fits = false;
+                break;
+                }
+            }
+
+        if(fits)
+            {
+            best = low;
+            }
+        }
+
+    return best;
+    }
+
+
+// Create a new thread, if there is a free slot in the thread table and the stack budget allows.
+// The new thread runs until it suspends itself waiting for work, then the caller continues.
+// Returns 0 if a thread can't be created.
+
+static omp_thread *gomp_new_thread()
+    {
+    omp_thread *thread = 0;
+    unsigned used = 0;
+
+    for(int i=GOMP_FIRST_WORKER; i<GOMP_MAX_NUM_THREADS; i++)
+        {
+        if(omp_threads[i].stack_low)
+            {
+            used += omp_threads[i].stack_high - omp_threads[i].stack_low;
+            }
+        else if(thread == 0)
+            {
+            thread = &omp_threads[i];
+            }
+        }
+
+    if(thread == 0 || used + gomp_stacksize_var > gomp_stack_budget)
+        {
+        return 0;
+        }
+
+    char *stack = gomp_stack_alloc(gomp_stacksize_var);
+    if(stack == 0)
+        {
+        return 0;
+        }
+
+    thread->team = 0;
+    thread->team_id = 0;
+    thread->task = 0;
+    thread->retire = false;
+
+    DPRINT(1)("create thread %d, stack %p, %u bytes\n", thread->id, stack, gomp_stacksize_var);
+    gomp_tls_init(*thread);
+    libgomp_start_thread(*thread, gomp_worker, stack, gomp_stacksize_var, thread->id);
+
+    return thread;
+    }
+
+
+// Retire idle threads that were created on demand, and return their stacks to the arena.
+// If "all" is false only threads that have been idle for GOMP_IDLE_TIME are retired,
+// otherwise every idle created thread is.
+// The oldest idle thread is at the head of the thread pool. Threads that are kept are put back at the tail.
+
+void gomp_trim_threads(bool all)
+    {
+    uint32_t now = __HAL_TIM_GET_COUNTER(&htim2);
+    unsigned n = 0;
+    omp_thread *thread;
+
+    if(!all && gomp_idle_time == 0)
+        {
+        return;
+        }
+
+    for(int i=0; i<GOMP_MAX_NUM_THREADS; i++)       // count the idle threads, so each is looked at only once
+        {
+        n += omp_threads[i].idle_since != 0;
+        }
+
+    while(n-- && thread_pool.take(thread))
+        {
+        if(thread->id >= GOMP_FIRST_WORKER
+        && thread->twaiting                         // it is not busy helping another team with its tasks
+        && (all || now - thread->idle_since > gomp_idle_time*1000))
+            {
+            DPRINT(1)("retire thread %d\n", thread->id);
+            thread->idle_since = 0;
+            thread->retire = true;
+            thread->context.resume();               // the thread terminates, and we continue here
+            thread->stack_low = 0;                  // free the slot and the stack
+            thread->stack_high = 0;
+            }
+        else
+            {
+            thread_pool.add(thread);
+            if(!all && thread->id >= GOMP_FIRST_WORKER)
+                {
+                break;                              // the rest have been idle for less time
+                }
+            }
+        }
+    }
+
+
+// take a thread from the thread pool, or create one
+static omp_thread *gomp_get_thread()
+    {
+    omp_thread *thread;
+
+    if(thread_pool.take(thread))
+        {
+        thread->idle_since = 0;
+        return thread;
+        }
+
+    return gomp_new_thread();
+    }
+
+
+// return a thread to the thread pool
+static void gomp_put_thread(omp_thread *thread)
+    {
+    thread->idle_since = __HAL_TIM_GET_COUNTER(&htim2) | 1;     // never 0, which means "not idle"
+    thread_pool.add(thread);
     }
 
 // Powerup initialization of libgomp.
@@ -181,9 +505,6 @@ void libgomp_reinit()
 
 void libgomp_init()
     {
-    // put all tasks into the idle task pool
-    for(auto &task: tasks)task_pool.add(&task);
-
     // init the omp_threads
     // put all threads except 0 (background) into the idle thread pool and start each one
     for(unsigned i=0; i<GOMP_MAX_NUM_THREADS; i++)
@@ -195,14 +516,14 @@ void libgomp_init()
             omp_threads[i].name = thread_names[i];
             }
 
+        if(i < GOMP_FIRST_WORKER)
+            {
+            gomp_tls_init(omp_threads[i]);                          // the created threads get theirs when they are started
+            }
+
         if(i == 0)
             {
-            __asm__ __volatile__(
-            "   mov r9, %[bgctx]"           // init the thread pointer to the background thread
-            :
-            : [bgctx]"r"(&omp_threads[0])
-            :
-            );
+            Context::pointer(&omp_threads[0].context);              // init the thread pointer to the background thread
 
             omp_threads[i].team = (omp_thread *)0xFFFFFFFF;         // background's team pointer must never be used, since background cannot be a member of a team
             omp_threads[i].stack_low = (char *)&_stack_start;
@@ -211,18 +532,14 @@ void libgomp_init()
         else if(i == 1)
             {
             libgomp_start_thread(omp_threads[i], gomp_worker, TemperatureStack, i);
-            thread_pool.add(&omp_threads[i]);
+            gomp_put_thread(&omp_threads[i]);
             }
         else if(i == 2)
             {
             libgomp_start_thread(omp_threads[i], gomp_worker, InterpStack, i);
-            thread_pool.add(&omp_threads[i]);
-            }
-        else
-            {
-            libgomp_start_thread(omp_threads[i], gomp_worker, gomp_stacks[i-3], i);
-            thread_pool.add(&omp_threads[i]);
+            gomp_put_thread(&omp_threads[i]);
             }
+                                                                    // the rest are created when they are needed
         }
 
     libgomp_reinit();
@@ -238,29 +555,49 @@ void GOMP_parallel(
     unsigned flags __attribute__((__unused__)))     // flags (ignored for now)
     {
     omp_thread &team = *omp_this_thread();
+    taskgroup *save_taskgroup = team.taskgroup;
+    bool save_final = team.in_final;
+    Arena *arena = team.arena;                      // the master's arena is shared by the team for the region
+    ArenaMark mark = {};
+    bool scoped = arena && arena->shared++ == 0;    // only the outermost region sharing an arena may release what was allocated in it
+
+    if(scoped)
+        {
+        mark = arena->enter();
+        }
 
     if(num_threads == 0)
         {
         num_threads = gomp_nthreads_var;
         }
 
+    if(num_threads > (unsigned)gomp_thread_limit_var)
+        {
+        num_threads = gomp_thread_limit_var;
+        }
+
+    GOMP_TOOL(GOMP_EV_PARALLEL_BEGIN, num_threads);
+
     team.mutex = false;
     team.tsingle = 0;
     team.sections_count = 0;
     team.sections = 0;
     team.section= 0;
     team.copyprivate = 0;
+    team.cancelled = false;
+    team.ws_cancelled = false;
     team.team_count = 0;
     team.task_count = 0;
     team.members.init();
     team.task_list.init();
+    team.task_queued = 0;
+    team.loop = workshare();
 
     // create a team, give each member a task, and start it
     for(unsigned i=0; i<num_threads; i++)
         {
         omp_thread *thread = 0;
         task *task = 0;
-        bool ok;
 
         if(i == 0)
             {
@@ -268,13 +605,14 @@ void GOMP_parallel(
             }
         else
             {
-            ok = thread_pool.take(thread);
-            if(!ok)
+            thread = gomp_get_thread();
+            if(thread == 0)                 // the team is smaller than requested, which OpenMP allows
                 {
-                printf("thread_pool is empty\n");
+                DPRINT(1)("no thread for team member %u\n", i);
                 break;
                 }
             thread->team = &team;
+            thread->arena = arena;
             team.members.add(thread);
             }
 
@@ -282,9 +620,13 @@ void GOMP_parallel(
         thread->arrived = false;
         thread->mwaiting = false;
         thread->single = 0;
+        thread->taskgroup = 0;
+        thread->in_final = false;
+        thread->loop_gen = 0;
+        thread->owaiting = false;
 
-        ok = task_pool.take(task);
-        if(!ok)
+        task = task_pool.acquire();
+        if(task == 0)
             {
             DPRINT(2)("task_pool is empty\n");
             break;
@@ -296,6 +638,7 @@ void GOMP_parallel(
         team.task_count++;
         thread->task = task;                     // this field becoming non-zero kicks off the implicit task
 
+        GOMP_TOOL(GOMP_EV_IMPLICIT_CREATE, task_pool.index(task));
         DPRINT(2)("create implicit task %8p, id = %d(%d)\n", task, i, thread->id);
         }
 
@@ -307,7 +650,7 @@ void GOMP_parallel(
     while(team.task_count)
         {
         task *task;
-        if(team.task_list.take(task))         // if there are any explicit tasks waiting for a context
+        if(gomp_dequeue_task(team, task))  // if there are any explicit tasks waiting for a context
             {
             run_explicit(task);
             }
@@ -319,8 +662,23 @@ void GOMP_parallel(
         {
         omp_thread *thread;
         if(!team.members.take(thread))break;
-        thread_pool.add(thread);
+        thread->arena = 0;
+        gomp_put_thread(thread);
+        }
+
+    if(arena)
+        {
+        arena->shared--;
+        if(scoped)
+            {
+            arena->leave(mark);                     // every task of the region has completed, so its data can go at once
+            }
         }
+
+    team.taskgroup = save_taskgroup;
+    team.in_final = save_final;
+
+    GOMP_TOOL(GOMP_EV_PARALLEL_END, team.team_count);
     }
 
 
@@ -332,6 +690,8 @@ void GOMP_barrier()
     omp_thread *member;
     omp_thread **pnext;
 
+    GOMP_TOOL(GOMP_EV_BARRIER_ENTER, thread.team_id);
+
     thread.arrived = true;                      // signal that this thread has reached the barrier
 
     // walk the list of all team members. If any member has not arrived yet, suspend myself.
@@ -342,6 +702,7 @@ void GOMP_barrier()
         if(member->arrived == false)
             {                                   // get here if any team member has not yet arrived
             thread.context.suspend();           // suspend this thread until all other threads have arrived
+            GOMP_TOOL(GOMP_EV_BARRIER_EXIT, thread.team_id);
             return;                             // when resumed, some other thread has done all the barrier cleanup work, so just keep going
             }
         member = *pnext;
@@ -350,14 +711,26 @@ void GOMP_barrier()
 
     // Only get here if all other team members have arrived, which mean this thread
     // is the last to arrive, and all other team members are suspended.
-    // When the last team member arrives it walks the list again, clears all the "arrived" flags,
-    // and resumes all the other members.
+    // When the last team member arrives it walks the list again and clears all the "arrived" flags,
+    // then walks it once more and resumes all the other members. All the flags must be cleared before
+    // any member is resumed, otherwise a resumed member could reach the next barrier, see a stale flag,
+    // and try to resume a thread that is not suspended.
 
     member = &team;
     pnext = &team.members.head;
     while(member)
         {
         member->arrived = false;
+        member = *pnext;
+        pnext = &member->next;
+        }
+
+    team.ws_cancelled = false;                  // a cancelled worksharing construct ends at its barrier
+
+    member = &team;
+    pnext = &team.members.head;
+    while(member)
+        {
         if(member != &thread)                   // don't try to resume myself
             {
             member->context.resume();           // resume any other thread in this team
@@ -365,6 +738,28 @@ void GOMP_barrier()
         member = *pnext;
         pnext = &member->next;
         }
+
+    GOMP_TOOL(GOMP_EV_BARRIER_EXIT, thread.team_id);
+    }
+
+
+// A barrier in a construct that can be cancelled.
+// Returns true if the parallel region has been cancelled, in which case the caller
+// skips to the end of the region.
+
+extern "C"
+bool GOMP_barrier_cancel()
+    {
+    omp_thread &team = *omp_this_team();
+
+    if(team.cancelled)                          // don't wait for members that have already left the region
+        {
+        return true;
+        }
+
+    GOMP_barrier();                             // GOMP_cancel releases the barrier if the region is cancelled while waiting
+
+    return team.cancelled;
     }
 
 
@@ -373,15 +768,18 @@ void GOMP_critical_start()
     {
     omp_thread &thread = *omp_this_thread();
     omp_thread &team = *omp_this_team();
+    unsigned waits = 0;
 
     while(team.mutex == true)
         {
         thread.mwaiting = true;
         thread.context.suspend();      // suspend this thread until it can grab the mutex
         thread.mwaiting = false;
+        ++waits;
         }
 
     team.mutex = true;
+    GOMP_TOOL(GOMP_EV_CRITICAL_ACQUIRE, waits);
     }
 
 extern "C"
@@ -391,6 +789,7 @@ void GOMP_critical_end()
     omp_thread *member = &team;
     omp_thread **pnext = &team.members.head;
 
+    GOMP_TOOL(GOMP_EV_CRITICAL_RELEASE, omp_this_thread()->team_id);
     team.mutex = false;
 
     while(member)                               // resume a waiting team member
@@ -521,208 +920,1582 @@ void GOMP_sections_end()                // each thread runs this once when all t
     GOMP_barrier();                     // hold everyone here until all have arrived
     }
 
-
-#if 0
-
-/////////////
-// LOCKING //
-/////////////
-
 extern "C"
-void omp_init_lock(omp_lock_t *lock)
+bool GOMP_sections_end_cancel()         // the end of sections in a construct that can be cancelled
     {
-    *lock = 0;
-    }
+    omp_thread &team = *omp_this_team();
+    int num = omp_get_num_threads();
 
-extern "C"
-void omp_set_lock(omp_lock_t *lock)
-    {
-    while(*lock)
+    if(team.sections_count == num)
         {
-        yield();
+        team.sections_count = 0;
         }
 
-    *lock = 1;
+    return GOMP_barrier_cancel();
     }
 
-extern "C"
-void omp_unset_lock(omp_lock_t *lock)
+
+///////////
+// Loops //
+///////////
+
+// GCC inlines a "for" with a static schedule. The runtime schedules the others: loops with an
+// ordered clause, doacross loops (ordered(n) with depend(sink) and depend(source)), and the
+// dynamic, guided, and runtime schedules. The runtime schedule is dynamic with a chunk size of 1.
+//
+// The iterations are handed out in chunks, each with a sequence number, and the team's ticket
+// says which chunk may run its ordered region. A thread that reaches its ordered region before
+// its turn suspends itself rather than spinning. The thread that holds the ticket passes it on
+// when its chunk ends, and resumes the thread that holds the next chunk if it is waiting. A chunk
+// holds the ticket until it ends, whether or not its iterations ran the ordered region, so the
+// ordered regions of a chunk of several iterations run together.
+//
+// A doacross wait suspends the thread until the iteration it depends on has posted, or its chunk
+// has ended. Each post resumes the waiting threads whose dependence it satisfies.
+
+#define GOMP_SCHED_STATIC   1
+#define GOMP_SCHED_DYNAMIC  2
+#define GOMP_SCHED_GUIDED   3
+
+
+// the number of iterations of a loop with a long loop variable
+static uint64_t gomp_loop_count(long start, long end, long incr)
     {
-    *lock = 0;
+    if(incr > 0)
+        {
+        return end > start ? ((int64_t)end - start + incr - 1) / incr : 0;
+        }
+    else
+        {
+        return start > end ? ((int64_t)start - end - incr - 1) / -(int64_t)incr : 0;
+        }
     }
 
-extern "C"
-int omp_test_lock(omp_lock_t *lock)
+// the number of iterations of a loop with an unsigned long long loop variable
+static uint64_t gomp_loop_count_ull(bool up, uint64_t start, uint64_t end, uint64_t incr)
     {
-    if(*lock)
+    if(up)
         {
-        return 0;
+        return end > start ? (end - start + incr - 1) / incr : 0;
+        }
+    else
+        {
+        return start > end ? (start - end - incr - 1) / -incr : 0;
         }
-
-    *lock = 1;
-    return 1;
     }
 
-extern "C"
-void omp_destroy_lock(omp_lock_t *lock)
+
+// step through the members of a team, starting with the master
+static inline omp_thread *gomp_next_member(omp_thread &team, omp_thread *member)
+    {
+    return member == &team ? team.members.head : member->next;
+    }
+
+
+// test whether the doacross iteration a member is waiting for has been done: it has been posted, or its chunk has ended
+// In a nest deeper than GOMP_DOACROSS_DEPTH the posts are not tracked, and the member waits for the chunk to end,
+// unless it is the member's own chunk, whose earlier iterations it has already run.
+
+static bool gomp_doacross_done(omp_thread &team, omp_thread &member)
+    {
+    uint64_t outer = member.wait_outer;
+    workshare &loop = team.loop;
+    omp_thread *owner = 0;
+
+    if(loop.sched == GOMP_SCHED_STATIC)         // the member that runs the iteration can be calculated
+        {
+        uint64_t t = team.team_count;
+        int id;
+
+        if(loop.chunk == 0)
+            {
+            uint64_t q = loop.n / t;
+            uint64_t r = loop.n % t;
+            id = outer < r*(q+1) ? outer/(q+1) : r + (outer - r*(q+1))/q;
+            }
+        else
+            {
+            id = (outer / loop.chunk) % t;
+            }
+
+        for(owner = &team; owner && owner->team_id != id; owner = gomp_next_member(team, owner));
+
+        if(owner == 0 || (int)(owner->loop_gen - loop.ready) < 0)
+            {
+            return false;                       // it has not started the loop
+            }
+
+        if(outer < owner->chunk_start)
+            {
+            return true;                        // it has gone past the iteration
+            }
+        }
+    else                                        // the chunks are handed out in order
+        {
+        if(outer >= loop.next)
+            {
+            return false;                       // the iteration has not been handed out
+            }
+
+        for(owner = &team; owner; owner = gomp_next_member(team, owner))
+            {
+            if((int)(owner->loop_gen - loop.ready) >= 0 && owner->chunk_start <= outer && outer < owner->chunk_end)
+                {
+                break;
+                }
+            }
+
+        if(owner == 0)
+            {
+            return true;                        // the chunk has ended
+            }
+        }
+
+    if(owner->chunk_start > outer || outer >= owner->chunk_end)
+        {
+        return false;                           // the owner has not reached the iteration's chunk
+        }
+
+    return loop.ncounts > GOMP_DOACROSS_DEPTH ? owner == &member : owner->posted > member.wait_flat;
+    }
+
+
+// test whether a member that is waiting in the team's loop can continue
+static bool gomp_loop_can_run(omp_thread &team, omp_thread &member)
+    {
+    if(team.cancelled || team.ws_cancelled)
+        {
+        return true;
+        }
+
+    if(team.loop.ncounts)
+        {
+        return gomp_doacross_done(team, member);
+        }
+
+    return team.loop.ticket == member.chunk_seq;
+    }
+
+
+// suspend the thread until it can continue
+static void gomp_loop_wait(omp_thread &thread, omp_thread &team)
+    {
+    while(!gomp_loop_can_run(team, thread))
+        {
+        thread.owaiting = true;
+        thread.context.suspend();               // until gomp_loop_wake decides it can continue
+        }
+    }
+
+
+// resume the members of the team that are waiting, and can now continue
+static void gomp_loop_wake(omp_thread &team)
+    {
+    for(omp_thread *member = &team; member; member = gomp_next_member(team, member))
+        {
+        if(member->owaiting && gomp_loop_can_run(team, *member))
+            {
+            member->owaiting = false;
+            member->context.resume();
+            }
+        }
+    }
+
+
+// set up the team's loop, when the first member arrives, and this member's place in it
+
+static void gomp_loop_init(int sched, uint64_t n, uint64_t chunk, uint64_t start, uint64_t incr,
+                           bool ull, bool ordered, unsigned ncounts, const void *counts)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    workshare &loop = team.loop;
+
+    if(thread.loop_gen++ == loop.gen)           // the first member to arrive sets up the loop
+        {
+        loop.gen++;
+
+        while(loop.users)                       // some members may not have ended the previous loop, if it was nowait
+            {
+            yield();
+            }
+
+        loop.sched = sched;
+        loop.ordered = ordered;
+        loop.ull = ull;
+        loop.n = n;
+        loop.chunk = (chunk == 0 && sched != GOMP_SCHED_STATIC) ? 1 : chunk;
+        loop.start = start;
+        loop.incr = incr;
+        loop.next = 0;
+        loop.next_chunk = 0;
+        loop.ticket = 0;
+        loop.ncounts = ncounts;
+        loop.inner = 1;
+        for(unsigned i=0; i<ncounts && i<GOMP_DOACROSS_DEPTH; i++)   // GCC reuses the counts array for the iteration vectors, so copy it
+            {
+            loop.counts[i] = ull ? ((unsigned long long *)counts)[i] : (uint64_t)((long *)counts)[i];
+            loop.inner *= i ? loop.counts[i] : 1;
+            }
+        loop.users = team.team_count;
+        loop.ready = thread.loop_gen;
+        }
+    else
+        {
+        while(loop.ready != thread.loop_gen)    // wait for the first member to set it up
+            {
+            yield();
+            }
+        }
+
+    thread.chunks = 0;
+    thread.chunk_start = 0;
+    thread.chunk_end = 0;
+    thread.posted = 0;
+    }
+
+
+// end the thread's current chunk
+// In an ordered loop it waits for the chunk's turn, since its ordered region may not have run, and passes the ticket on.
+
+static void gomp_chunk_end(omp_thread &thread, omp_thread &team)
+    {
+    workshare &loop = team.loop;
+
+    if(thread.chunk_start >= thread.chunk_end)  // it has no chunk
+        {
+        return;
+        }
+
+    if(loop.ordered)
+        {
+        gomp_loop_wait(thread, team);
+        loop.ticket++;
+        }
+
+    thread.chunk_start = thread.chunk_end;     // past the chunk, which a doacross wait takes to mean its iterations are done
+
+    if(loop.ordered || loop.ncounts)
+        {
+        gomp_loop_wake(team);
+        }
+    }
+
+
+// end the thread's current chunk and give it the next one
+// returns false if there are no more iterations for it, or the loop has been cancelled
+
+static bool gomp_chunk_next(omp_thread &thread, omp_thread &team, uint64_t &first, uint64_t &last)
+    {
+    workshare &loop = team.loop;
+    uint64_t t = team.team_count;
+    uint64_t seq;
+
+    gomp_chunk_end(thread, team);
+
+    thread.chunk_start = loop.n;                // past every iteration, until it gets another chunk
+    thread.chunk_end = loop.n;
+
+    if(team.cancelled || team.ws_cancelled)
+        {
+        return false;
+        }
+
+    if(loop.sched == GOMP_SCHED_STATIC && loop.chunk == 0)     // one block for each member
+        {
+        uint64_t q = loop.n / t;
+        uint64_t r = loop.n % t;
+        uint64_t id = thread.team_id;
+
+        if(thread.chunks)
+            {
+            return false;
+            }
+
+        first = id*q + (id < r ? id : r);
+        last = first + q + (id < r);
+        seq = id;
+        }
+    else if(loop.sched == GOMP_SCHED_STATIC)   // chunks dealt round robin
+        {
+        seq = thread.team_id + thread.chunks * t;
+        first = seq * loop.chunk;
+        if(first >= loop.n)
+            {
+            return false;
+            }
+        last = loop.n - first > loop.chunk ? first + loop.chunk : loop.n;
+        }
+    else                                        // chunks taken in turn, guided chunks shrink as the loop runs down
+        {
+        uint64_t size = loop.chunk;
+
+        if(loop.sched == GOMP_SCHED_GUIDED && (loop.n - loop.next + t - 1) / t > size)
+            {
+            size = (loop.n - loop.next + t - 1) / t;
+            }
+
+        first = loop.next;
+        if(first >= loop.n)
+            {
+            return false;
+            }
+        last = loop.n - first > size ? first + size : loop.n;
+        loop.next = last;
+        seq = loop.next_chunk++;
+        }
+
+    if(first >= last)
+        {
+        return false;
+        }
+
+    thread.chunks++;
+    thread.chunk_seq = seq;
+    thread.chunk_start = first;
+    thread.chunk_end = last;
+    thread.posted = first * loop.inner;         // no iteration of the chunk has been posted
+
+    return true;
+    }
+
+
+// get the next chunk of a loop, as values of its loop variable
+
+static bool gomp_loop_next(long *istart, long *iend)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    workshare &loop = team.loop;
+    uint64_t first, last;
+
+    if(!gomp_chunk_next(thread, team, first, last))
+        {
+        return false;
+        }
+
+    *istart = loop.start + first*loop.incr;
+    *iend = loop.start + last*loop.incr;
+
+    return true;
+    }
+
+static bool gomp_loop_ull_next(unsigned long long *istart, unsigned long long *iend)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    workshare &loop = team.loop;
+    uint64_t first, last;
+
+    if(!gomp_chunk_next(thread, team, first, last))
+        {
+        return false;
+        }
+
+    *istart = loop.start + first*loop.incr;
+    *iend = loop.start + last*loop.incr;
+
+    return true;
+    }
+
+
+// start a loop, and get the first chunk
+static bool gomp_loop_start(int sched, bool ordered, long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    gomp_loop_init(sched, gomp_loop_count(start, end, incr), chunk, start, incr, false, ordered, 0, 0);
+    return gomp_loop_next(istart, iend);
+    }
+
+static bool gomp_loop_ull_start(int sched, bool ordered, bool up, unsigned long long start, unsigned long long end,
+                                unsigned long long incr, unsigned long long chunk, unsigned long long *istart, unsigned long long *iend)
+    {
+    gomp_loop_init(sched, gomp_loop_count_ull(up, start, end, incr), chunk, start, incr, true, ordered, 0, 0);
+    return gomp_loop_ull_next(istart, iend);
+    }
+
+// start a doacross loop nest, only the outer loop is workshared, its iterations are 0..counts[0]-1
+static bool gomp_doacross_start(int sched, unsigned ncounts, long *counts, long chunk, long *istart, long *iend)
+    {
+    gomp_loop_init(sched, counts[0] > 0 ? counts[0] : 0, chunk, 0, 1, false, false, ncounts, counts);
+    return gomp_loop_next(istart, iend);
+    }
+
+static bool gomp_doacross_ull_start(int sched, unsigned ncounts, unsigned long long *counts, unsigned long long chunk,
+                                    unsigned long long *istart, unsigned long long *iend)
+    {
+    gomp_loop_init(sched, counts[0], chunk, 0, 1, true, false, ncounts, counts);
+    return gomp_loop_ull_next(istart, iend);
+    }
+
+
+extern "C" bool GOMP_loop_static_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_STATIC, false, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_dynamic_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_DYNAMIC, false, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_guided_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_GUIDED, false, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_runtime_start(long start, long end, long incr, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_DYNAMIC, false, start, end, incr, 1, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ordered_static_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_STATIC, true, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ordered_dynamic_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_DYNAMIC, true, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ordered_guided_start(long start, long end, long incr, long chunk, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_GUIDED, true, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ordered_runtime_start(long start, long end, long incr, long *istart, long *iend)
+    {
+    return gomp_loop_start(GOMP_SCHED_DYNAMIC, true, start, end, incr, 1, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_doacross_static_start(unsigned ncounts, long *counts, long chunk, long *istart, long *iend)
+    {
+    return gomp_doacross_start(GOMP_SCHED_STATIC, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_doacross_dynamic_start(unsigned ncounts, long *counts, long chunk, long *istart, long *iend)
+    {
+    return gomp_doacross_start(GOMP_SCHED_DYNAMIC, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_doacross_guided_start(unsigned ncounts, long *counts, long chunk, long *istart, long *iend)
+    {
+    return gomp_doacross_start(GOMP_SCHED_GUIDED, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_doacross_runtime_start(unsigned ncounts, long *counts, long *istart, long *iend)
+    {
+    return gomp_doacross_start(GOMP_SCHED_DYNAMIC, ncounts, counts, 1, istart, iend);
+    }
+
+// the schedule was decided when the loop started, so every "next" is the same
+extern "C" bool GOMP_loop_static_next(long *istart, long *iend)
+    {
+    return gomp_loop_next(istart, iend);
+    }
+
+extern "C" bool GOMP_loop_dynamic_next(long *, long *)          __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_guided_next(long *, long *)           __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_runtime_next(long *, long *)          __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_ordered_static_next(long *, long *)   __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_ordered_dynamic_next(long *, long *)  __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_ordered_guided_next(long *, long *)   __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_ordered_runtime_next(long *, long *)  __attribute__((alias("GOMP_loop_static_next")));
+
+// GCC calls these for dynamic, guided, and runtime schedules, which are not monotonic by default
+extern "C" bool GOMP_loop_nonmonotonic_dynamic_start(long, long, long, long, long *, long *)   __attribute__((alias("GOMP_loop_dynamic_start")));
+extern "C" bool GOMP_loop_nonmonotonic_guided_start(long, long, long, long, long *, long *)    __attribute__((alias("GOMP_loop_guided_start")));
+extern "C" bool GOMP_loop_nonmonotonic_runtime_start(long, long, long, long *, long *)         __attribute__((alias("GOMP_loop_runtime_start")));
+extern "C" bool GOMP_loop_maybe_nonmonotonic_runtime_start(long, long, long, long *, long *)   __attribute__((alias("GOMP_loop_runtime_start")));
+extern "C" bool GOMP_loop_nonmonotonic_dynamic_next(long *, long *)         __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_nonmonotonic_guided_next(long *, long *)          __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_nonmonotonic_runtime_next(long *, long *)         __attribute__((alias("GOMP_loop_static_next")));
+extern "C" bool GOMP_loop_maybe_nonmonotonic_runtime_next(long *, long *)   __attribute__((alias("GOMP_loop_static_next")));
+
+
+// "parallel for" with a dynamic, guided, or runtime schedule
+// Each member sets up its place in the loop before running the region, which starts with a "next".
+
+struct parallel_loop
+    {
+    TASKFN *fn;                                 // the parallel region generated by GCC
+    char *data;
+    int sched;
+    long start;
+    long end;
+    long incr;
+    long chunk;
+    };
+
+static void gomp_parallel_loop_fn(void *arg)
+    {
+    parallel_loop &pl = *(parallel_loop *)arg;
+
+    gomp_loop_init(pl.sched, gomp_loop_count(pl.start, pl.end, pl.incr), pl.chunk, pl.start, pl.incr, false, false, 0, 0);
+    pl.fn(pl.data);
+    }
+
+static void gomp_parallel_loop(int sched, TASKFN *fn, char *data, unsigned num_threads, long start, long end, long incr, long chunk, unsigned flags)
+    {
+    parallel_loop pl = {fn, data, sched, start, end, incr, chunk};
+
+    GOMP_parallel(gomp_parallel_loop_fn, (char *)&pl, num_threads, flags);
+    }
+
+extern "C" void GOMP_parallel_loop_static(TASKFN *fn, char *data, unsigned num_threads, long start, long end, long incr, long chunk, unsigned flags)
+    {
+    gomp_parallel_loop(GOMP_SCHED_STATIC, fn, data, num_threads, start, end, incr, chunk, flags);
+    }
+
+extern "C" void GOMP_parallel_loop_dynamic(TASKFN *fn, char *data, unsigned num_threads, long start, long end, long incr, long chunk, unsigned flags)
+    {
+    gomp_parallel_loop(GOMP_SCHED_DYNAMIC, fn, data, num_threads, start, end, incr, chunk, flags);
+    }
+
+extern "C" void GOMP_parallel_loop_guided(TASKFN *fn, char *data, unsigned num_threads, long start, long end, long incr, long chunk, unsigned flags)
+    {
+    gomp_parallel_loop(GOMP_SCHED_GUIDED, fn, data, num_threads, start, end, incr, chunk, flags);
+    }
+
+extern "C" void GOMP_parallel_loop_runtime(TASKFN *fn, char *data, unsigned num_threads, long start, long end, long incr, unsigned flags)
+    {
+    gomp_parallel_loop(GOMP_SCHED_DYNAMIC, fn, data, num_threads, start, end, incr, 1, flags);
+    }
+
+extern "C" void GOMP_parallel_loop_nonmonotonic_dynamic(TASKFN *, char *, unsigned, long, long, long, long, unsigned)  __attribute__((alias("GOMP_parallel_loop_dynamic")));
+extern "C" void GOMP_parallel_loop_nonmonotonic_guided(TASKFN *, char *, unsigned, long, long, long, long, unsigned)   __attribute__((alias("GOMP_parallel_loop_guided")));
+extern "C" void GOMP_parallel_loop_nonmonotonic_runtime(TASKFN *, char *, unsigned, long, long, long, unsigned)        __attribute__((alias("GOMP_parallel_loop_runtime")));
+extern "C" void GOMP_parallel_loop_maybe_nonmonotonic_runtime(TASKFN *, char *, unsigned, long, long, long, unsigned)  __attribute__((alias("GOMP_parallel_loop_runtime")));
+
+
+typedef unsigned long long ull;
+
+extern "C" bool GOMP_loop_ull_static_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_STATIC, false, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_dynamic_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_DYNAMIC, false, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_guided_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_GUIDED, false, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_runtime_start(bool up, ull start, ull end, ull incr, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_DYNAMIC, false, up, start, end, incr, 1, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_ordered_static_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_STATIC, true, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_ordered_dynamic_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_DYNAMIC, true, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_ordered_guided_start(bool up, ull start, ull end, ull incr, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_GUIDED, true, up, start, end, incr, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_ordered_runtime_start(bool up, ull start, ull end, ull incr, ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_start(GOMP_SCHED_DYNAMIC, true, up, start, end, incr, 1, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_doacross_static_start(unsigned ncounts, ull *counts, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_doacross_ull_start(GOMP_SCHED_STATIC, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_doacross_dynamic_start(unsigned ncounts, ull *counts, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_doacross_ull_start(GOMP_SCHED_DYNAMIC, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_doacross_guided_start(unsigned ncounts, ull *counts, ull chunk, ull *istart, ull *iend)
+    {
+    return gomp_doacross_ull_start(GOMP_SCHED_GUIDED, ncounts, counts, chunk, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_doacross_runtime_start(unsigned ncounts, ull *counts, ull *istart, ull *iend)
+    {
+    return gomp_doacross_ull_start(GOMP_SCHED_DYNAMIC, ncounts, counts, 1, istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_static_next(ull *istart, ull *iend)
+    {
+    return gomp_loop_ull_next(istart, iend);
+    }
+
+extern "C" bool GOMP_loop_ull_dynamic_next(ull *, ull *)            __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_guided_next(ull *, ull *)             __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_runtime_next(ull *, ull *)            __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_ordered_static_next(ull *, ull *)     __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_ordered_dynamic_next(ull *, ull *)    __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_ordered_guided_next(ull *, ull *)     __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_ordered_runtime_next(ull *, ull *)    __attribute__((alias("GOMP_loop_ull_static_next")));
+
+extern "C" bool GOMP_loop_ull_nonmonotonic_dynamic_start(bool, ull, ull, ull, ull, ull *, ull *)   __attribute__((alias("GOMP_loop_ull_dynamic_start")));
+extern "C" bool GOMP_loop_ull_nonmonotonic_guided_start(bool, ull, ull, ull, ull, ull *, ull *)    __attribute__((alias("GOMP_loop_ull_guided_start")));
+extern "C" bool GOMP_loop_ull_nonmonotonic_runtime_start(bool, ull, ull, ull, ull *, ull *)        __attribute__((alias("GOMP_loop_ull_runtime_start")));
+extern "C" bool GOMP_loop_ull_maybe_nonmonotonic_runtime_start(bool, ull, ull, ull, ull *, ull *)  __attribute__((alias("GOMP_loop_ull_runtime_start")));
+extern "C" bool GOMP_loop_ull_nonmonotonic_dynamic_next(ull *, ull *)       __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_nonmonotonic_guided_next(ull *, ull *)        __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_nonmonotonic_runtime_next(ull *, ull *)       __attribute__((alias("GOMP_loop_ull_static_next")));
+extern "C" bool GOMP_loop_ull_maybe_nonmonotonic_runtime_next(ull *, ull *) __attribute__((alias("GOMP_loop_ull_static_next")));
+
+
+// each member ends the loop once, when it has no more chunks
+static void gomp_loop_end()
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    gomp_chunk_end(thread, team);               // if it stopped early, because the loop was cancelled
+    thread.chunk_start = team.loop.n;
+    thread.chunk_end = team.loop.n;
+    team.loop.users--;
+    }
+
+extern "C" void GOMP_loop_end()
+    {
+    gomp_loop_end();
+    GOMP_barrier();
+    }
+
+extern "C" void GOMP_loop_end_nowait()
+    {
+    gomp_loop_end();
+    }
+
+extern "C" bool GOMP_loop_end_cancel()
+    {
+    gomp_loop_end();
+    return GOMP_barrier_cancel();
+    }
+
+
+// the start of an ordered region, wait until the thread's chunk has the ticket
+extern "C" void GOMP_ordered_start()
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    gomp_loop_wait(thread, team);
+    }
+
+// the end of an ordered region
+// The ticket is passed on when the chunk ends, since the chunk's next iteration may have an ordered region too.
+extern "C" void GOMP_ordered_end()
+    {
+    }
+
+
+// the flattened iteration number of a doacross iteration vector, and whether it is within the loop nest
+template<typename T>
+static bool gomp_doacross_flat(workshare &loop, const T *iter, uint64_t &flat)
+    {
+    flat = 0;
+    for(unsigned i=0; i<loop.ncounts && i<GOMP_DOACROSS_DEPTH; i++)
+        {
+        if((uint64_t)iter[i] >= loop.counts[i])
+            {
+            return false;
+            }
+        flat = flat*loop.counts[i] + iter[i];
+        }
+
+    return true;
+    }
+
+// "ordered depend(source)", the iteration has done the work its successors depend on
+template<typename T>
+static void gomp_doacross_post(const T *iter)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    uint64_t flat;
+
+    if(team.loop.ncounts <= GOMP_DOACROSS_DEPTH && gomp_doacross_flat(team.loop, iter, flat) && flat+1 > thread.posted)
+        {
+        thread.posted = flat+1;
+        gomp_loop_wake(team);
+        }
+    }
+
+// "ordered depend(sink: ...)", wait until an earlier iteration has posted
+// A dependence on an iteration outside the loop nest is ignored.
+template<typename T>
+static void gomp_doacross_wait(const T *iter)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    if(gomp_doacross_flat(team.loop, iter, thread.wait_flat))
+        {
+        thread.wait_outer = iter[0];
+        gomp_loop_wait(thread, team);
+        }
+    }
+
+extern "C" void GOMP_doacross_post(long *counts)
+    {
+    gomp_doacross_post(counts);
+    }
+
+extern "C" void GOMP_doacross_ull_post(ull *counts)
+    {
+    gomp_doacross_post(counts);
+    }
+
+extern "C" void GOMP_doacross_wait(long first, ...)
+    {
+    omp_thread &team = *omp_this_team();
+    long iter[team.loop.ncounts];
+    va_list ap;
+
+    iter[0] = first;
+    va_start(ap, first);
+    for(unsigned i=1; i<team.loop.ncounts; i++)
+        {
+        iter[i] = va_arg(ap, long);
+        }
+    va_end(ap);
+
+    gomp_doacross_wait(iter);
+    }
+
+extern "C" void GOMP_doacross_ull_wait(ull first, ...)
+    {
+    omp_thread &team = *omp_this_team();
+    ull iter[team.loop.ncounts];
+    va_list ap;
+
+    iter[0] = first;
+    va_start(ap, first);
+    for(unsigned i=1; i<team.loop.ncounts; i++)
+        {
+        iter[i] = va_arg(ap, ull);
+        }
+    va_end(ap);
+
+    gomp_doacross_wait(iter);
+    }
+
+
+#if 0
+
+/////////////
+// LOCKING //
+/////////////
+
+extern "C"
+void omp_init_lock(omp_lock_t *lock)
+    {
+    *lock = 0;
+    }
+
+extern "C"
+void omp_set_lock(omp_lock_t *lock)
+    {
+    while(*lock)
+        {
+        yield();
+        }
+
+    *lock = 1;
+    }
+
+extern "C"
+void omp_unset_lock(omp_lock_t *lock)
+    {
+    *lock = 0;
+    }
+
+extern "C"
+int omp_test_lock(omp_lock_t *lock)
+    {
+    if(*lock)
+        {
+        return 0;
+        }
+
+    *lock = 1;
+    return 1;
+    }
+
+extern "C"
+void omp_destroy_lock(omp_lock_t *lock)
     {
     *lock = 0;
     }
 
 
 
-////////////////////
-// NESTED LOCKING //
-////////////////////
+////////////////////
+// NESTED LOCKING //
+////////////////////
+
+extern "C"
+void omp_init_nest_lock(omp_nest_lock_t *lock)
+    {
+    lock->lock = 0;
+    lock->count = 0;
+    lock->owner = 0;
+    }
+
+extern "C"
+void omp_set_nest_lock(omp_nest_lock_t *lock)
+    {
+    int id = omp_get_thread_num();
+
+    if(lock->lock && lock->owner == id)
+        {
+        ++lock->count;
+        return;
+        }
+
+    while(lock->lock==1)
+        {
+        yield();
+        }
+
+    lock->lock = 1;
+    lock->count = 1;
+    lock->owner = id;
+    }
+
+extern "C"
+void omp_unset_nest_lock(omp_nest_lock_t *lock)
+    {
+    // It is assumed that the caller matches the owner. This is not checked.
+    // It is assumed that count>0. This is not checked.
+
+    --lock->count;
+    if(lock->count == 0)
+        {
+        lock->owner = 0;
+        lock->lock = 0;
+        }
+    }
+
+extern "C"
+int omp_test_nest_lock(omp_nest_lock_t *lock)
+    {
+    int id = omp_get_thread_num();
+
+    if(lock->lock && lock->owner == id)
+        {
+        ++lock->count;
+        return lock->count;
+        }
+
+    if(lock->lock == 0)
+        {
+        lock->lock = 1;
+        lock->count = 1;
+        lock->owner = id;
+        return 1;
+        }
+
+    return 0;
+    }
+
+extern "C"
+void omp_destroy_nest_lock(omp_nest_lock_t *lock)
+    {
+    lock->lock = 0;
+    lock->count = 0;
+    lock->owner = 0;
+    }
+
+#endif
+
+
+///////////
+// Tasks //
+///////////
+
+// flags passed to GOMP_task and GOMP_taskloop, from GCC's gomp-constants.h
+#define GOMP_TASK_FLAG_UNTIED       (1 << 0)
+#define GOMP_TASK_FLAG_FINAL        (1 << 1)
+#define GOMP_TASK_FLAG_MERGEABLE    (1 << 2)
+#define GOMP_TASK_FLAG_UP           (1 << 8)
+#define GOMP_TASK_FLAG_GRAINSIZE    (1 << 9)
+#define GOMP_TASK_FLAG_IF           (1 << 10)
+#define GOMP_TASK_FLAG_NOGROUP      (1 << 11)
+
+
+// Decide whether a new task should be run immediately rather than queued.
+// Queuing a task costs a malloc and a copy of its data, and only pays off if another thread
+// runs the task while this one gets on with something else. So a task is queued only while
+// there are fewer tasks in the queue than there are team members to take them: one for each
+// member that is waiting for work now, plus one for each member that will be looking for work
+// when it finishes what it is doing. Beyond that a queued task would only wait for a thread that
+// is already busy. A few tasks are always left in the pool for the implicit tasks of a parallel.
+
+static inline bool gomp_task_cutoff(omp_thread &team)
+    {
+    if(task_pool.available() <= (gomp_task_cutoff_var ? GOMP_TASK_RESERVE : 0))
+        {
+        return true;
+        }
+
+    if(!gomp_task_cutoff_var)
+        {
+        return false;
+        }
+
+    if(team.team_count <= 1)                    // there's no one else to run it
+        {
+        return true;
+        }
+
+    if(team.task_queued >= 2*team.team_count - 1)  // enough even if every other member is idle, the usual case
+        {                                       // in a recursive workload, so it is checked without counting them
+        return true;
+        }
+
+    int idle = 0;
+    for(omp_thread *member = team.members.head; member; member = member->next)
+        {
+        idle += member->twaiting;
+        }
+
+    return team.task_queued >= idle + team.team_count;
+    }
+
+
+// run a task now, on the creating thread
+static void gomp_task_now(void (*fn)(void *), void *data, void (*cpyfn)(void *, void *), long arg_size, long arg_align, unsigned flags)
+    {
+    omp_thread &thread = *omp_this_thread();
+
+    bool save_final = thread.in_final;
+    thread.in_final = save_final || (flags & GOMP_TASK_FLAG_FINAL);
+
+    // A mergeable task may run on its creator's data. Without a copy function that is what
+    // happens here to every task that is run immediately, with one it must be copied anyway.
+    if(cpyfn)                                   // if a copy function is defined, copy the data to a private buffer first
+        {
+        char buf[arg_size + arg_align - 1];
+        char *dst = &buf[arg_align-1];
+        dst = (char *)((uintptr_t)dst & ~(arg_align-1));
+        cpyfn(dst, data);
+        DPRINT(2)("call explicit task, id = %d(%d), code = %8p, data = %8p\n", thread.team_id, thread.id, fn, data);
+        GOMP_TOOL(GOMP_EV_TASK_BEGIN, GOMP_TRACE_INLINE);
+        fn(dst);
+        GOMP_TOOL(GOMP_EV_TASK_END, GOMP_TRACE_INLINE);
+        }
+    else
+        {
+        DPRINT(2)("call explicit task, id = %d(%d), code = %8p, data = %8p\n", thread.team_id, thread.id, fn, data);
+        GOMP_TOOL(GOMP_EV_TASK_BEGIN, GOMP_TRACE_INLINE);
+        fn(data);
+        GOMP_TOOL(GOMP_EV_TASK_END, GOMP_TRACE_INLINE);
+        }
+
+    thread.in_final = save_final;
+    }
+
+
+extern "C"
+void GOMP_task (    void (*fn) (void *),
+                    void *data,
+                    void (*cpyfn) (void *, void *),
+                    long arg_size,
+                    long arg_align,
+                    bool if_clause,
+                    unsigned flags,
+                    void **depend,
+                    int priority_arg,
+                    void *detach)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    if(gomp_cancelled(team, thread.taskgroup))  // tasks created after cancellation are never run
+        {
+        return;
+        }
+
+    if(!if_clause                               // if if_clause if false
+    || thread.in_final                          // or the creating task is final
+    || (flags & GOMP_TASK_FLAG_FINAL)           // or this task is final
+    || gomp_task_cutoff(team))                  // or queuing it would not help, run the task right now
+        {
+        gomp_task_now(fn, data, cpyfn, arg_size, arg_align, flags);
+        }
+    else                                        // else queue the task to be executed by another context later
+        {
+        char *argmem = (char *)arena_malloc(arg_size + arg_align);                              // allocate memory for data
+        task *task = argmem ? task_pool.acquire() : 0;                                          // and create a new task
+
+        if(task == 0)                           // if either can't be had, the task is run now instead
+            {
+            DPRINT(1)("%s, run the task undeferred\n", argmem ? "task_pool.acquire failed" : "malloc returned 0");
+            if(argmem)
+                {
+                arena_free(argmem, thread.arena);
+                }
+            gomp_task_now(fn, data, cpyfn, arg_size, arg_align, flags);
+            return;
+            }
+
+        char *arg = (char *)((uintptr_t)(argmem + arg_align) & ~(uintptr_t)(arg_align - 1));    // align the data memory
+        arg[-1] = arg-argmem;                                                                   // save the alignment offset at arg-1 so we can calc the addr for free later
+
+        if(cpyfn)
+            {
+            cpyfn(arg, data);
+            }
+        else
+            {
+            memcpy(arg, data, arg_size);
+            }
+
+        team.task_count++;
+
+        task->fn = fn;                          // give it code
+        task->data = arg;                       // and data
+        task->loop = 0;
+        task->arena = thread.arena;             // and the arena the data came from
+        task->taskgroup = thread.taskgroup;     // and make it a member of the current taskgroup
+        if(task->taskgroup)
+            {
+            task->taskgroup->count++;
+            }
+
+        DPRINT(2)("create explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+        GOMP_TOOL(GOMP_EV_TASK_CREATE, task_pool.index(task));
+        gomp_queue_task(team, task);            // add it to the list of explicit tasks
+        }
+    }
+
+
+
+// Start a taskgroup. The taskgroup_end will wait for all tasks created within the
+// taskgroup, and all their descendants, to complete.
+
+extern "C"
+void GOMP_taskgroup_start()
+    {
+    omp_thread &thread = *omp_this_thread();
+    taskgroup *group = (taskgroup *)arena_malloc(sizeof(taskgroup));
+
+    // The group lives until GOMP_taskgroup_end, so it can't be on this stack, and without it
+    // the end of the taskgroup couldn't wait for its tasks.
+    assert(group != 0 && "no memory for a taskgroup");
+
+    group->prev = thread.taskgroup;
+    group->count = 0;
+    group->cancelled = false;
+    thread.taskgroup = group;
+    }
+
+extern "C"
+void GOMP_taskgroup_end()
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    taskgroup *group = thread.taskgroup;
+
+    while(group->count)                         // while any tasks of the group are still queued or running
+        {
+        task *task;
+        if(gomp_dequeue_task(team, task))       // help out by running a queued task
+            {
+            run_explicit(task);
+            }
+        else
+            {
+            yield();                            // or let the threads that are running them continue
+            }
+        }
+
+    thread.taskgroup = group->prev;
+    arena_free(group);
+    }
+
+
+
+///////////////
+// Taskloops //
+///////////////
+
+// Split a loop of n iterations into chunks, and queue tasks to run them.
+// A taskloop is run by at most one task per team member, each of which claims chunks until
+// they are gone, which balances chunks of uneven cost without creating a task per chunk.
+//
+// Unless "nogroup" is given, the taskloop waits for its chunks in a taskgroup, so the shared
+// state can live on this stack, and the loop body's data is used in place. With "nogroup",
+// one block holds the shared state and a copy of the data, and is freed by the last task.
+// If the data has a copy function it can't be copied in advance, so a nogroup taskloop
+// with firstprivate objects is run by the creating thread.
+
+static void gomp_taskloop(taskloop &proto, unsigned flags, unsigned long num_tasks, uint64_t n)
+    {
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+
+    if(n == 0)
+        {
+        return;
+        }
+
+    if(flags & GOMP_TASK_FLAG_GRAINSIZE)        // num_tasks is the grainsize, the minimum iterations per chunk
+        {
+        num_tasks = num_tasks ? n/num_tasks : n;
+        }
+    else if(num_tasks == 0)                     // by default, one chunk per thread
+        {
+        num_tasks = team.team_count ? team.team_count : 1;
+        }
+
+    if(num_tasks == 0)
+        {
+        num_tasks = 1;
+        }
+    else if(num_tasks > n)
+        {
+        num_tasks = n;
+        }
+
+    proto.chunks = num_tasks;
+    proto.base = n / num_tasks;
+    proto.extra = n % num_tasks;
+    proto.next = 0;
+    proto.refs = 0;
+    proto.heap = false;
+
+    bool nogroup = flags & GOMP_TASK_FLAG_NOGROUP;
+    unsigned ntasks = proto.chunks < (unsigned)team.team_count ? proto.chunks : team.team_count;
+
+    if(!(flags & GOMP_TASK_FLAG_IF)             // if(0), or nowhere to run it but here
+    || ntasks <= 1
+    || !task_pool
+    || (nogroup && proto.cpyfn))
+        {
+        GOMP_TOOL(GOMP_EV_TASK_BEGIN, GOMP_TRACE_INLINE);
+        gomp_taskloop_run(proto);
+        GOMP_TOOL(GOMP_EV_TASK_END, GOMP_TRACE_INLINE);
+        return;
+        }
 
-extern "C"
-void omp_init_nest_lock(omp_nest_lock_t *lock)
-    {
-    lock->lock = 0;
-    lock->count = 0;
-    lock->owner = 0;
-    }
+    taskloop *loop = &proto;
 
-extern "C"
-void omp_set_nest_lock(omp_nest_lock_t *lock)
-    {
-    int id = omp_get_thread_num();
+    if(nogroup)
+        {
+        loop = (taskloop *)arena_malloc(sizeof(taskloop) + proto.arg_size + proto.arg_align);
+        if(loop == 0)                           // no memory for the shared copy, run it here as above
+            {
+            DPRINT(1)("malloc returned 0, run the taskloop undeferred\n");
+            GOMP_TOOL(GOMP_EV_TASK_BEGIN, GOMP_TRACE_INLINE);
+            gomp_taskloop_run(proto);
+            GOMP_TOOL(GOMP_EV_TASK_END, GOMP_TRACE_INLINE);
+            return;
+            }
+        *loop = proto;
+        loop->heap = true;
+        loop->data = (char *)((uintptr_t)((char *)(loop+1) + proto.arg_align - 1) & ~(uintptr_t)(proto.arg_align - 1));
+        memcpy(loop->data, proto.data, proto.arg_size);
+        }
+    else
+        {
+        GOMP_taskgroup_start();
+        }
 
-    if(lock->lock && lock->owner == id)
+    unsigned queued = 0;
+
+    for(unsigned i=0; i<ntasks; i++)
         {
-        ++lock->count;
-        return;
+        task *task = task_pool.acquire();
+
+        if(task == 0)
+            {
+            break;
+            }
+        ++queued;
+
+        ++loop->refs;
+        team.task_count++;
+        task->fn = 0;
+        task->data = 0;
+        task->loop = loop;
+        task->arena = thread.arena;
+        task->taskgroup = thread.taskgroup;
+        if(task->taskgroup)
+            {
+            task->taskgroup->count++;
+            }
+
+        DPRINT(2)("create taskloop task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
+        GOMP_TOOL(GOMP_EV_TASK_CREATE, task_pool.index(task));
+        gomp_queue_task(team, task);
         }
 
-    while(lock->lock==1)
+    if(queued == 0)                             // the task pool is empty, run the chunks here
         {
-        yield();
+        GOMP_TOOL(GOMP_EV_TASK_BEGIN, GOMP_TRACE_INLINE);
+        gomp_taskloop_run(*loop);
+        GOMP_TOOL(GOMP_EV_TASK_END, GOMP_TRACE_INLINE);
+        if(loop->heap)
+            {
+            arena_free(loop, thread.arena);
+            }
         }
 
-    lock->lock = 1;
-    lock->count = 1;
-    lock->owner = id;
+    if(!nogroup)
+        {
+        GOMP_taskgroup_end();                   // help run the chunks, and wait for them
+        }
     }
 
+
 extern "C"
-void omp_unset_nest_lock(omp_nest_lock_t *lock)
+void GOMP_taskloop( void (*fn)(void *),
+                    void *data,
+                    void (*cpyfn)(void *, void *),
+                    long arg_size,
+                    long arg_align,
+                    unsigned flags,
+                    unsigned long num_tasks,
+                    int priority __attribute__((__unused__)),
+                    long start,
+                    long end,
+                    long step)
     {
-    // It is assumed that the caller matches the owner. This is not checked.
-    // It is assumed that count>0. This is not checked.
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    uint64_t n;
 
-    --lock->count;
-    if(lock->count == 0)
+    if(gomp_cancelled(team, thread.taskgroup))
         {
-        lock->owner = 0;
-        lock->lock = 0;
+        return;
+        }
+
+    if(step > 0)
+        {
+        n = start < end ? (unsigned long)(end - start + step - 1) / step : 0;
         }
+    else
+        {
+        n = start > end ? (unsigned long)(start - end - step - 1) / (unsigned long)-step : 0;
+        }
+
+    taskloop loop = {fn, (char *)data, cpyfn, arg_size, arg_align, false, (uint64_t)start, (uint64_t)step};
+    gomp_taskloop(loop, flags, num_tasks, n);
     }
 
+
 extern "C"
-int omp_test_nest_lock(omp_nest_lock_t *lock)
+void GOMP_taskloop_ull( void (*fn)(void *),
+                        void *data,
+                        void (*cpyfn)(void *, void *),
+                        long arg_size,
+                        long arg_align,
+                        unsigned flags,
+                        unsigned long num_tasks,
+                        int priority __attribute__((__unused__)),
+                        unsigned long long start,
+                        unsigned long long end,
+                        unsigned long long step)
     {
-    int id = omp_get_thread_num();
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
+    uint64_t n;
 
-    if(lock->lock && lock->owner == id)
+    if(gomp_cancelled(team, thread.taskgroup))
         {
-        ++lock->count;
-        return lock->count;
+        return;
         }
 
-    if(lock->lock == 0)
+    if(flags & GOMP_TASK_FLAG_UP)
         {
-        lock->lock = 1;
-        lock->count = 1;
-        lock->owner = id;
-        return 1;
+        n = start < end ? (end - start + step - 1) / step : 0;
+        }
+    else
+        {
+        n = start > end ? (start - end - step - 1) / -step : 0;
         }
 
-    return 0;
+    taskloop loop = {fn, (char *)data, cpyfn, arg_size, arg_align, true, start, step};
+    gomp_taskloop(loop, flags, num_tasks, n);
     }
 
+
+
+//////////////////
+// Cancellation //
+//////////////////
+
+// Test whether the innermost construct of type "which" has been cancelled.
+// Returns true if it has, and the caller skips to the end of the construct.
+
 extern "C"
-void omp_destroy_nest_lock(omp_nest_lock_t *lock)
+bool GOMP_cancellation_point(int which)
     {
-    lock->lock = 0;
-    lock->count = 0;
-    lock->owner = 0;
-    }
+    if(!gomp_cancel_var)
+        {
+        return false;
+        }
 
-#endif
+    omp_thread &thread = *omp_this_thread();
+    omp_thread &team = *omp_this_team();
 
+    if(which & GOMP_CANCEL_PARALLEL)
+        {
+        return team.cancelled;
+        }
+    else if(which & (GOMP_CANCEL_LOOP | GOMP_CANCEL_SECTIONS))
+        {
+        return team.cancelled || team.ws_cancelled;
+        }
+    else if(which & GOMP_CANCEL_TASKGROUP)
+        {
+        return gomp_cancelled(team, thread.taskgroup);
+        }
+
+    return false;
+    }
 
-///////////
-// Tasks //
-///////////
+
+// Cancel the innermost construct of type "which".
+// If do_cancel is false (the "if" clause of the cancel was false) this is just a cancellation point.
+// Returns true if the construct has been cancelled, and the caller skips to the end of the construct.
+//
+// Cancelling a taskgroup causes its queued tasks, and the queued tasks of nested taskgroups,
+// to be discarded rather than run. Cancelling a parallel region also discards the team's queued
+// tasks, and releases any team members that are waiting at a barrier.
 
 extern "C"
-void GOMP_task (    void (*fn) (void *),
-                    void *data,
-                    void (*cpyfn) (void *, void *),
-                    long arg_size,
-                    long arg_align,
-                    bool if_clause,
-                    unsigned flags,
-                    void **depend,
-                    int priority_arg,
-                    void *detach)
+bool GOMP_cancel(int which, bool do_cancel)
     {
+    if(!gomp_cancel_var)
+        {
+        return false;
+        }
+
+    if(!do_cancel)
+        {
+        return GOMP_cancellation_point(which);
+        }
+
     omp_thread &thread = *omp_this_thread();
     omp_thread &team = *omp_this_team();
 
-    if(!if_clause                               // if if_clause if false
-    || !task_pool)                              // or the task pool is empty, we have to run the task right now
+    DPRINT(2)("cancel %d, id = %d(%d)\n", which, thread.team_id, thread.id);
+    GOMP_TOOL(GOMP_EV_CANCEL, which);
+
+    if(which & (GOMP_CANCEL_LOOP | GOMP_CANCEL_SECTIONS))
         {
-        if(cpyfn)                               // if a copy function is defined, copy the data to a private buffer first
-            {
-            char buf[arg_size + arg_align - 1];
-            char *dst = &buf[arg_align-1];
-            dst = (char *)((uintptr_t)dst & ~(arg_align-1));
-            cpyfn(dst, data);
-            DPRINT(2)("call explicit task, id = %d(%d), code = %8p, data = %8p\n", thread.team_id, thread.id, fn, data);
-            fn(dst);
-            }
-        else
-            {
-            DPRINT(2)("call explicit task, id = %d(%d), code = %8p, data = %8p\n", thread.team_id, thread.id, fn, data);
-            fn(data);
-            }
+        team.ws_cancelled = true;
+        gomp_loop_wake(team);                   // release members waiting in an ordered region or a doacross wait
         }
-    else                                        // else queue the task to be executed by another context later
+    else if(which & GOMP_CANCEL_TASKGROUP)
         {
-        char *argmem = (char *)malloc(arg_size + arg_align);                                    // allocate memory for data
-        if(argmem == 0)
+        if(thread.taskgroup)
             {
-            printf("malloc returned 0\n");
+            thread.taskgroup->cancelled = true;
             }
-        char *arg = (char *)((uintptr_t)(argmem + arg_align) & ~(uintptr_t)(arg_align - 1));    // align the data memory
-        arg[-1] = arg-argmem;                                                                   // save the alignment offset at arg-1 so we can calc the addr for free later
+        }
+    else if(which & GOMP_CANCEL_PARALLEL)
+        {
+        team.cancelled = true;
 
-        if(cpyfn)
-            {
-            cpyfn(arg, data);
-            }
-        else
+        omp_thread *member = &team;             // release any members waiting at a barrier
+        omp_thread **pnext = &team.members.head;
+        while(member)
             {
-            memcpy(arg, data, arg_size);
+            if(member->arrived)                 // a thread that has arrived at a barrier is suspended there
+                {
+                member->arrived = false;
+                member->context.resume();
+                }
+            member = *pnext;
+            pnext = &member->next;
             }
 
-        task *task = 0;
+        gomp_loop_wake(team);
+        }
 
-        bool ok = task_pool.take(task);        // create a new task
-        if(!ok)
-            {
-            printf("task_pool.take failed\n");
-            return;
-            }
-        team.task_count++;
+    return true;
+    }
 
-        task->fn = fn;                          // give it code
-        task->data = arg;                       // and data
 
-        DPRINT(2)("create explicit task %8p, id = %d(%d)\n", task, thread.team_id, thread.id);
-        team.task_list.add(task);                  // add it to the list of explicit tasks
+
+///////////////////
+// Configuration //
+///////////////////
+
+// parse a size in bytes, with an optional B, K, or M suffix. A number with no suffix is in "unit"s.
+static bool gomp_parse_size(const char *value, unsigned unit, unsigned &size)
+    {
+    char *end;
+    long n = strtol(value, &end, 10);
+
+    if(end == value || n < 0)
+        {
+        return false;
+        }
+
+    switch(*end)
+        {
+    case 0:                 n *= unit;          break;
+    case 'b': case 'B':     ++end;              break;
+    case 'k': case 'K':     n *= 1024; ++end;   break;
+    case 'm': case 'M':     n *= 1024*1024; ++end; break;
+    default:                return false;
+        }
+
+    size = n;
+    return *end == 0;
+    }
+
+static bool gomp_parse_bool(const char *value, int &var)
+    {
+    if(strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0)
+        {
+        var = 1;
+        }
+    else if(strcasecmp(value, "false") == 0 || strcmp(value, "0") == 0)
+        {
+        var = 0;
+        }
+    else
+        {
+        return false;
+        }
+
+    return true;
+    }
+
+
+// Set one of the runtime settings, given the name of its environment variable and a value.
+// Changing the stack size or budget retires the idle created threads, so that new
+// threads are created according to the new settings. Busy threads keep their stacks
+// until they become idle and time out.
+
+bool gomp_setenv(const char *name, const char *value)
+    {
+    unsigned n;
+
+    if(strcmp(name, "OMP_NUM_THREADS") == 0)
+        {
+        if(!gomp_parse_size(value, 1, n) || n == 0)return false;
+        gomp_nthreads_default = n;
+        gomp_nthreads_var = n;
+        }
+    else if(strcmp(name, "OMP_THREAD_LIMIT") == 0)
+        {
+        if(!gomp_parse_size(value, 1, n) || n == 0)return false;
+        gomp_thread_limit_var = n;
+        }
+    else if(strcmp(name, "OMP_STACKSIZE") == 0)                // the OpenMP default unit is K
+        {
+        if(!gomp_parse_size(value, 1024, n) || n < GOMP_MIN_STACK_SIZE || n > GOMP_STACK_ARENA)return false;
+        gomp_stacksize_var = (n + 15) & ~15;
+        gomp_trim_threads(true);
+        }
+    else if(strcmp(name, "GOMP_STACK_BUDGET") == 0)
+        {
+        if(!gomp_parse_size(value, 1, n) || n > GOMP_STACK_ARENA)return false;
+        gomp_stack_budget = n;
+        gomp_trim_threads(true);
+        }
+    else if(strcmp(name, "GOMP_IDLE_TIME") == 0)
+        {
+        if(!gomp_parse_size(value, 1, n))return false;
+        gomp_idle_time = n;
+        }
+    else if(strcmp(name, "OMP_DYNAMIC") == 0)
+        {
+        return gomp_parse_bool(value, dyn_var);
+        }
+    else if(strcmp(name, "OMP_CANCELLATION") == 0)
+        {
+        return gomp_parse_bool(value, gomp_cancel_var);
+        }
+    else if(strcmp(name, "GOMP_TASK_CUTOFF") == 0)
+        {
+        return gomp_parse_bool(value, gomp_task_cutoff_var);
+        }
+    else
+        {
+        return false;
+        }
+
+    return true;
+    }
+
+
+// set a variable from a line of the form NAME=value
+// blank lines and comments beginning with '#' are accepted and ignored
+bool gomp_putenv(char *line)
+    {
+    char *name = line;
+    char *value;
+    char *end;
+
+    while(*name == ' ' || *name == '\t')++name;                         // trim leading white space
+    for(end = name + strlen(name); end > name && (unsigned char)end[-1] <= ' '; )*--end = 0;  // and trailing white space and newline
+
+    if(*name == 0 || *name == '#')
+        {
+        return true;
+        }
+
+    value = strchr(name, '=');
+    if(value == 0)
+        {
+        return false;
+        }
+
+    for(end = value; end > name && (end[-1] == ' ' || end[-1] == '\t'); --end);  // trim white space around the '='
+    *end = 0;
+    for(++value; *value == ' ' || *value == '\t'; ++value);
+
+    return gomp_setenv(name, value);
+    }
+
+
+// print the settings, and the state of each thread that can be created on demand
+void gomp_print_env()
+    {
+    unsigned used = 0;
+
+    printf("OMP_NUM_THREADS=%d\n", gomp_nthreads_default);
+    printf("OMP_THREAD_LIMIT=%d\n", gomp_thread_limit_var);
+    printf("OMP_STACKSIZE=%uB\n", gomp_stacksize_var);
+    printf("OMP_DYNAMIC=%s\n", dyn_var ? "true" : "false");
+    printf("OMP_CANCELLATION=%s\n", gomp_cancel_var ? "true" : "false");
+    printf("GOMP_STACK_BUDGET=%uB\n", gomp_stack_budget);
+    printf("GOMP_IDLE_TIME=%u\n", gomp_idle_time);
+    printf("GOMP_TASK_CUTOFF=%s\n", gomp_task_cutoff_var ? "true" : "false");
+
+    printf("thread  stack     size  state\n");
+    for(int i=GOMP_FIRST_WORKER; i<GOMP_MAX_NUM_THREADS; i++)
+        {
+        omp_thread &thread = omp_threads[i];
+
+        if(thread.stack_low)
+            {
+            unsigned size = thread.stack_high - thread.stack_low;
+            used += size;
+            printf("%6d  %5u %8u  %s\n", i, (unsigned)(thread.stack_low - gomp_stack_arena), size, thread.idle_since ? "idle" : "busy");
+            }
         }
+    printf("%u of %u arena bytes in use\n", used, GOMP_STACK_ARENA);
+    printf("%u of %u tasks in use, at most %u, %u times none left\n",
+        task_pool.in_use(), task_pool.size(), task_pool.peak(), task_pool.failures());
     }
 
 
@@ -738,9 +2511,9 @@ void GOMP_task (    void (*fn) (void *),
 extern "C"
 void omp_set_num_threads(int num)
     {
-    if(num > OMP_NUM_THREADS)
+    if(num > gomp_thread_limit_var)
         {
-        num = OMP_NUM_THREADS;
+        num = gomp_thread_limit_var;
         }
 
     gomp_nthreads_var = num;
@@ -776,8 +2549,26 @@ int gomp_get_thread_id()
     }
 
 
-// extern "C" void omp_set_num_threads (int);
-// extern "C" int omp_get_max_threads (void);
+// return the number of threads a parallel without a num_threads clause would use
+extern "C"
+int omp_get_max_threads(void)
+    {
+    return gomp_nthreads_var;
+    }
+
+// return whether the running task is final
+extern "C"
+int omp_in_final(void)
+    {
+    return omp_this_thread()->in_final;
+    }
+
+// return the maximum team size
+extern "C"
+int omp_get_thread_limit(void)
+    {
+    return gomp_thread_limit_var;
+    }
 
 
 
@@ -793,6 +2584,13 @@ int omp_get_dynamic(void)
     return dyn_var;
     }
 
+// return whether cancellation is enabled
+extern "C"
+int omp_get_cancellation(void)
+    {
+    return gomp_cancel_var;
+    }
+
 
 // Return current time as a floating point number in seconds since powerup.
 // This uses the 32-bit TIM2 timer which runs at 1 MHz.
@@ -853,14 +2651,11 @@ float omp_get_wtick(int __attribute__((__unused__)))
 // extern "C" void omp_init_nest_lock_with_hint (omp_nest_lock_t *, omp_sync_hint_t);
 // extern "C" void omp_set_schedule (omp_sched_t, int);
 // extern "C" void omp_get_schedule (omp_sched_t *, int *);
-// extern "C" int omp_get_thread_limit (void);
 // extern "C" void omp_set_max_active_levels (int);
 // extern "C" int omp_get_max_active_levels (void);
 // extern "C" int omp_get_level (void);
 // extern "C" int omp_get_ancestor_thread_num (int);
 // extern "C" int omp_get_active_level (void);
-// extern "C" int omp_in_final (void);
-// extern "C" int omp_get_cancellation (void);
 // extern "C" omp_proc_bind_t omp_get_proc_bind (void);
 // extern "C" int omp_get_num_places (void);
 // extern "C" int omp_get_place_num_procs (int);
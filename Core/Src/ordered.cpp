@@ -0,0 +1,140 @@
+// ordered.cpp
+//
+// Parallel computation with output in order, to test and time "ordered" and doacross loops.
+//
+// Each block of a pseudo-random stream is checksummed with a CRC-32, which is the part that can
+// run in parallel, and the CRCs are written out in block order, as a stream of results would be
+// written to flash. Here the output is folded into a digest that depends on the order, so every
+// version must produce the same digest as the serial one.
+//
+// The ordered versions write the output in an ordered region, with various schedules. The doacross
+// version makes each iteration wait for the previous one with depend(sink: i-1) before writing.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+#include "ordered.hpp"
+
+static const int BLOCK = 256;               // bytes per block
+
+const char *crc_stream_modes[CRC_NUM_MODES] =
+    {
+    "serial",
+    "static",
+    "static,1",
+    "dynamic,1",
+    "guided",
+    "doacross"
+    };
+
+
+// the CRC-32 of a block of pseudo-random bytes
+static uint32_t crc_block(int block)
+    {
+    uint32_t x = block*0x9E3779B9 + 1;      // the block's data is an xorshift sequence seeded by its number
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(int i=0; i<BLOCK; i++)
+        {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        crc ^= x & 0xFF;
+
+        for(int k=0; k<8; k++)
+            {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+            }
+        }
+
+    return ~crc;
+    }
+
+
+// "write" one result, the digest depends on the order of the writes
+static inline void output(uint32_t &digest, uint32_t crc)
+    {
+    digest = (digest ^ crc) * 0x01000193;
+    }
+
+
+// checksum a stream of blocks, and write the checksums in order
+// mode is one of the CRC_* modes, threads is the team size, 0 for the default
+// returns the digest of the output
+
+uint32_t crc_stream(int blocks, int mode, int threads)
+    {
+    uint32_t digest = 0x811C9DC5;
+
+    if(threads == 0)
+        {
+        threads = omp_get_max_threads();
+        }
+
+    switch(mode)
+        {
+    case CRC_SERIAL:
+        for(int i=0; i<blocks; i++)
+            {
+            output(digest, crc_block(i));
+            }
+        break;
+
+    case CRC_STATIC:                        // one block of iterations per thread, the ordered regions run one block after another
+        #pragma omp parallel for ordered num_threads(threads)
+        for(int i=0; i<blocks; i++)
+            {
+            uint32_t crc = crc_block(i);
+            #pragma omp ordered
+            output(digest, crc);
+            }
+        break;
+
+    case CRC_STATIC1:
+        #pragma omp parallel for ordered schedule(static, 1) num_threads(threads)
+        for(int i=0; i<blocks; i++)
+            {
+            uint32_t crc = crc_block(i);
+            #pragma omp ordered
+            output(digest, crc);
+            }
+        break;
+
+    case CRC_DYNAMIC1:
+        #pragma omp parallel for ordered schedule(dynamic, 1) num_threads(threads)
+        for(int i=0; i<blocks; i++)
+            {
+            uint32_t crc = crc_block(i);
+            #pragma omp ordered
+            output(digest, crc);
+            }
+        break;
+
+    case CRC_GUIDED:
+        #pragma omp parallel for ordered schedule(guided) num_threads(threads)
+        for(int i=0; i<blocks; i++)
+            {
+            uint32_t crc = crc_block(i);
+            #pragma omp ordered
+            output(digest, crc);
+            }
+        break;
+
+    case CRC_DOACROSS:
+        #pragma omp parallel for ordered(1) schedule(static, 1) num_threads(threads)
+        for(int i=0; i<blocks; i++)
+            {
+            uint32_t crc = crc_block(i);
+            #pragma omp ordered depend(sink: i-1)
+            output(digest, crc);
+            #pragma omp ordered depend(source)
+            }
+        break;
+        }
+
+    return digest;
+    }
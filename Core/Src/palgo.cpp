@@ -0,0 +1,162 @@
+// palgo.cpp
+//
+// Compare each algorithm of parallel.hpp with the equivalent serial loop.
+//
+// Every benchmark works on pseudo-random words, and returns a checksum of its result that
+// depends on the order of the elements, so the serial and parallel versions must return the same
+// value. The sort returns 0 if its output is not in order.
+//
+// The array is qbuf, which is free while no file command is running, as it is for mb. The heap is
+// too small for it, and it isn't worth 2K of RAM of its own.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+#include "parallel.hpp"
+#include "palgo.hpp"
+
+static const long FOR_GRAIN = 64;           // the grain of each algorithm, enough work to be worth a thread switch
+static const long REDUCE_GRAIN = 256;
+static const long SCAN_GRAIN = 64;
+static const long SORT_GRAIN = 64;
+
+const char *palgo_names[PALGO_NUM_ALGOS] =
+    {
+    "for",
+    "reduce",
+    "scan",
+    "sort"
+    };
+
+extern uint32_t qbuf[512/4];
+static uint32_t *const data = qbuf;
+
+
+// a pseudo-random word for element i
+static inline uint32_t hash(uint32_t x)
+    {
+    x = x*0x9E3779B9 + 1;
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+    }
+
+
+// fill the array with hashes
+static void fill(int n, bool parallel)
+    {
+    if(parallel)
+        {
+        parallel_for(Range{0, n}, FOR_GRAIN, [](long i){ data[i] = hash(i); });
+        }
+    else
+        {
+        for(int i=0; i<n; i++)
+            {
+            data[i] = hash(i);
+            }
+        }
+    }
+
+
+// a checksum of the array that depends on the order of the elements
+static uint32_t checksum(int n)
+    {
+    uint32_t sum = 0;
+
+    for(int i=0; i<n; i++)
+        {
+        sum = (sum ^ data[i]) * 0x01000193;
+        }
+
+    return sum;
+    }
+
+
+// run one algorithm on n elements, serially or in parallel, and return a checksum of its result
+uint32_t palgo_bench(int algo, int n, bool parallel)
+    {
+    if(algo != PALGO_REDUCE && n > PALGO_MAX)
+        {
+        n = PALGO_MAX;
+        }
+
+    switch(algo)
+        {
+    case PALGO_FOR:
+        {
+        fill(n, parallel);
+        return checksum(n);
+        }
+
+    case PALGO_REDUCE:
+        {
+        auto map = [](long i){ return hash(i); };
+        auto add = [](uint32_t a, uint32_t b){ return a + b; };
+
+        if(parallel)
+            {
+            return parallel_reduce(Range{0, n}, REDUCE_GRAIN, (uint32_t)0, map, add);
+            }
+
+        uint32_t sum = 0;
+        for(int i=0; i<n; i++)
+            {
+            sum = add(sum, map(i));
+            }
+        return sum;
+        }
+
+    case PALGO_SCAN:
+        {
+        fill(n, false);
+
+        if(parallel)
+            {
+            parallel_inclusive_scan(data, data, n, SCAN_GRAIN, [](uint32_t a, uint32_t b){ return a + b; });
+            }
+        else
+            {
+            for(int i=1; i<n; i++)
+                {
+                data[i] += data[i-1];
+                }
+            }
+        return checksum(n);
+        }
+
+    case PALGO_SORT:
+        {
+        auto less = [](uint32_t a, uint32_t b){ return a < b; };
+
+        fill(n, false);
+
+        if(parallel)
+            {
+            parallel_sort(data, data+n, SORT_GRAIN, less);
+            }
+        else
+            {
+            parallel_sort_serial(data, data+n, less);
+            }
+
+        for(int i=1; i<n; i++)
+            {
+            if(data[i] < data[i-1])
+                {
+                return 0;
+                }
+            }
+        return checksum(n);
+        }
+        }
+
+    return 0;
+    }
@@ -79,7 +79,7 @@ static void permuter(unsigned input, unsigned char (&output)[MAX], int step, int
 
 
 
-void permute(int colors_arg, int balls, int plevel_arg, int verbose_arg)
+int permute(int colors_arg, int balls, int plevel_arg, int verbose_arg)
     {
     unsigned input;
     unsigned char output[MAX];
@@ -108,4 +108,6 @@ void permute(int colors_arg, int balls, int plevel_arg, int verbose_arg)
     permuter(input, output, 0, colors*balls);           //   gets things started
 
     printf("permutations = %d\n", permutations);        // print results
+
+    return permutations;
     }
@@ -14,6 +14,7 @@
 
 extern "C" int _write  (int file, const char *ptr, int len);
 extern "C" int _writenl(int file, const char *ptr, int len);
+extern "C" void console_flush();
 
 static mutex PrintfMutex;
 
@@ -39,7 +40,7 @@ int vprintf(const char *fmt, va_list args)
 
     int len = vsnprintf(printbuf, MAXPRINTF, fmt, args);        // format the message into the shared buffer
 
-    _write(1, printbuf, len);
+    _write(1, printbuf, len);                                   // copy it to the CDC transmit ring, which the USB interrupt sends
 
     PrintfMutex.unlock();
 
@@ -61,13 +62,25 @@ int puts(const char *str)
     }
 
 
+// C library fflush, waits until what was printed has been sent
+extern "C"
+int fflush(FILE *)
+    {
+    console_flush();
+
+    return 0;
+    }
+
+
 // C library putchar
 extern "C"
 int putchar(const int c)
     {
     char buf = c;
 
+    PrintfMutex.lock();
     _write(1, &buf, 1);
+    PrintfMutex.unlock();
 
     return c;
     }
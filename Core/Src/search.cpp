@@ -0,0 +1,94 @@
+// search.cpp
+//
+// A "find first match" search, to test and time OpenMP cancellation.
+//
+// The search space is divided into chunks, and each chunk is searched by an explicit task.
+// When a task finds the match it cancels the taskgroup. The tasks that have not started yet
+// are discarded by the runtime, and the tasks that are running notice the cancellation at their
+// next cancellation point and give up. Without cancellation every chunk is searched to the end.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+
+static const int CHUNKS = 8;                // number of tasks the search is divided into, few enough that they all fit in the task pool
+static const int CHECK = 64;                // number of keys tried between cancellation points
+
+
+// a one-to-one hash, so exactly one key matches the target
+static inline uint32_t hash(uint32_t x)
+    {
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+    }
+
+
+// search the keys 0..n-1 for the one whose hash matches that of pos
+// if cancel is true, the search is cancelled as soon as the match is found
+// returns the key that was found, or -1
+// if scanned is not null, it returns the number of keys that were hashed
+
+int search(int n, int pos, bool cancel, int *scanned)
+    {
+    uint32_t target = hash(pos);
+    int found = -1;
+    int count = 0;
+
+    #pragma omp parallel
+        {
+        #pragma omp single
+            {
+            #pragma omp taskgroup
+                {
+                for(int c=0; c<CHUNKS; c++)
+                    {
+                    #pragma omp task firstprivate(c) shared(found, count)
+                        {
+                        int start = (int)((int64_t)n * c / CHUNKS);
+                        int end = (int)((int64_t)n * (c+1) / CHUNKS);
+
+                        for(int i=start; i<end; i+=CHECK)
+                            {
+                            int last = i+CHECK < end ? i+CHECK : end;
+                            bool match = false;
+
+                            for(int j=i; j<last; j++)
+                                {
+                                if(hash(j) == target)
+                                    {
+                                    found = j;
+                                    match = true;
+                                    }
+                                }
+
+                            #pragma omp atomic
+                            count += last - i;
+
+                            if(match)
+                                {
+                                #pragma omp cancel taskgroup if(cancel)
+                                }
+
+                            #pragma omp cancellation point taskgroup
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+    if(scanned)
+        {
+        *scanned = count;
+        }
+
+    return found;
+    }
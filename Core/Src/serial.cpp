@@ -5,29 +5,64 @@
 
  
 #include <stdint.h>
+#include <string.h>
 #include "main.h"
+#include "local.h"
 #include "context.hpp"
-#include "Fifo.hpp"
 #include "ContextFIFO.hpp"
 #include "Port.hpp"
 #include "CriticalRegion.hpp"
 #include "usbd_cdc_if.h"
 #include "tim.h"
 
-extern "C" const char *strnchr(const char *s, int n, int c);
-
-Port txPort;
-Port rxPort;
-
-FIFO<char, 64> ConsoleFifo;
+Port rxPort;                                                    // a reader waits here for console input
 
 bool ControlC = false;
 bool SerialRaw = false;
 
+
+// Console output
+//
+// printf, puts, putchar, and _write put their output straight into the transmit ring of the USB
+// CDC interface, in space reserved from it, and return. The ring sends it from the USB interrupt,
+// each transfer chained to the last, so nothing is copied again and no thread is involved in
+// sending it. Newlines become "\r\n" as the output goes into the ring.
+//
+// Output is committed to the ring, and so sent, once it ends a line, fills a USB packet, is
+// flushed, or has waited CONSOLE_IDLE microseconds for more, so that a line put out a character
+// at a time, such as the echo and redraw of getline, doesn't become a transfer per character.
+// The console thread commits output that has waited too long.
+//
+// The reserved space is only touched by threads, which are not preemptive, so it needs no lock.
+// It can't be written by an interrupt handler, nor by the background thread when ConsoleOverflow
+// is CONSOLE_BLOCK, since the background must never suspend.
+
+static uint8_t *out_base;                                       // the space reserved at the head of the ring
+static unsigned out_room = 0;                                   // its size
+static unsigned out_fill = 0;                                   // the bytes written into it, not yet committed
+static uint32_t out_stamp = 0;                                  // the microsecond timer when output was last written
+
+static char ConsoleStack[512];                                  // the stack of the console thread, which the USB interrupt also runs on
+static Context console_context;
+
+static Port txKick;                                             // the console thread waits here for uncommitted output
+static ContextFIFO txWait;                                      // threads wait here for a USB transfer to complete
+
+ConsoleOverflowPolicy ConsoleOverflow = CONSOLE_OVERFLOW;
+unsigned ConsoleDrops = 0;                                      // characters lost to a full ring
+unsigned ConsolePeak = 0;                                       // the most characters that have been waiting
+bool ConsoleCoalesce = true;                                    // false to send each write at once
+
+// Console input
+//
+// The USB CDC interface puts what the host sends in its receive ring, and holds the host off when
+// that is full, so input isn't lost when it comes faster than it is read. Control-C is taken out
+// as it arrives, unless SerialRaw is set, so that it can stop a command that isn't reading.
+
 extern "C"
 int __io_kbhit()                                // test for input
     {
-    if(ConsoleFifo)
+    if(vcp_rxcount())
         {
         return 1;
         }
@@ -38,23 +73,29 @@ int __io_kbhit()                                // test for input
     }
 
 
+// wait for input, which a reader can only do one at a time
+static void console_rxwait()
+    {
+    CRITICAL_REGION(InterruptLock)              // close the window between test and wait, where a callback might occur
+        {
+        if(!vcp_rxcount())
+            {
+            rxPort.suspend();
+            yield();
+            }
+        }
+    }
+
+
 extern "C"
 int __io_getchar()                              // link the CMSIS syslib to the HAL's UART input
     {
-    char ch;
+    uint8_t ch;
 
-    do
+    while(!vcp_read(&ch, 1))
         {
-        CRITICAL_REGION(InterruptLock)          // close the window between test and wait, where a callback might occur
-            {
-            if(!ConsoleFifo)
-                {
-                rxPort.suspend();
-                yield();
-                }
-            }
+        console_rxwait();
         }
-    while(!ConsoleFifo.take(ch));
 
     return ch;
     }
@@ -63,15 +104,13 @@ int __io_getchar()                              // link the CMSIS syslib to the
 extern "C"
 int __io_getchart(unsigned timeout)                      // getch with timeout
     {
-    char ch;
+    uint8_t ch;
     uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
 
     do
         {
-        if(ConsoleFifo)
+        if(vcp_read(&ch, 1))
             {
-            ConsoleFifo.take(ch);
-
             return ch;
             }
         yield();
@@ -81,56 +120,216 @@ int __io_getchart(unsigned timeout)                      // getch with timeout
     }
 
 
-// refactored code: atomically wrap the test and wait for txready, then output the buffer
-static void vcp_writeblock(uint8_t* Buf1, uint16_t Len1, uint8_t* Buf2 = 0, uint16_t Len2 = 0)
+// Read n bytes of console input into buf, in as few pieces as they come, and return how many
+// were read. It gives up early when nothing more has come for timeout microseconds, or never if
+// timeout is 0.
+extern "C"
+int console_read(void *buf, int n, unsigned timeout)
     {
-    do
+    uint8_t *p = (uint8_t *)buf;
+    int got = 0;
+    uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
+
+    while(got < n)
         {
-        CRITICAL_REGION(InterruptLock)                          // test for busy and wait atomically
+        uint32_t more = vcp_read(p + got, n - got);
+
+        if(more)
             {
-            if(!vcp_txready())
-                {
-                txPort.suspend();                                  // so the callback cannot occur in the window between the test and wait
-                yield();
-                }
+            got += more;
+            start = __HAL_TIM_GET_COUNTER(&htim2);
+            }
+        else if(timeout == 0)
+            {
+            console_rxwait();
+            }
+        else if(__HAL_TIM_GET_COUNTER(&htim2) - start >= timeout)
+            {
+            break;
+            }
+        else
+            {
+            yield();
             }
         }
-    while(CDC_Transmit_FS(Buf1, Len1, Buf2, Len2) == USBD_BUSY);
+
+    return got;
     }
 
+
+// wait for the transfer in progress to complete, or give way for a moment if there is none
 extern "C"
-int _write(int file, const char *ptr, int len)
+void vcp_txwait()
     {
-    int retlen = len;                                           // success return = buffer len
+    vcp_commit(0);                                              // start one, if output is waiting that USB wasn't ready for
 
-    while(len)                                                  // while there is some of the buffer left
+    CRITICAL_REGION(InterruptLock)                              // test for busy and wait atomically
         {
-        const char *pnl;                                        // pointer to newline
+        if(vcp_txbusy())
+            {
+            txWait.suspend();                                   // so the callback cannot occur in the window between the test and wait
+            }
+        }
+    yield();
+    }
+
+
+// send what has been written
+static void console_commit()
+    {
+    vcp_commit(out_fill);
+    out_base += out_fill;
+    out_room -= out_fill;
+    out_fill = 0;
+    }
 
-        pnl = strnchr(ptr, len, '\n');                          // see if there is a newline in the buffer
-        if(pnl )
+
+// the console thread, which commits output that has waited CONSOLE_IDLE for the rest of its line
+static uint32_t console_idle(uintptr_t)
+    {
+    while(true)
+        {
+        if(out_fill == 0)
+            {
+            txKick.suspend();
+            }
+        else if(__HAL_TIM_GET_COUNTER(&htim2) - out_stamp >= CONSOLE_IDLE)
+            {
+            console_commit();
+            }
+        else
             {
-            vcp_writeblock((uint8_t *)ptr, pnl-ptr, (uint8_t *)"\r\n", 2); // if so, output the buffer up to before the newlin, followed by return and newline
+            yield();
+            }
+        }
+    }
+
 
-            len -= pnl-ptr+1;                                   // skip over the newline in the buffer
-            ptr = pnl+1;
-            }                                                   // we will repeat until the buffer is empty
-        else                                                    // if there is no newline
+extern "C"
+void console_init()
+    {
+    console_context.spawn(console_idle, ConsoleStack);
+    }
+
+
+// Make room for another character in the reserved space, returns false if it is to be dropped.
+static bool console_room()
+    {
+    while(true)
+        {
+        uint32_t room;
+        uint8_t *base = vcp_reserve(&room);                     // the space may have grown as USB sent
+
+        if(room > out_fill)
+            {
+            out_base = base;
+            out_room = room;
+            return true;
+            }
+
+        if(out_fill)                                            // the space ends at the end of the ring, or the ring is full,
+            {                                                   // send what is written, and look again
+            console_commit();
+            continue;
+            }
+
+        if(ConsoleOverflow == CONSOLE_DROP_OLDEST)
             {
-            vcp_writeblock((uint8_t *)ptr, len);                // just output the whole buffer
+            uint32_t dropped = vcp_txdiscard();                 // all the output waiting behind the transfer in progress
+
+            ConsoleDrops += dropped;
+            if(dropped)
+                {
+                continue;
+                }
+            }
 
-            len = 0;                                            // and set the len to zero so there is no repeat
+        if(ConsoleOverflow == CONSOLE_BLOCK)
+            {
+            vcp_txwait();
+            continue;
+            }
+
+        ++ConsoleDrops;
+        return false;
+        }
+    }
+
+
+// put a character in the reserved space
+static inline void console_put(char ch)
+    {
+    if(out_fill == out_room && !console_room())
+        {
+        return;
+        }
+
+    out_base[out_fill++] = ch;
+    }
+
+
+// put a buffer in the ring, with newlines translated, and send it if it ends a line or fills a packet
+static void console_write(const char *ptr, int len, bool newline)
+    {
+    bool line = newline || !ConsoleCoalesce;
+
+    for(int i=0; i<len; i++)
+        {
+        if(ptr[i] == '\n')
+            {
+            console_put('\r');
+            line = true;
             }
+        console_put(ptr[i]);
+        }
+
+    if(newline)
+        {
+        console_put('\r');
+        console_put('\n');
+        }
+
+    out_stamp = __HAL_TIM_GET_COUNTER(&htim2);
+    if(line || out_fill >= CONSOLE_COALESCE)
+        {
+        console_commit();
+        }
+    else if(out_fill && txKick)                                 // part of a line, the console thread sends it if no more comes
+        {
+        txKick.resume();
         }
 
-    return retlen;
+    if(vcp_txpending() + out_fill > ConsolePeak)
+        {
+        ConsolePeak = vcp_txpending() + out_fill;
+        }
+    }
+
+
+// wait until everything written so far has gone out over USB
+extern "C"
+void console_flush()
+    {
+    console_commit();
+    while(vcp_txpending())
+        {
+        vcp_txwait();
+        }
+    }
+
+
+extern "C"
+int _write(int file, const char *ptr, int len)
+    {
+    console_write(ptr, len, false);
+    return len;
     }
 
 
 extern "C"
 int _writenl(int file, const char *ptr, int len)
     {
-    vcp_writeblock((uint8_t *)ptr, len, (uint8_t *)"\r\n", 2);
+    console_write(ptr, len, true);
     return len;
     }
 
@@ -138,12 +337,18 @@ int _writenl(int file, const char *ptr, int len)
 extern "C"
 void vcp_tx_callback()
     {
-    txPort.resume();
+    while(txWait)
+        {
+        txWait.resume();
+        }
     }
 
+// take control-C out of a packet from the host, returns the length of what is left
 extern "C"
-void vcp_rx_callback(uint8_t *Buf, uint32_t Len)
+uint32_t vcp_rx_filter(uint8_t *Buf, uint32_t Len)
     {
+    uint32_t kept = 0;
+
     for(unsigned i=0; i<Len; i++)
         {
         char ch = Buf[i];
@@ -154,10 +359,15 @@ void vcp_rx_callback(uint8_t *Buf, uint32_t Len)
             }
         else
             {
-            ConsoleFifo.add(ch);
-            rxPort.resume();
+            Buf[kept++] = ch;
             }
         }
 
+    return kept;
     }
 
+extern "C"
+void vcp_rx_callback()
+    {
+    rxPort.resume();
+    }
@@ -7,6 +7,61 @@
 #include <stdint.h>
 
 #include "boundaries.h"
+#include "libgomp.hpp"
+
+// the type of memory an address is in, see summary below
+static char region(const unsigned char *mem)
+    {
+    uint32_t *addr = (uint32_t *)mem;
+
+    for(auto &thread : omp_threads)                                                 // thread stacks first, they are in .bss
+        {
+        if(thread.stack_low && mem >= (unsigned char *)thread.stack_low && mem < (unsigned char *)thread.stack_high)
+            {
+            return 'S';
+            }
+        }
+
+    if(     addr >= &_text_start      && addr < &_text_end)      return 'T';
+    else if(addr >= &_sdata           && addr < &_edata)         return 'D';
+    else if(addr >= &_sbss            && addr < &_ebss)          return 'B';
+    else if(addr >= &_heap_start      && addr < &_heap_end)      return 'H';
+    else if(addr >= &_stack_start     && addr < &_stack_end)     return 'S';
+    else                                                         return '#';
+    }
+
+
+// whether every byte of a block is the same, looking at a word at a time where it can
+static bool uniform(const unsigned char *mem, unsigned size)
+    {
+    unsigned char b = mem[0];
+    unsigned j = 0;
+
+    if(((uintptr_t)mem & 3) == 0)
+        {
+        const uint32_t *words = (const uint32_t *)mem;
+        uint32_t w = b * 0x01010101u;
+
+        for(; j+4 <= size; j += 4)
+            {
+            if(*words++ != w)
+                {
+                return false;
+                }
+            }
+        }
+
+    for(; j<size; j++)
+        {
+        if(mem[j] != b)
+            {
+            return false;
+            }
+        }
+
+    return true;
+    }
+
 
 // print a summary of memory
 //
@@ -17,9 +72,10 @@
 // -- DD for .data
 // -- BB for .bss
 // -- HH for the heap
-// -- SS for the area declared as stack on the linker file, though threads may have stacks elsewhere 
-// -- XX is the memory block is not one of the above and all the bytes in the block do not have the same value
+// -- SS for a thread's stack, or the area declared as stack in the linker file
+// -- ## if the memory block is not one of the above
 // -- hh the summary may be a two-digit hex value if every byte of the block has the same value.
+// A block that spans two areas is shown as the one it starts in.
 
 // args:
 //  -- a pointer to the start of the memory area to summarize
@@ -41,31 +97,16 @@ void summary(   unsigned char *mem,                     // start of memory regio
             printf("%08zx: ", (uintptr_t)(mem+i));
             }
 
-        unsigned char b = mem[i];                       // remember first byte in block
-        char buf[3];                                    // print buffer
-
-        snprintf(buf, 3, "%02x", b);                    // save hex representation of the first byte
-
-        for(unsigned j=0; j<inc; j++)                   // for each byte in the block
+        if(values && uniform(&mem[i], inc))             // print the value of a block that is all one value
             {
-            if(mem[i+j] != b || values==0)              // if the byte is different from the first byte, or we are not printing values
-                {
-                char sym;
-                uint32_t *addr = (uint32_t *)&mem[i+j];
-
-                if(     addr >= &_text_start      && addr < &_text_end)      sym = 'T';     // select a type depending on what range the mmory is in
-                else if(addr >= &_sdata           && addr < &_edata)         sym = 'D';
-                else if(addr >= &_sbss            && addr < &_ebss)          sym = 'B';
-                else if(addr >= &_heap_start      && addr < &_heap_end)      sym = 'H';
-                else if(addr >= &_stack_start     && addr < &_stack_end)     sym = 'S';
-                else                                                         sym = '#';
-
-                buf[0] = sym;                           // fill a two char buffer with the selected memory type
-                buf[1] = sym;
-                }
+            printf("%02x ", mem[i]);
+            }
+        else                                            // else the type of memory it is
+            {
+            char sym = region(&mem[i]);
+            printf("%c%c ", sym, sym);
             }
 
-        printf("%s ", buf);                             // print summary of this block
         line++;                                         // count up to 16 blocks per line
         if(line>=16)                                    // at end of line
             {
@@ -80,3 +121,118 @@ void summary(   unsigned char *mem,                     // start of memory regio
         }
     }
 
+
+// A snapshot of memory, a 16 bit hash of each block, to find the blocks that change.
+// Two different contents of a block have the same hash once in 65536 times, so a change can be missed, rarely.
+
+static const unsigned SNAP_BLOCKS = 64;                 // enough for 32K of RAM in 512 byte blocks
+
+static uint16_t snap_hash[SNAP_BLOCKS];
+static unsigned char *snap_mem = 0;                     // the memory in the snapshot
+static unsigned snap_size;
+static unsigned snap_inc;                               // the block size
+
+
+static uint16_t block_hash(const unsigned char *mem, unsigned size)
+    {
+    const uint32_t *words = (const uint32_t *)mem;
+    uint32_t h = 2166136261u;
+
+    for(unsigned j=0; j<size/4; j++)
+        {
+        h = (h ^ words[j]) * 16777619u;
+        }
+
+    return h ^ (h >> 16);
+    }
+
+
+// hash each block of a word aligned area of memory
+// The block size is at least a word, and is doubled until the blocks fit in the table.
+void summary_snap(unsigned char *mem, unsigned size, unsigned inc)
+    {
+    mem = (unsigned char *)((uintptr_t)mem & ~(uintptr_t)3);
+    size &= ~3u;
+    inc = (inc + 3) & ~3u;
+    if(inc == 0)                                        // 0, or so big it wrapped
+        {
+        inc = 4;
+        }
+    while((size + inc - 1) / inc > SNAP_BLOCKS)
+        {
+        inc *= 2;
+        }
+
+    snap_mem = mem;
+    snap_size = size;
+    snap_inc = inc;
+    for(unsigned i=0, n=0; i<size; i += inc, n++)
+        {
+        snap_hash[n] = block_hash(&mem[i], i + inc <= size ? inc : size - i);
+        }
+
+    printf("snapshot of %08zx-%08zx in %u byte blocks\n", (uintptr_t)mem, (uintptr_t)(mem + size), inc);
+    }
+
+
+// print the blocks that have changed since the snapshot, and a count of them by region
+// The stack of the thread doing the diff has always changed.
+void summary_diff()
+    {
+    static const char types[] = "DBHS#T";
+    static const char *const names[] = {".data", ".bss", "heap", "stack", "other", ".text"};
+    unsigned counts[sizeof(types) - 1] = {};
+    int line = 0;
+
+    if(snap_mem == 0)
+        {
+        printf("no snapshot, use \"sum snap\" first\n");
+        return;
+        }
+
+    for(unsigned i=0, n=0; i<snap_size; i += snap_inc, n++)
+        {
+        if(line == 0)
+            {
+            printf("%08zx: ", (uintptr_t)(snap_mem+i));
+            }
+
+        if(block_hash(&snap_mem[i], i + snap_inc <= snap_size ? snap_inc : snap_size - i) == snap_hash[n])
+            {
+            printf(".. ");
+            }
+        else
+            {
+            char sym = region(&snap_mem[i]);
+            for(unsigned t=0; types[t]; t++)
+                {
+                if(types[t] == sym)
+                    {
+                    ++counts[t];
+                    }
+                }
+            printf("%c%c ", sym, sym);
+            }
+
+        if(++line >= 16)
+            {
+            printf("\n");
+            line = 0;
+            }
+        }
+
+    if(line != 0)
+        {
+        printf("\n");
+        }
+
+    printf("changed blocks of %u bytes:", snap_inc);
+    for(unsigned t=0; types[t]; t++)
+        {
+        if(counts[t])
+            {
+            printf(" %s %u", names[t], counts[t]);
+            }
+        }
+    printf("\n");
+    }
@@ -0,0 +1,86 @@
+// taskloop.cpp
+//
+// Compare "taskloop" with "parallel for" on a loop whose iterations have uneven cost.
+//
+// Iteration i hashes a word i*COST/n+1 times, so the last iterations cost COST times as
+// much as the first. A static "parallel for" gives each thread an equal number of iterations,
+// so the thread with the last block does most of the work. The taskloop splits the loop into
+// chunks that are claimed by whichever thread is free.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+
+static const int COST = 64;                 // the cost of the last iteration relative to the first
+
+
+// the work done by one iteration
+static inline uint32_t work(int i, int n)
+    {
+    uint32_t x = i;
+
+    for(int k = (int)((int64_t)i*COST/n); k >= 0; --k)
+        {
+        x ^= x >> 16;
+        x *= 0x7FEB352D;
+        x ^= x >> 15;
+        }
+
+    return x;
+    }
+
+
+// sum the work over n iterations with a taskloop
+// grainsize is the minimum number of iterations per chunk, 0 for the default (one chunk per thread)
+long taskloop_sum(int n, int grainsize)
+    {
+    uint32_t sum = 0;
+
+    #pragma omp parallel
+    #pragma omp single nowait                   // the other threads go straight to running the chunks
+        {
+        if(grainsize)
+            {
+            #pragma omp taskloop grainsize(grainsize)
+            for(int i=0; i<n; i++)
+                {
+                uint32_t x = work(i, n);
+                #pragma omp atomic
+                sum += x;
+                }
+            }
+        else
+            {
+            #pragma omp taskloop
+            for(int i=0; i<n; i++)
+                {
+                uint32_t x = work(i, n);
+                #pragma omp atomic
+                sum += x;
+                }
+            }
+        }
+
+    return sum;
+    }
+
+
+// sum the work over n iterations with a parallel for
+long parallel_for_sum(int n)
+    {
+    uint32_t sum = 0;
+
+    #pragma omp parallel for
+    for(int i=0; i<n; i++)
+        {
+        uint32_t x = work(i, n);
+        #pragma omp atomic
+        sum += x;
+        }
+
+    return sum;
+    }
@@ -0,0 +1,72 @@
+// threadprivate.cpp
+//
+// Test and time "#pragma omp threadprivate" variables.
+//
+// Each thread of a team counts to n in its own copy of a threadprivate counter, with a barrier
+// halfway so the threads take turns and the counters must survive the thread switches. For
+// comparison the same count is kept in a shared array indexed by the thread number, which is
+// what code has to do without thread local storage. The increments are in functions that are
+// not inlined, so every increment looks up the variable again.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <omp.h>
+#include "cmsis.h"
+
+static int counter;                         // each thread has its own copy
+#pragma omp threadprivate(counter)
+
+static int counters[16];                    // one element per thread in the team
+
+
+static __NOINLINE void count_private()
+    {
+    counter++;
+    }
+
+static __NOINLINE void count_shared()
+    {
+    counters[omp_get_thread_num()]++;
+    }
+
+
+// count to n in each thread of a team, in a threadprivate variable or in a shared array
+// returns the number of threads whose count came out right
+int threadprivate_test(int n, bool shared)
+    {
+    int good = 0;
+
+    #pragma omp parallel
+        {
+        int id = omp_get_thread_num();
+
+        counter = 0;
+        counters[id] = 0;
+
+        for(int i=0; i<n/2; i++)
+            {
+            if(shared)count_shared();
+            else count_private();
+            }
+
+        #pragma omp barrier
+
+        for(int i=n/2; i<n; i++)
+            {
+            if(shared)count_shared();
+            else count_private();
+            }
+
+        if((shared ? counters[id] : counter) == n)
+            {
+            #pragma omp atomic
+            good++;
+            }
+        }
+
+    return good;
+    }
@@ -25,6 +25,7 @@
 
 /* USER CODE BEGIN INCLUDE */
 
+#include <string.h>
 #include "cmsis.h"
 
 /* USER CODE END INCLUDE */
@@ -38,8 +39,42 @@
 
 static int vcp_init_complete = 0;
 
-static uint8_t *xmit_Buf2 = 0;
-static uint16_t xmit_Len2 = 0;
+// The transmit ring. Writers reserve space at its head with vcp_reserve, fill it in place, and
+// hand it over with vcp_commit. The committed bytes are sent in transfers of up to VCP_TX_MAX
+// bytes, and the transfer complete callback starts the next at once, so USB sends one part of
+// the ring while the writers fill another, and nothing is copied on the way.
+//
+// tx_head is only moved by the writers, and tx_tail and tx_flight only by the USB interrupt, or
+// with interrupts off.
+
+static uint8_t vcp_tx_ring[VCP_TX_RING];
+_Static_assert((VCP_TX_RING & (VCP_TX_RING-1)) == 0, "VCP_TX_RING must be a power of 2");     // the free running indexes wrap with it
+static volatile uint32_t tx_head = 0;           // the end of the committed bytes, free running
+static volatile uint32_t tx_tail = 0;           // the first byte not yet sent, free running
+static volatile uint32_t tx_flight = 0;         // bytes in the transfer in progress, from tx_tail
+
+uint32_t vcp_tx_transfers = 0;                  // USB transfers started
+uint32_t vcp_tx_bytes = 0;                      // and the bytes in them
+
+// The receive ring. Each packet is copied into it from UserRxBufferFS, and the OUT endpoint is
+// only made ready for the next when the ring has room for a whole packet, so when the readers
+// fall behind USB makes the host wait, with NAKs, rather than anything being lost.
+//
+// rx_head is only moved by the USB interrupt, and rx_tail by the readers.
+
+static uint8_t vcp_rx_ring[VCP_RX_RING];
+_Static_assert((VCP_RX_RING & (VCP_RX_RING-1)) == 0, "VCP_RX_RING must be a power of 2");
+_Static_assert(VCP_RX_RING >= APP_RX_DATA_SIZE, "VCP_RX_RING must hold a packet");
+static volatile uint32_t rx_head = 0;           // the end of the bytes received, free running
+static volatile uint32_t rx_tail = 0;           // the next byte to read, free running
+static volatile int rx_armed = 0;               // the OUT endpoint is ready for a packet
+
+uint32_t vcp_rx_stalls = 0;                     // times the host was held off for want of room
+
+// While a consumer is set, packets are handed to it instead of going in the ring. It returns
+// whether it can take another, and if not, the endpoint waits for vcp_rx_ready.
+static uint32_t (*rx_consumer)(uint8_t *buf, uint32_t len) = 0;
+static volatile int rx_consumer_ready = 0;
 
 /* USER CODE END PV */
 
@@ -120,7 +155,8 @@ extern USBD_HandleTypeDef hUsbDeviceFS;
 /* USER CODE BEGIN EXPORTED_VARIABLES */
 
 extern void vcp_tx_callback();
-extern void vcp_rx_callback(uint8_t *Buf, uint32_t Len);
+extern uint32_t vcp_rx_filter(uint8_t *Buf, uint32_t Len);
+extern void vcp_rx_callback();
 
 /* USER CODE END EXPORTED_VARIABLES */
 
@@ -141,6 +177,9 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
 
+static void vcp_tx_start(void);
+static void vcp_rx_arm(void);
+
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
 /**
@@ -168,6 +207,12 @@ static int8_t CDC_Init_FS(void)
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
 
+  tx_tail += tx_flight;                         // a transfer cut off by a reset is not completed, drop it
+  tx_flight = 0;                                // the rest is sent by the next commit
+
+  rx_tail = rx_head;                            // input from before the reset is stale
+  rx_armed = 1;                                 // the class makes the OUT endpoint ready when this returns
+
   vcp_init_complete = 1;
 
   return (USBD_OK);
@@ -277,10 +322,34 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-    vcp_rx_callback(Buf, *Len);
+  if(rx_consumer)
+      {
+      rx_consumer_ready = rx_consumer(Buf, *Len);
+      rx_armed = 0;
+      vcp_rx_arm();
+      if(!rx_armed)
+          {
+          ++vcp_rx_stalls;
+          }
+      return (USBD_OK);
+      }
+
+  uint32_t len = vcp_rx_filter(Buf, *Len);      // the characters the console acts on at once are taken out
+  uint32_t offset = rx_head % VCP_RX_RING;
+  uint32_t first = VCP_RX_RING - offset < len ? VCP_RX_RING - offset : len;
+
+  memcpy(&vcp_rx_ring[offset], Buf, first);     // there is room, or the endpoint wouldn't have been ready
+  memcpy(&vcp_rx_ring[0], Buf + first, len - first);
+  COMPILER_BARRIER();                           // the bytes are in before a reader can see them
+  rx_head += len;
 
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  rx_armed = 0;
+  vcp_rx_arm();
+  if(!rx_armed)
+      {
+      ++vcp_rx_stalls;
+      }
+  vcp_rx_callback();
   return (USBD_OK);
   /* USER CODE END 6 */
 }
@@ -300,16 +369,30 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf1, uint16_t Len1, uint8_t* Buf2, uint16_t Le
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
-  if(!vcp_txready())
+  // Copy both buffers into the transmit ring, or neither if there isn't room for them. This
+  // writes at the head of the ring, so it must not be used while a writer has filled reserved
+  // space it has not yet committed.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if(VCP_TX_RING - (tx_head - tx_tail) < (uint32_t)Len1 + Len2)
       {
-      return USBD_BUSY;
+      result = USBD_BUSY;
+      }
+  else
+      {
+      for(uint32_t i=0; i<Len1; i++)
+          {
+          vcp_tx_ring[(tx_head + i) % VCP_TX_RING] = Buf1[i];
+          }
+      for(uint32_t i=0; i<Len2; i++)
+          {
+          vcp_tx_ring[(tx_head + Len1 + i) % VCP_TX_RING] = Buf2[i];
+          }
+      vcp_commit(Len1 + Len2);
       }
 
-  xmit_Buf2 = Buf2;
-  xmit_Len2 = Len2;
-
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf1, Len1);
-  result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+  __set_PRIMASK(primask);
   /* USER CODE END 7 */
   return result;
 }
@@ -334,17 +417,10 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   UNUSED(Len);
   UNUSED(epnum);
 
-  if(xmit_Buf2)
-      {
-      USBD_CDC_SetTxBuffer(&hUsbDeviceFS, xmit_Buf2, xmit_Len2);
-      USBD_CDC_TransmitPacket(&hUsbDeviceFS);
-      xmit_Buf2 = 0;
-      xmit_Len2 = 0;
-      }
-  else
-      {
-      vcp_tx_callback();
-      }
+  tx_tail += tx_flight;                         // the space of the transfer is free
+  tx_flight = 0;
+  vcp_tx_start();                               // send whatever was committed meanwhile, before anyone is woken
+  vcp_tx_callback();
 
   /* USER CODE END 13 */
   return result;
@@ -359,6 +435,185 @@ void vcp_init ()
         }
     }
 
+
+// Start a transfer of the committed bytes, if there are any and no transfer is in progress. It
+// is called with interrupts off, or from the USB interrupt.
+static void vcp_tx_start(void)
+    {
+    if(tx_flight != 0 || tx_head == tx_tail || !vcp_init_complete)
+        {
+        return;
+        }
+
+    uint32_t offset = tx_tail % VCP_TX_RING;
+    uint32_t n = tx_head - tx_tail;
+
+    if(n > VCP_TX_RING - offset)                // up to the end of the ring, the rest is the next transfer
+        {
+        n = VCP_TX_RING - offset;
+        }
+    if(n > VCP_TX_MAX)
+        {
+        n = VCP_TX_MAX;
+        }
+
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, &vcp_tx_ring[offset], n);
+    if(USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
+        {
+        return;                                 // not configured yet, the next commit tries again
+        }
+
+    // The host takes a transfer that is a whole number of packets to continue until a short
+    // packet, so the class ends one with a zero length packet. When more is committed the next
+    // transfer follows at once and ends it instead, and the zero length packet would only waste a
+    // turn on the bus.
+    if(tx_head - tx_tail > n)
+        {
+        hUsbDeviceFS.ep_in[CDC_IN_EP & 0xFU].total_length = 0;
+        }
+
+    tx_flight = n;
+    ++vcp_tx_transfers;
+    vcp_tx_bytes += n;
+    }
+
+
+// Return the free space at the head of the transmit ring, and its length in *len. The space is
+// contiguous, so it may be less than all that is free where the ring wraps, and *len is 0 when
+// the ring is full. The space can be filled at leisure, since only a commit sends it.
+uint8_t *vcp_reserve(uint32_t *len)
+    {
+    uint32_t head = tx_head;
+    uint32_t offset = head % VCP_TX_RING;
+    uint32_t free = VCP_TX_RING - (head - tx_tail);
+
+    *len = free < VCP_TX_RING - offset ? free : VCP_TX_RING - offset;
+    return &vcp_tx_ring[offset];
+    }
+
+
+// Send the first len bytes of the reserved space. A commit of 0 bytes starts a transfer of what
+// is waiting, if USB was not ready when it was committed.
+void vcp_commit(uint32_t len)
+    {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    tx_head += len;
+    vcp_tx_start();
+    __set_PRIMASK(primask);
+    }
+
+
+// Drop the committed bytes that are not in the transfer in progress, and return how many.
+uint32_t vcp_txdiscard(void)
+    {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    uint32_t dropped = tx_head - (tx_tail + tx_flight);
+    tx_head = tx_tail + tx_flight;
+    __set_PRIMASK(primask);
+
+    return dropped;
+    }
+
+
+// the bytes committed and not yet sent, including the transfer in progress
+uint32_t vcp_txpending(void)
+    {
+    return tx_head - tx_tail;
+    }
+
+
+// whether a transfer is in progress
+int vcp_txbusy(void)
+    {
+    return tx_flight != 0;
+    }
+
+
+// Make the OUT endpoint ready for another packet, if the receive ring has room for it and it isn't
+// ready already. It is called with interrupts off, or from the USB interrupt.
+static void vcp_rx_arm(void)
+    {
+    if(rx_armed)
+        {
+        return;
+        }
+    if(rx_consumer ? !rx_consumer_ready : VCP_RX_RING - (rx_head - rx_tail) < APP_RX_DATA_SIZE)
+        {
+        return;                                 // USB NAKs the host until a reader makes room
+        }
+
+    rx_armed = 1;
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+    }
+
+
+// Take up to n bytes from the receive ring, returns how many there were. This doesn't wait.
+uint32_t vcp_read(uint8_t *buf, uint32_t n)
+    {
+    uint32_t tail = rx_tail;
+    uint32_t count = rx_head - tail;
+    uint32_t offset = tail % VCP_RX_RING;
+
+    if(n > count)
+        {
+        n = count;
+        }
+
+    uint32_t first = VCP_RX_RING - offset < n ? VCP_RX_RING - offset : n;
+
+    memcpy(buf, &vcp_rx_ring[offset], first);
+    memcpy(buf + first, &vcp_rx_ring[0], n - first);
+
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    rx_tail = tail + n;
+    vcp_rx_arm();
+    __set_PRIMASK(primask);
+
+    return n;
+    }
+
+
+// the bytes waiting in the receive ring
+uint32_t vcp_rxcount(void)
+    {
+    return rx_head - rx_tail;
+    }
+
+
+// Hand each packet from the host to consumer, straight from the USB packet buffer, instead of
+// putting it in the receive ring, or go back to the ring if consumer is 0. The consumer is called
+// from the USB interrupt, and returns whether it can take another packet. If it can't, the host
+// is held off until vcp_rx_ready is called.
+void vcp_rx_divert(uint32_t (*consumer)(uint8_t *buf, uint32_t len))
+    {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    rx_consumer = consumer;
+    rx_consumer_ready = 1;
+    vcp_rx_arm();
+    __set_PRIMASK(primask);
+    }
+
+
+// the consumer can take another packet
+void vcp_rx_ready(void)
+    {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    rx_consumer_ready = 1;
+    vcp_rx_arm();
+    __set_PRIMASK(primask);
+    }
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -54,6 +54,14 @@
 #define APP_TX_DATA_SIZE  0
 /* USER CODE BEGIN EXPORTED_DEFINES */
 
+#ifndef VCP_TX_RING
+#define VCP_TX_RING 1024                // bytes of the transmit ring, a power of two, see usbd_cdc_if.c
+#endif
+#define VCP_TX_MAX 512                  // the most bytes sent in one transfer, a multiple of the 64 byte packet
+#ifndef VCP_RX_RING
+#define VCP_RX_RING 512                 // bytes of the receive ring, a power of two of at least a packet, see usbd_cdc_if.c
+#endif
+
 /* USER CODE END EXPORTED_DEFINES */
 
 /**
@@ -97,6 +105,9 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 /* USER CODE BEGIN EXPORTED_VARIABLES */
 
 extern USBD_HandleTypeDef hUsbDeviceFS;
+extern uint32_t vcp_tx_transfers;       // USB transfers started from the transmit ring
+extern uint32_t vcp_tx_bytes;           // and the bytes in them
+extern uint32_t vcp_rx_stalls;          // times the host was held off because the receive ring was full
 
 /* USER CODE END EXPORTED_VARIABLES */
 
@@ -114,6 +125,16 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf1, uint16_t Len1, uint8_t* Buf2, uint16_t Le
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
 
 void vcp_init ();
+uint8_t *vcp_reserve(uint32_t *len);    // the contiguous free space at the head of the transmit ring
+void vcp_commit(uint32_t len);          // send the first len bytes of it
+uint32_t vcp_txdiscard(void);           // drop the committed bytes not yet being sent
+uint32_t vcp_txpending(void);           // committed bytes not yet sent
+int vcp_txbusy(void);                   // a transfer is in progress
+void vcp_txwait(void);                  // wait for the transfer in progress to complete, see serial.cpp
+uint32_t vcp_read(uint8_t *buf, uint32_t n);    // take up to n bytes from the receive ring, without waiting
+uint32_t vcp_rxcount(void);             // bytes waiting in the receive ring
+void vcp_rx_divert(uint32_t (*consumer)(uint8_t *buf, uint32_t len));   // hand packets to consumer instead, or 0 for the ring
+void vcp_rx_ready(void);                // the consumer can take another packet
 
 static inline int vcp_txready()
     {
@@ -0,0 +1,69 @@
+// background.cpp -- host port
+//
+// On the target, background() becomes OpenMP thread 0 at powerup, starts a team in which
+// thread 0 runs the background polling loop and the other members run the temperature monitor
+// and the command interpreter. On the host, main() does the same thing, except that the
+// second team member runs the test program instead of the interpreter.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "context.hpp"
+#include "ContextFIFO.hpp"
+#include "libgomp.hpp"
+#include "gomp_trace.hpp"
+#include "tim.h"
+
+ContextFIFO DeferFIFO;                      // the DeferFIFO used by yield
+TIM_HandleTypeDef htim2;                    // the microsecond timer, see tim.h
+uint32_t _stack_start, _stack_end;          // the linker script symbols libgomp uses for thread 0's stack
+
+// the firmware's malloc keeps statistics per call site, the host's does not
+extern "C" void *malloc_at(size_t size, void *)
+    {
+    return malloc(size);
+    }
+
+extern int omptest(int argc, char **argv);
+
+static volatile bool done = false;
+static int status = 0;
+
+int main(int argc, char **argv)
+    {
+    libgomp_init();                                     // init the OpenMP threading system, including setting main as thread 0
+
+#if GOMP_TRACE
+    if(getenv("GOMP_TRACE") == 0)                       // reading the clock costs much more on a PC than CYCCNT does on the target,
+        {                                               // so the trace recorder is off unless asked for, to keep the timings comparable
+        gomp_tool_callback = 0;
+        }
+#endif
+
+    #pragma omp parallel num_threads(2)
+    if(omp_get_thread_num() == 0)                       // thread 0 runs the background polling loop
+        {
+        while(!done)
+            {
+            gomp_poll_threads();                        // wake any OpenMP threads that have work to do
+
+            if(DeferFIFO)                               // if anything on the DeferFIFO
+                {
+                undefer();                              // wake any threads that called yield
+                }
+            }
+
+        exit(status);                                   // thread 0 must never suspend, so exit from here
+        }
+    else                                                // and thread 1 runs the tests
+        {
+        status = omptest(argc, argv);
+        done = true;
+        }
+
+    return 0;
+    }
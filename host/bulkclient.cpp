@@ -0,0 +1,594 @@
+// bulkclient.cpp
+//
+// The Linux end of the binary protocol of Core/Inc/bulk.hpp. It types the "bulk" command at the
+// target's console, waits for the HELLO, makes one request, and sends EXIT, which gives the link
+// back to the console. Memory is read and written at the target's addresses, and files are the
+// target's FatFs paths, such as 0:/data.bin.
+//
+// A lost request is sent again after a silence of five times BULK_RESEND, which is long enough
+// that the target would have been heard from if it had the request. If it did, it gives up the
+// first when the second comes, with an END that says ABORTED, which is ignored.
+//
+// usage: bulk [-d <device>] read <address> <length> <file>     read memory into a file
+//        bulk [-d <device>] write <address> <file>             write a file into memory
+//        bulk [-d <device>] get <remote> <local>               read a file
+//        bulk [-d <device>] put <local> <remote>               write a file
+//
+// The device is /dev/ttyACM0 if not given. Addresses and lengths may be decimal or 0x hex.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <vector>
+#include "bulk.hpp"
+
+
+// a frame from the target
+struct Frame
+    {
+    unsigned type;
+    unsigned seq;
+    std::vector<uint8_t> payload;
+    bool good;                              // the CRC matched
+    };
+
+static const unsigned MAX_PATH = 64;       // the longest path the target takes, _MAX_LFN of its FatFs
+
+static int fd = -1;
+static std::vector<uint8_t> in;             // bytes received, not yet made frames
+static std::vector<uint8_t> out;            // frames not yet written
+static uint64_t heard_at = 0;               // when bytes last came
+static unsigned window = BULK_SLOTS;        // frames the target can hold, from its HELLO
+static unsigned payload = BULK_PAYLOAD;     // and the size of a DATA frame
+
+static uint64_t usec()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+    }
+
+static void fail(const char *message)
+    {
+    fprintf(stderr, "bulk: %s\n", message);
+    exit(1);
+    }
+
+
+// write what can be written, and read what has come, waiting up to timeout microseconds for either
+static void pump(uint64_t timeout)
+    {
+    struct pollfd p = {fd, (short)(POLLIN | (out.empty() ? 0 : POLLOUT)), 0};
+
+    if(poll(&p, 1, (int)((timeout + 999) / 1000)) < 0 && errno != EINTR)
+        {
+        fail("poll failed");
+        }
+
+    if(p.revents & POLLOUT)
+        {
+        ssize_t n = write(fd, out.data(), out.size());
+
+        if(n > 0)
+            {
+            out.erase(out.begin(), out.begin() + n);
+            }
+        }
+    if(p.revents & POLLIN)
+        {
+        uint8_t buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+
+        if(n > 0)
+            {
+            uint64_t now = usec();
+
+            if(now - heard_at >= BULK_RESEND)
+                {
+                in.clear();                 // the rest of a frame cut short, or of noise that looked like one
+                }
+            heard_at = now;
+            in.insert(in.end(), buf, buf + n);
+            }
+        }
+    if(p.revents & (POLLERR | POLLHUP))
+        {
+        fail("the device went away");
+        }
+    }
+
+
+static void send_frame(unsigned type, unsigned seq, const void *data = 0, uint32_t length = 0)
+    {
+    uint8_t header[BULK_HEADER];
+    uint8_t trailer[BULK_TRAILER];
+
+    bulk_header(header, type, seq, length);
+    bulk_put32(trailer, bulk_crc(bulk_crc(0, header, BULK_HEADER), data, length));
+
+    out.insert(out.end(), header, header + BULK_HEADER);
+    out.insert(out.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+    out.insert(out.end(), trailer, trailer + BULK_TRAILER);
+    pump(0);
+    }
+
+
+// take a frame from what has been received, skipping what isn't one
+static bool parse(Frame &f)
+    {
+    size_t i = 0;
+    bool found = false;
+
+    while(i < in.size())
+        {
+        if(in[i] != BULK_MAGIC)
+            {
+            ++i;
+            continue;
+            }
+        if(in.size() - i < BULK_HEADER)
+            {
+            break;
+            }
+        if(!bulk_header_ok(&in[i]))
+            {
+            ++i;
+            continue;
+            }
+
+        uint32_t length = bulk_get16(&in[i + 3]);
+
+        if(in.size() - i < BULK_HEADER + length + BULK_TRAILER)
+            {
+            break;
+            }
+
+        f.type = in[i + 1];
+        f.seq = in[i + 2];
+        f.payload.assign(&in[i + BULK_HEADER], &in[i + BULK_HEADER + length]);
+        f.good = bulk_crc(0, &in[i], BULK_HEADER + length) == bulk_get32(&in[i + BULK_HEADER + length]);
+        i += BULK_HEADER + length + BULK_TRAILER;
+        found = true;
+        break;
+        }
+
+    in.erase(in.begin(), in.begin() + i);
+    return found;
+    }
+
+// wait up to timeout microseconds for a frame
+static bool next_frame(Frame &f, uint64_t timeout)
+    {
+    uint64_t deadline = usec() + timeout;
+
+    while(!parse(f))
+        {
+        uint64_t now = usec();
+        uint64_t left = now < deadline ? deadline - now : 0;
+
+        pump(left);
+        if(left == 0)
+            {
+            return parse(f);
+            }
+        }
+    return true;
+    }
+
+
+// the END that answers a request
+struct End
+    {
+    uint32_t status;
+    uint32_t count;
+    };
+
+static bool is_end(const Frame &f, End &end)
+    {
+    if(f.good && f.type == BULK_END && f.payload.size() == 8)
+        {
+        end.status = bulk_get32(&f.payload[0]);
+        end.count = bulk_get32(&f.payload[4]);
+        return true;
+        }
+    return false;
+    }
+
+
+// Make a request whose data the target sends, and take the data into got.
+static End receive_request(unsigned type, const std::vector<uint8_t> &request, std::vector<uint8_t> &got)
+    {
+    uint32_t expected = 0;                  // the number of the next DATA frame
+    bool naked = false;                     // a NAK has been sent for it
+    unsigned last = 0xFF;                   // the number of the frame before
+    unsigned again = 0;                     // times the request was sent again
+    uint64_t heard = usec();
+    End end;
+    Frame f;
+
+    send_frame(type, 0, request.data(), request.size());
+
+    while(true)
+        {
+        if(!next_frame(f, BULK_RESEND))
+            {
+            if(usec() - heard < 5 * BULK_RESEND)
+                {
+                continue;
+                }
+            if(expected || ++again > BULK_TRIES)
+                {
+                fail("the target stopped answering");
+                }
+            send_frame(type, 0, request.data(), request.size());
+            heard = usec();
+            continue;
+            }
+
+        heard = usec();
+        if(is_end(f, end))
+            {
+            if(end.status == BULK_ABORTED && again)
+                {
+                continue;
+                }
+            return end;
+            }
+
+        if(f.good && f.type != BULK_DATA)
+            {
+            continue;
+            }
+
+        if(f.good && f.seq == (expected & 0xFF))
+            {
+            got.insert(got.end(), f.payload.begin(), f.payload.end());
+            ++expected;
+            naked = false;
+            send_frame(BULK_ACK, f.seq);
+            }
+        else if(f.good && ((expected - f.seq - 1) & 0xFF) < BULK_WINDOW * 2 && expected)
+            {
+            send_frame(BULK_ACK, expected - 1);         // one already taken, the target went back
+            }
+        else if(!naked || f.seq != ((last + 1) & 0xFF))    // the first out of order, or the target went back and lost it again
+            {
+            send_frame(BULK_NAK, expected);
+            naked = true;
+            }
+        last = f.seq;
+        }
+    }
+
+
+// Make a request whose data is sent to the target, going back N on a NAK or a silence.
+static End send_request(unsigned type, const std::vector<uint8_t> &request, const std::vector<uint8_t> &data)
+    {
+    uint32_t frames = (data.size() + payload - 1) / payload;
+    uint32_t base = 0;                      // the oldest frame not acknowledged
+    uint32_t next = 0;                      // the next frame to send
+    bool again = false;
+    unsigned tries = 0;
+    uint64_t heard = usec();
+    uint64_t asked = heard;                 // when the request was sent
+    End end;
+    Frame f;
+
+    send_frame(type, 0, request.data(), request.size());
+
+    while(true)
+        {
+        // the request holds one of the target's slots until the first ACK
+        while(next < frames && next - base + (base == 0) < window && out.size() < 2 * payload)
+            {
+            uint32_t offset = next * payload;
+            uint32_t n = data.size() - offset < payload ? data.size() - offset : payload;
+
+            send_frame(BULK_DATA, next & 0xFF, &data[offset], n);
+            ++next;
+            }
+
+        if(!next_frame(f, 1000))
+            {
+            uint64_t now = usec();
+
+            if(now - heard < BULK_RESEND)
+                {
+                continue;
+                }
+            if(++tries > BULK_TRIES)
+                {
+                fail("the target stopped answering");
+                }
+            if(base == 0 && now - asked >= 5 * BULK_RESEND)
+                {
+                send_frame(type, 0, request.data(), request.size());
+                again = true;
+                asked = now;
+                }
+            next = base;
+            heard = now;
+            continue;
+            }
+
+        if(is_end(f, end))
+            {
+            if(end.status == BULK_ABORTED && again)
+                {
+                continue;
+                }
+            return end;
+            }
+
+        if(f.good && (f.type == BULK_ACK || f.type == BULK_NAK))
+            {
+            uint32_t advance = ((f.type == BULK_ACK ? f.seq + 1 : f.seq) - base) & 0xFF;
+
+            if(advance <= next - base)
+                {
+                base += advance;
+                if(advance)
+                    {
+                    heard = usec();
+                    tries = 0;
+                    }
+                if(f.type == BULK_NAK)
+                    {
+                    next = base;
+                    }
+                }
+            }
+        }
+    }
+
+
+// type "bulk" at the console, and wait for the target's HELLO
+static void connect(const char *device)
+    {
+    struct termios t;
+
+    fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(fd < 0)
+        {
+        fprintf(stderr, "bulk: can't open %s\n", device);
+        exit(1);
+        }
+    if(tcgetattr(fd, &t) == 0)
+        {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+        }
+    tcflush(fd, TCIFLUSH);
+
+    const char command[] = "\rbulk\r";
+
+    out.insert(out.end(), command, command + strlen(command));
+
+    for(unsigned tries=0; tries<BULK_TRIES; tries++)
+        {
+        uint64_t deadline = usec() + 5 * BULK_RESEND;
+        Frame f;
+
+        while(next_frame(f, deadline > usec() ? deadline - usec() : 0))
+            {
+            if(f.good && f.type == BULK_HELLO && f.payload.size() >= 4)
+                {
+                if(f.payload[0] != BULK_VERSION)
+                    {
+                    fail("the target speaks another version of the protocol");
+                    }
+                window = f.payload[1];
+                payload = bulk_get16(&f.payload[2]);
+                if(window < 2 || window > BULK_WINDOW || payload == 0 || payload > BULK_PAYLOAD)
+                    {
+                    fail("the target's HELLO makes no sense");
+                    }
+                return;
+                }
+            }
+        send_frame(BULK_HELLO, 0);                      // in case it is already in the mode
+        }
+    fail("no HELLO from the target");
+    }
+
+static void disconnect()
+    {
+    for(unsigned tries=0; tries<BULK_TRIES; tries++)
+        {
+        uint64_t deadline = usec() + 5 * BULK_RESEND;
+        End end;
+        Frame f;
+
+        send_frame(BULK_EXIT, 0);
+        while(next_frame(f, deadline > usec() ? deadline - usec() : 0))
+            {
+            if(is_end(f, end))
+                {
+                while(!out.empty())
+                    {
+                    pump(BULK_RESEND);
+                    }
+                close(fd);
+                return;
+                }
+            }
+        }
+    fail("the target didn't answer EXIT");
+    }
+
+
+static void check(const End &end, uint32_t expected)
+    {
+    switch(end.status)
+        {
+    case BULK_OK:
+        if(end.count == expected)
+            {
+            return;
+            }
+        fprintf(stderr, "bulk: the target moved %u bytes of %u\n", end.count, expected);
+        break;
+    case BULK_BAD_REQUEST:
+        fprintf(stderr, "bulk: the target refused the request\n");
+        break;
+    case BULK_TIMEOUT:
+        fprintf(stderr, "bulk: the target timed out, after %u bytes\n", end.count);
+        break;
+    case BULK_ABORTED:
+        fprintf(stderr, "bulk: the target gave up, after %u bytes\n", end.count);
+        break;
+    case BULK_BAD_ADDRESS:
+        fprintf(stderr, "bulk: the target has no such memory, or it can't be written\n");
+        break;
+    default:
+        fprintf(stderr, "bulk: FatFs error %u on the target, after %u bytes\n", end.status - BULK_FILE, end.count);
+        break;
+        }
+    disconnect();                               // give the link back to the console
+    exit(1);
+    }
+
+static std::vector<uint8_t> read_file(const char *path)
+    {
+    FILE *f = fopen(path, "rb");
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+
+    if(f == 0)
+        {
+        fprintf(stderr, "bulk: can't read %s\n", path);
+        exit(1);
+        }
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        {
+        data.insert(data.end(), buf, buf + n);
+        }
+    fclose(f);
+    return data;
+    }
+
+static void write_file(const char *path, const std::vector<uint8_t> &data)
+    {
+    FILE *f = fopen(path, "wb");
+
+    if(f == 0 || fwrite(data.data(), 1, data.size(), f) != data.size() || fclose(f) != 0)
+        {
+        fprintf(stderr, "bulk: can't write %s\n", path);
+        exit(1);
+        }
+    }
+
+static void usage()
+    {
+    fprintf(stderr, "usage: bulk [-d <device>] read <address> <length> <file>\n"
+                    "       bulk [-d <device>] write <address> <file>\n"
+                    "       bulk [-d <device>] get <remote> <local>\n"
+                    "       bulk [-d <device>] put <local> <remote>\n");
+    exit(1);
+    }
+
+
+int main(int argc, char **argv)
+    {
+    const char *device = "/dev/ttyACM0";
+
+    if(argc >= 3 && strcmp(argv[1], "-d") == 0)
+        {
+        device = argv[2];
+        argc -= 2;
+        argv += 2;
+        }
+    if(argc < 2)
+        {
+        usage();
+        }
+
+    const char *op = argv[1];
+    std::vector<uint8_t> request;
+    std::vector<uint8_t> data;
+    uint8_t word[4];
+    End end;
+
+    bool read = strcmp(op, "read") == 0 && argc == 5;
+    bool write = strcmp(op, "write") == 0 && argc == 4;
+    bool get = strcmp(op, "get") == 0 && argc == 4;
+    bool put = strcmp(op, "put") == 0 && argc == 4;
+
+    if(!read && !write && !get && !put)
+        {
+        usage();
+        }
+
+    const char *remote = get ? argv[2] : argv[3];
+
+    if((get || put) && strlen(remote) > MAX_PATH)
+        {
+        fail("the remote path is too long");
+        }
+
+    if(write || put)
+        {
+        data = read_file(put ? argv[2] : argv[3]);
+        }
+
+    connect(device);
+    uint64_t start = usec();
+
+    if(read || write)
+        {
+        bulk_put32(word, strtoul(argv[2], 0, 0));
+        request.insert(request.end(), word, word + 4);
+        bulk_put32(word, read ? strtoul(argv[3], 0, 0) : data.size());
+        request.insert(request.end(), word, word + 4);
+        }
+    else if(put)
+        {
+        bulk_put32(word, data.size());
+        request.insert(request.end(), word, word + 4);
+        }
+    if(get || put)
+        {
+        request.insert(request.end(), remote, remote + strlen(remote));
+        }
+
+    if(read)
+        {
+        end = receive_request(BULK_READ, request, data);
+        check(end, strtoul(argv[3], 0, 0));
+        }
+    else if(get)
+        {
+        end = receive_request(BULK_GET, request, data);
+        check(end, data.size());
+        }
+    else
+        {
+        end = send_request(write ? BULK_WRITE : BULK_PUT, request, data);
+        check(end, data.size());
+        }
+
+    double seconds = (usec() - start) / 1e6;
+
+    disconnect();
+
+    if(read || get)
+        {
+        write_file(read ? argv[4] : argv[3], data);
+        }
+
+    printf("%s %zu bytes in %.3f s, %.0f bytes per second\n", op, data.size(), seconds, data.size() / seconds);
+    return 0;
+    }
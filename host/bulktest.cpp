@@ -0,0 +1,255 @@
+// bulktest.cpp
+//
+// Test Core/Src/bulk.cpp, the device end of the protocol of bulk.hpp, against host/bulk, with
+// a pty standing in for the USB link. A thread reads the master in packets of 64 bytes, as the
+// USB interrupt receives them, and while bulk.cpp has diverted the link it hands each packet to
+// bulk.cpp's consumer, and reads no more until the consumer says it is ready, as the endpoint
+// is held off. Otherwise it plays the console, and each time it sees "bulk" and a return,
+// bulk_serve is called, as the command does.
+//
+// The command given is run by sh, with BULK_DEV set to the pty and BULK_ADDR to the address of
+// a 64K buffer to read and write, and the test ends when it does, with its exit status. Memory
+// outside the buffer is refused, as the target refuses memory outside its RAM and flash.
+//
+// BULK_LOSS=<n> drops about one in n of the packets to the device, and damages one in n of the
+// DATA frames from it, so that the protocol's recovery is tested too.
+//
+// The program is linked without PIE, so the buffer has an address that fits the 32 bits of a
+// request.
+//
+// usage: bulktest <command>
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "local.h"
+#include "ContextFIFO.hpp"
+#include "usbd_cdc_if.h"
+#include "ff.h"
+#include "Pool.hpp"
+#include "bulk.hpp"
+
+Pool<FIL, NFILES> file_pool;                // as in interp.cpp
+
+static uint8_t memory[65536];               // what the test reads and writes with read and write
+
+static int master = -1;
+static unsigned loss = 0;                   // one in loss packets is dropped, 0 for none
+static unsigned lost = 0;
+static unsigned damaged = 0;
+
+static uint32_t (*consumer)(uint8_t *buf, uint32_t len) = 0;
+static volatile bool ready = true;          // the consumer can take a packet
+static volatile bool command = false;       // "bulk" was typed
+
+static uint8_t scratch[1024];               // where frames are made, as they are in the transmit ring
+
+
+// the console's output is written as it is made
+extern "C" void console_flush()
+    {
+    }
+
+
+// the memory that read and write may have is the buffer, rather than the target's RAM and flash
+bool bulk_addressable(uint32_t address, uint32_t length, bool)
+    {
+    uint32_t base = (uintptr_t)memory;
+
+    return address >= base && length <= sizeof(memory) && address - base <= sizeof(memory) - length;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// the USB virtual COM port, on the master of the pty
+//////////////////////////////////////////////////////////////////////////////
+
+extern "C" uint8_t *vcp_reserve(uint32_t *len)
+    {
+    *len = sizeof(scratch);
+    return scratch;
+    }
+
+extern "C" void vcp_commit(uint32_t len)
+    {
+    // The payload of a frame is committed on its own, so a commit this long is the payload of
+    // a DATA frame, rather than a header, a CRC, or an END.
+    if(loss && len >= 16 && rand() % loss == 0)
+        {
+        scratch[len / 2] ^= 0x55;
+        ++damaged;
+        }
+
+    for(uint32_t done=0; done<len; )
+        {
+        ssize_t n = write(master, scratch + done, len - done);
+
+        if(n > 0)
+            done += n;
+        else
+            yield();                        // the client hasn't read what it has
+        }
+    }
+
+extern "C" void vcp_txwait()
+    {
+    yield();
+    }
+
+// the console's input is taken by the USB thread, so there is never any left over
+extern "C" uint32_t vcp_read(uint8_t *, uint32_t)
+    {
+    return 0;
+    }
+
+extern "C" uint32_t vcp_rxcount()
+    {
+    return 0;
+    }
+
+extern "C" void vcp_rx_divert(uint32_t (*c)(uint8_t *buf, uint32_t len))
+    {
+    consumer = c;
+    ready = true;
+    }
+
+extern "C" void vcp_rx_ready()
+    {
+    ready = true;
+    }
+
+
+// plays the USB interrupt
+static uint32_t usb_thread(uintptr_t)
+    {
+    const char word[] = "bulk\r";
+    unsigned matched = 0;                   // characters of the word seen so far
+
+    while(true)
+        {
+        uint8_t packet[64];
+        ssize_t n;
+
+        if(consumer && !ready)
+            {
+            yield();
+            continue;
+            }
+
+        n = read(master, packet, sizeof(packet));
+        if(n <= 0)
+            {
+            yield();
+            continue;
+            }
+
+        if(consumer)
+            {
+            if(loss && rand() % loss == 0)
+                {
+                ++lost;
+                continue;
+                }
+            ready = consumer(packet, n);
+            continue;
+            }
+
+        for(ssize_t i=0; i<n; i++)
+            {
+            matched = packet[i] == word[matched] ? matched + 1 : packet[i] == word[0];
+            if(matched == strlen(word))
+                {
+                command = true;
+                matched = 0;
+                }
+            }
+        }
+
+    return 0;
+    }
+
+
+int omptest(int argc, char **argv)
+    {
+    static Context usb_context;
+    static char usb_stack[256];
+    char address[32];
+
+    if(argc != 2)
+        {
+        fprintf(stderr, "usage: bulktest <command>\n");
+        return 1;
+        }
+    if((uintptr_t)memory + sizeof(memory) > UINT32_MAX)
+        {
+        fprintf(stderr, "bulktest: the buffer isn't in the first 4G, link without PIE\n");
+        return 1;
+        }
+    if(getenv("BULK_LOSS"))
+        {
+        loss = atoi(getenv("BULK_LOSS"));
+        }
+    srand(1);
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+        {
+        fprintf(stderr, "bulktest: can't make a pty\n");
+        return 1;
+        }
+
+    const char *device = ptsname(master);
+    int slave = open(device, O_RDWR | O_NOCTTY);                // held open, so the master doesn't hang up between clients
+    struct termios t;
+
+    tcgetattr(slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    snprintf(address, sizeof(address), "0x%lx", (unsigned long)(uintptr_t)memory);
+    setenv("BULK_DEV", device, 1);
+    setenv("BULK_ADDR", address, 1);
+
+    pid_t child = fork();
+
+    if(child == 0)
+        {
+        close(master);
+        close(slave);
+        execl("/bin/sh", "sh", "-c", argv[1], (char *)0);
+        _exit(127);
+        }
+
+    usb_context.spawn(usb_thread, usb_stack);
+
+    int status = 0;
+
+    while(waitpid(child, &status, WNOHANG) == 0)
+        {
+        if(command)
+            {
+            command = false;
+            bulk_serve();
+            }
+        else
+            {
+            yield();
+            }
+        }
+
+    printf("bulktest: %u requests, %u frames received, %u sent, %u bad, %u dropped, %u went back, %u packets lost, %u damaged\n",
+           bulk_stats.requests, bulk_stats.received, bulk_stats.sent, bulk_stats.bad, bulk_stats.dropped,
+           bulk_stats.resent, lost, damaged);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
@@ -0,0 +1,209 @@
+// context.cpp -- host port
+// Implementation of Context, ContextFIFO, and Port for a Linux host.
+// See include/context.hpp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "context.hpp"
+#include "ContextFIFO.hpp"
+#include "Port.hpp"
+
+
+Context *host_context = 0;
+
+
+// Switch from one context to another.
+// On x86-64 the callee-saved registers are pushed on the old stack, the stack is switched,
+// and they are popped from the new stack. Other hosts use ucontext.
+
+#if defined(__x86_64__)
+
+extern "C" void host_switch(void **save, void *load);
+
+__asm__(
+"   .text                               \n"
+"   .globl  host_switch                 \n"
+"   .type   host_switch, @function      \n"
+"host_switch:                           \n"
+"   push    %rbp                        \n"
+"   push    %rbx                        \n"
+"   push    %r12                        \n"
+"   push    %r13                        \n"
+"   push    %r14                        \n"
+"   push    %r15                        \n"
+"   mov     %rsp, (%rdi)                \n"     // save the old sp
+"   mov     %rsi, %rsp                  \n"     // load the new sp
+"   pop     %r15                        \n"
+"   pop     %r14                        \n"
+"   pop     %r13                        \n"
+"   pop     %r12                        \n"
+"   pop     %rbx                        \n"
+"   pop     %rbp                        \n"
+"   ret                                 \n"
+"   .size   host_switch, .-host_switch  \n"
+);
+
+void Context::swap(Context *from, Context *to)
+    {
+    host_switch(&from->sp, to->sp);
+    }
+
+// build the initial stack of a new thread, so that the first switch to it "returns" into entry
+static void *host_initial_sp(char *stack, size_t size, void (*entry)())
+    {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    void **sp = (void **)top;
+
+    *--sp = 0;                              // fake return address of entry, so entry sees a normal call frame alignment
+    *--sp = (void *)entry;                  // popped by the ret in host_switch
+    for(int i=0; i<6; i++)
+        {
+        *--sp = 0;                          // rbp, rbx, r12-r15
+        }
+
+    return sp;
+    }
+
+#else
+
+#include <ucontext.h>
+
+void Context::swap(Context *from, Context *to)
+    {
+    if(from->sp == 0)
+        {
+        from->sp = calloc(1, sizeof(ucontext_t));
+        }
+    swapcontext((ucontext_t *)from->sp, (ucontext_t *)to->sp);
+    }
+
+static void *host_initial_sp(char *stack, size_t size, void (*entry)())
+    {
+    ucontext_t *uc = (ucontext_t *)calloc(1, sizeof(ucontext_t));
+
+    getcontext(uc);
+    uc->uc_stack.ss_sp = stack;
+    uc->uc_stack.ss_size = size;
+    uc->uc_link = 0;
+    makecontext(uc, entry, 0);
+
+    return uc;
+    }
+
+#endif
+
+
+// Suspend the current thread and run the next thread on the pending chain.
+void Context::suspend()
+    {
+    Context *self = host_context;
+
+    host_context = self->next;
+    swap(self, host_context);
+    }
+
+
+// Push the current thread onto the pending chain, and run this thread.
+void Context::resume()
+    {
+    Context *self = host_context;
+
+    next = self;
+    host_context = this;
+    swap(self, this);
+    }
+
+
+// The first code run by a new thread.
+// When the thread function returns, the thread terminates and the next pending thread runs.
+void Context::entry()
+    {
+    Context *self = host_context;
+
+    self->fn(self->arg);
+
+    host_context = self->next;
+    swap(self, host_context);               // never returns
+
+    abort();
+    }
+
+
+// Start a new thread. The caller is pushed on the pending chain, as if it had called resume.
+// The target stack is ignored, host threads need much larger stacks.
+void Context::start(THREADFN *fn, char *, uintptr_t arg)
+    {
+    if(stack == 0)
+        {
+        stack = malloc(HOST_STACK_SIZE);
+        }
+
+    this->fn = fn;
+    this->arg = arg;
+    sp = host_initial_sp((char *)stack, HOST_STACK_SIZE, entry);
+
+    resume();
+    }
+
+
+void ContextFIFO::suspend()
+    {
+    Context *self = host_context;
+
+    if(!add(self))                          // if the FIFO is full, just return
+        {
+        return;
+        }
+
+    Context::suspend();
+    }
+
+bool ContextFIFO::resume()
+    {
+    Context *ctx;
+
+    if(!take(ctx))
+        {
+        return false;
+        }
+
+    ctx->resume();
+    return true;
+    }
+
+
+// Suspend the current thread at the port. Returns the value passed to resume.
+void *Port::suspend()
+    {
+    Context *self = host_context;
+
+    host_context = self->next;
+    self->next = first;
+    first = self;
+    Context::swap(self, host_context);
+
+    return self->msg;
+    }
+
+// Resume the first thread waiting at the port, passing it a value.
+// Returns false if no thread was waiting.
+bool Port::resume(void *x)
+    {
+    Context *ctx = first;
+
+    if(ctx == 0)
+        {
+        return false;
+        }
+
+    first = ctx->next;
+    ctx->msg = x;
+    ctx->resume();
+
+    return true;
+    }
@@ -0,0 +1,273 @@
+// fmttest.cpp
+//
+// Test format.hpp against glibc's snprintf, and time a line of the memory dump formatted by it
+// and by Core/Sprintf/sprintf.cpp, which the Makefile builds with its names prefixed "menie_".
+//
+// Each format is tried with random values drawn to reach the edges: 0, 1, small numbers, the
+// largest and smallest of each size, and random bits, and with buffers from too small to hold
+// anything up to plenty, so that truncation and the returned length are checked as well. %p is
+// upper case hex without a 0x, as in sprintf.cpp, so it is compared with %lX.
+//
+// With -b the dump line is timed, in cycles of the time stamp counter, or nanoseconds on hosts
+// that have none.
+//
+// usage: fmttest [-n <iterations>] [-s <seed>] [-b]
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "format.hpp"
+#include "testutil.hpp"
+
+// Core/Sprintf/sprintf.cpp, renamed by the Makefile
+extern "C" int menie_sprintf(char *out, const char *format, ...);
+
+// where PRINT sends the console output
+extern "C" int _write(int, const char *ptr, int len)
+    {
+    return write(1, ptr, len);
+    }
+
+static uint64_t rnd64() { uint64_t hi = rnd(1u << 24); return hi << 40 ^ (uint64_t)rnd(1u << 24) << 16 ^ rnd(1u << 16); }
+
+
+// a random value, often one at an edge
+template<typename T>
+static T value()
+    {
+    switch(rnd(8))
+        {
+    case 0: return 0;
+    case 1: return 1;
+    case 2: return (T)-1;
+    case 3: return (T)((T)1 << (sizeof(T) * 8 - 1));                    // the most negative, if signed
+    case 4: return (T)~((T)1 << (sizeof(T) * 8 - 1));                   // the most positive
+    case 5: return (T)rnd(1000) - (T)rnd(2) * 500;
+    default: return (T)rnd64();
+        }
+    }
+
+
+static void check(const char *format, unsigned size, int got, int want, const char *mine, const char *theirs)
+    {
+    ++tests;
+    if(got != want || strcmp(mine, theirs) != 0)
+        {
+        if(++failures <= 20)
+            {
+            printf("\"%s\" size %u: got %d \"%s\", want %d \"%s\"\n", format, size, got, mine, want, theirs);
+            }
+        }
+    }
+
+// format into buffers of every size up to that needed, and one more
+#define TRY(f, ...)                                                                     \
+    do  {                                                                               \
+        char mine[128], theirs[128];                                                    \
+        int want = snprintf(theirs, sizeof(theirs), f, __VA_ARGS__);                    \
+        for(unsigned size=0; size<=(unsigned)want+1; size++)                            \
+            {                                                                           \
+            memset(mine, 'z', sizeof(mine));                                            \
+            theirs[0] = 0;                                                              \
+            snprintf(theirs, size, f, __VA_ARGS__);                                     \
+            int got = SNPRINT(mine, size, f, __VA_ARGS__);                              \
+            check(f, size, got, want, size ? mine : "", theirs);                        \
+            CHECK_UNTOUCHED(mine, size);                                                \
+            }                                                                           \
+        } while(0)
+
+// nothing past the end of the buffer is written
+#define CHECK_UNTOUCHED(buf, size)                                                      \
+    for(unsigned i=size; i<sizeof(buf); i++)                                            \
+        {                                                                               \
+        if(buf[i] != 'z')                                                               \
+            {                                                                           \
+            check("overrun", size, i, 0, "", "");                                       \
+            break;                                                                      \
+            }                                                                           \
+        }
+
+
+static void test()
+    {
+    int i = value<int>();
+    unsigned u = value<unsigned>();
+    short h = value<short>();
+    unsigned char b = value<unsigned char>();
+    long long ll = value<long long>();
+    unsigned long long ull = value<unsigned long long>();
+    const char *strings[] = {"", "a", "hello", "a longer string of text", 0};
+    const char *s = strings[rnd(4)];
+    char c = 'A' + rnd(26);
+    void *p = (void *)(uintptr_t)rnd64();
+
+    TRY("plain text%s", "");
+    TRY("%d", i);
+    TRY("%i|%u|%x|%X|%o", i, u, u, u, u);
+    TRY("%5d|%-5d|%05d|%12d", i, i, i, i);
+    TRY("%08x: %08x %08x|", u, u, i);
+    TRY("[%3u] [%-3u] [%03u] [%20u]", u, u, u, u);
+    TRY("%d %x", h, h);
+    TRY("%u %c%c", b, c, c);
+    TRY("%lld %llu %llx %llX %llo", ll, ull, ull, ull, ull);
+    TRY("%022lld|%-22lld|%22llu", ll, ll, ull);
+    TRY("%s|%10s|%-10s|%3s", s, s, s, s);
+    TRY("%c|%3c|%-3c|", c, c, c);
+    TRY("100%% %d%%", i);
+    TRY("%%%s%%", s);
+    TRY("%zu %zx", (size_t)u, (size_t)u);
+
+    char mine[40], theirs[40];
+    int want = snprintf(theirs, sizeof(theirs), "%lX", (unsigned long)(uintptr_t)p);
+    int got = SNPRINT(mine, sizeof(mine), "%p", p);
+    check("%p", sizeof(mine), got, want, mine, theirs);
+
+    got = SNPRINT(mine, sizeof(mine), "%s", (const char *)0);
+    check("%s of 0", sizeof(mine), got, 6, mine, "(null)");
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// timing
+//////////////////////////////////////////////////////////////////////////////
+
+// a line of the dump as Core/Src/dump.cpp formats it with format.hpp
+__attribute__((__noinline__))
+static char *format_line(char *b, const unsigned char *p, int size)
+    {
+    b += SPRINT(b,"%08x: ",(uint32_t)(uintptr_t)p);
+    for(int i=0;i<16;i+=4)
+        {
+        if(i<size)SPRINT(b,"%08x ",*(uint32_t *)&p[i]);
+        else SPRINT(b,"         ");
+        b += 9;
+        }
+    *b++ = ' ';
+    *b++ = '|';
+    for(int i=0;i<16 && i<size;i++)
+        {
+        *b++ = ' '<=p[i]&&p[i]<0x7f ? p[i] : '.';
+        }
+    *b++ = '|';
+    *b = 0;
+    return b;
+    }
+
+// and as it did before, with sprintf.cpp
+__attribute__((__noinline__))
+static char *sprintf_line(char *b, const unsigned char *p, int size)
+    {
+    b += menie_sprintf(b,"%08x: ",(int)(uintptr_t)p);
+    for(int i=0;i<16;i+=4)
+        {
+        if(i<size)menie_sprintf(b,"%08x ",*(int *)&p[i]);
+        else menie_sprintf(b,"         ");
+        b += 9;
+        }
+    *b++ = ' ';
+    *b++ = '|';
+    for(int i=0;i<16 && i<size;i++)
+        {
+        *b++ = ' '<=p[i]&&p[i]<0x7f ? p[i] : '.';
+        }
+    *b++ = '|';
+    *b = 0;
+    return b;
+    }
+
+static volatile uintptr_t sink;
+
+template<typename F>
+static double time_line(F f)
+    {
+    double best = 1e30;
+    const unsigned reps = 100000;
+
+    for(int tries=0; tries<5; tries++)
+        {
+        uint64_t start = ticks();
+        for(unsigned i=0; i<reps; i++)
+            {
+            sink = (uintptr_t)f();
+            }
+        double t = (double)(ticks() - start) / reps;
+        if(t < best)
+            {
+            best = t;
+            }
+        }
+    return best;
+    }
+
+static void bench()
+    {
+    alignas(4) static unsigned char data[16] = "Hello, world!\r\n";
+    char a[80], b[80];
+
+    format_line(a, data, 16);
+    sprintf_line(b, data, 16);
+    check("dump line", 80, strlen(a), strlen(b), a, b);
+    printf("%s\n", a);
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("time stamp counter cycles per dump line\n");
+#else
+    printf("nanoseconds per dump line\n");
+#endif
+    printf("format.hpp %8.1f\n", time_line([&]{ return format_line(a, data, 16); }));
+    printf("sprintf    %8.1f\n", time_line([&]{ return sprintf_line(b, data, 16); }));
+    }
+
+
+int main(int argc, char **argv)
+    {
+    unsigned iterations = 5000;
+    bool timing = false;
+
+    for(int i=1; i<argc; i++)
+        {
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            {
+            iterations = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            {
+            seed = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-b") == 0)
+            {
+            timing = true;
+            }
+        else
+            {
+            fprintf(stderr, "usage: fmttest [-n <iterations>] [-s <seed>] [-b]\n");
+            return 1;
+            }
+        }
+
+    for(unsigned i=0; i<iterations; i++)
+        {
+        test();
+        }
+
+    fflush(stdout);
+    int n = PRINT("fmttest: %u checks, %u failures\n", tests, failures);
+    if(n != snprintf(0, 0, "fmttest: %u checks, %u failures\n", tests, failures))
+        {
+        printf("PRINT returned %d\n", n);
+        ++failures;
+        }
+
+    if(timing)
+        {
+        bench();
+        }
+
+    return failures != 0;
+    }
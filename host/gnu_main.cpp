@@ -0,0 +1,38 @@
+// gnu_main.cpp
+// main() for running the test program against GNU libgomp, for comparison with the bare metal libgomp.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <omp.h>
+#include "arena.hpp"
+
+extern int omptest(int argc, char **argv);
+
+// not an OMP function, the bare metal libgomp provides it for permute
+extern "C"
+int gomp_get_thread_id()
+    {
+    return omp_get_thread_num();
+    }
+
+// GNU libgomp doesn't allocate from arenas, but the test program selects them
+static thread_local Arena *current_arena = 0;
+
+Arena *arena_current()
+    {
+    return current_arena;
+    }
+
+Arena *arena_select(Arena *arena)
+    {
+    Arena *prev = current_arena;
+    current_arena = arena;
+    return prev;
+    }
+
+int main(int argc, char **argv)
+    {
+    return omptest(argc, argv);
+    }
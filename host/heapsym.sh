@@ -0,0 +1,30 @@
+#!/bin/sh
+# heapsym.sh -- name the call sites in the output of the "heap" command
+#
+# Each line that starts with a hex address gets the function and source line of the call
+# that the address returns to, from the firmware's ELF file.
+#
+# usage: heapsym.sh <elf file> [<captured output>]
+#
+# Copyright (c) 2023 Jonathan Engdahl
+# BSD license -- see the accompanying LICENSE file
+
+ADDR2LINE=${ADDR2LINE:-arm-none-eabi-addr2line}
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <elf file> [<captured output>]" >&2
+    exit 1
+fi
+elf=$1
+shift
+
+# a return address has the Thumb bit set and points after the call, so look up the address less one
+cat "$@" | tr -d '\r' | while IFS= read -r line; do
+    addr=$(echo "$line" | sed -n 's/^\([0-9a-fA-F]\{8\}\) .*/\1/p')
+    if [ -n "$addr" ]; then
+        where=$($ADDR2LINE -f -C -p -e "$elf" $(printf '%x' $((0x$addr - 1))))
+        echo "$line  $where"
+    else
+        echo "$line"
+    fi
+done
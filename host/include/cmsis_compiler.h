@@ -0,0 +1,29 @@
+// cmsis_compiler.h -- host port
+// Just enough of CMSIS for Core/Inc/cmsis.h and the headers that use it to compile on a PC.
+
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#define __ASM                   __asm
+#define __INLINE                inline
+#define __STATIC_INLINE         static inline
+#define __STATIC_FORCEINLINE    __attribute__((always_inline)) static inline
+#define __NO_RETURN             __attribute__((__noreturn__))
+#define __USED                  __attribute__((used))
+#define __WEAK                  __attribute__((weak))
+#define __PACKED                __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+#define __RESTRICT              __restrict
+#define __COMPILER_BARRIER()    __asm__ __volatile__("":::"memory")
+
+// all host threads run on one OS thread, and there are no interrupts
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+static inline void __CLREX() {}
+static inline uint32_t __get_PRIMASK() { return 0; }
+static inline void __set_PRIMASK(uint32_t) {}
+static inline uint32_t __get_IPSR() { return 0; }          // always thread mode
+
+#endif // __CMSIS_COMPILER_H
@@ -0,0 +1,84 @@
+// context.hpp -- host port
+//
+// A host (Linux) implementation of the Context class from Core/Inc/context.hpp, so that
+// libgomp.cpp and other threading code can be built and run on a PC.
+//
+// The semantics are the same as the bare metal version: the running Context is the head of
+// a chain of pending Contexts, resume pushes the running thread onto the chain and runs another,
+// and suspend pops the chain. Instead of r9, the host keeps the chain head in a global.
+// All threads run on one OS thread, so the system is just as non-preemptive as on the target.
+//
+// This file is force-included (-include) ahead of everything else in the host build. It uses
+// the same include guard as Core/Inc/context.hpp, so the target version is never seen.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HOST_STACK_SIZE
+#define HOST_STACK_SIZE (256*1024)          // host threads get their own stacks, target stack arrays are too small for glibc
+#endif
+
+// the code of a thread
+typedef uint32_t THREADFN(uintptr_t arg);
+
+class Context;
+
+extern Context *host_context;               // the running Context, stands in for r9
+
+// the context of a thread
+class Context
+    {
+    private:
+
+    void *sp = 0;                           // saved stack pointer, the callee-saved registers are on the stack
+    void *stack = 0;                        // host stack allocated by start
+    THREADFN *fn = 0;                       // thread code, until it is started
+    uintptr_t arg = 0;                      // thread arg, until it is started
+    void *msg = 0;                          // value passed from Port::resume to Port::suspend
+
+    Context *next = 0;                      // contextchain pointer, this continues the LIFO chain
+
+    static void entry();                    // first code run by a new thread
+    static void swap(Context *from, Context *to);
+
+    friend class Port;
+    friend class ContextFIFO;
+
+    public:
+
+    Context()
+        {
+        }
+
+    void static suspend();                  // suspend self until resumed
+    void resume();                          // resume a suspended thread
+    void start(THREADFN *fn, char *sp, uintptr_t arg); // an internal function to start a new thread
+
+    // spawn a new thread
+    // The host ignores the target stack and allocates a larger one.
+    template<unsigned N>
+    void spawn(THREADFN *fn, char (&stack)[N], uintptr_t arg = 0)
+        {
+        start(fn, &stack[N-8], arg);
+        }
+
+    // get a pointer to the current context
+    static Context *pointer()
+        {
+        return host_context;
+        }
+
+    // set the context pointer, used at powerup to make the caller the background thread
+    static void pointer(Context *ctx)
+        {
+        host_context = ctx;
+        }
+    };
+
+#endif // CONTEXT_H
@@ -0,0 +1,17 @@
+// cyccnt.hpp -- host port
+// The target uses the DWT cycle counter. The host counts nanoseconds instead, reported as "cycles".
+
+#ifndef CYCCNT_HPP
+#define CYCCNT_HPP
+
+#include <stdint.h>
+#include <time.h>
+
+static inline unsigned Now()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned)(ts.tv_sec*1000000000ull + ts.tv_nsec);
+    }
+
+#endif //CYCCNT_HPP
@@ -0,0 +1,89 @@
+// ff.h -- host port
+// The few FatFs calls that bulk.cpp makes, on the host's files. A FIL holds a stdio FILE.
+
+#ifndef _FATFS
+#define _FATFS
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define _MAX_LFN 64                         // as in FATFS/Target/ffconf.h
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint32_t FSIZE_t;
+
+typedef struct
+    {
+    FILE *file;
+    } FIL;
+
+typedef enum
+    {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED,
+    FR_EXIST,
+    FR_INVALID_OBJECT,
+    FR_WRITE_PROTECTED,
+    FR_INVALID_DRIVE,
+    FR_NOT_ENABLED,
+    FR_NO_FILESYSTEM,
+    FR_MKFS_ABORTED,
+    FR_TIMEOUT,
+    FR_LOCKED,
+    FR_NOT_ENOUGH_CORE,
+    FR_TOO_MANY_OPEN_FILES,
+    FR_INVALID_PARAMETER,
+    } FRESULT;
+
+#define FA_READ             0x01
+#define FA_WRITE            0x02
+#define FA_CREATE_ALWAYS    0x08
+
+static inline FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+    {
+    fp->file = fopen(path, mode & FA_WRITE ? "wb" : "rb");
+    return fp->file ? FR_OK : FR_NO_FILE;
+    }
+
+static inline FRESULT f_close(FIL *fp)
+    {
+    return fclose(fp->file) == 0 ? FR_OK : FR_DISK_ERR;
+    }
+
+static inline FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+    {
+    *br = fread(buff, 1, btr, fp->file);
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+    }
+
+static inline FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+    {
+    *bw = fwrite(buff, 1, btw, fp->file);
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+    }
+
+static inline FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+    {
+    return fseek(fp->file, ofs, SEEK_SET) == 0 ? FR_OK : FR_DISK_ERR;
+    }
+
+static inline FSIZE_t host_f_size(FIL *fp)
+    {
+    long here = ftell(fp->file);
+    fseek(fp->file, 0, SEEK_END);
+    long size = ftell(fp->file);
+    fseek(fp->file, here, SEEK_SET);
+    return size;
+    }
+
+#define f_tell(fp) ((FSIZE_t)ftell((fp)->file))
+#define f_size(fp) host_f_size(fp)
+
+#endif // _FATFS
@@ -0,0 +1,9 @@
+// main.h -- host port
+// Stands in for the CubeMX main.h, which pulls in the STM32 HAL.
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+
+#endif // __MAIN_H
@@ -0,0 +1,38 @@
+// testutil.hpp
+//
+// What the host tests of library routines share: the counts of checks and failures, a seeded
+// random number generator, so that a failure can be repeated with -s, and a clock for timing,
+// the time stamp counter, or nanoseconds on hosts that have none.
+//
+// Each test is one file, so the state is static here.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#ifndef TESTUTIL_HPP
+#define TESTUTIL_HPP
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static unsigned failures = 0;
+static unsigned tests = 0;
+
+static uint32_t seed = 1;
+static unsigned rnd(unsigned n) { seed = seed * 1664525 + 1013904223; return (seed >> 8) % n; }
+
+static uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+
+#endif // TESTUTIL_HPP
@@ -0,0 +1,23 @@
+// tim.h -- host port
+// TIM2 is a free running 1 MHz counter on the target. On the host it reads the monotonic clock.
+
+#ifndef __TIM_H__
+#define __TIM_H__
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct { int dummy; } TIM_HandleTypeDef;
+
+extern TIM_HandleTypeDef htim2;
+
+static inline uint32_t host_usec()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec*1000000ull + ts.tv_nsec/1000);
+    }
+
+#define __HAL_TIM_GET_COUNTER(h) ((void)(h), host_usec())
+
+#endif // __TIM_H__
@@ -0,0 +1,25 @@
+// usbd_cdc_if.h -- host port
+// The USB virtual COM port calls that bulk.cpp makes, which host/bulktest.cpp provides on a pty.
+
+#ifndef __USBD_CDC_IF_H__
+#define __USBD_CDC_IF_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+uint8_t *vcp_reserve(uint32_t *len);    // the contiguous free space at the head of the transmit ring
+void vcp_commit(uint32_t len);          // send the first len bytes of it
+void vcp_txwait(void);                  // wait for the transfer in progress to complete
+uint32_t vcp_read(uint8_t *buf, uint32_t n);    // take up to n bytes from the receive ring, without waiting
+uint32_t vcp_rxcount(void);             // bytes waiting in the receive ring
+void vcp_rx_divert(uint32_t (*consumer)(uint8_t *buf, uint32_t len));   // hand packets to consumer instead, or 0 for the ring
+void vcp_rx_ready(void);                // the consumer can take another packet
+
+#ifdef __cplusplus
+    }
+#endif
+
+#endif // __USBD_CDC_IF_H__
@@ -0,0 +1,302 @@
+// logdecode.cpp
+//
+// Turn the binary log printed by the "log" command back into text.
+//
+// The log is read from a file, such as a capture of the console, in which it starts with the
+// line "binlog <n> MHz, ..." and ends with "end". The format strings are read from the
+// "binlog" section of the ELF file of the firmware that wrote the log, where a record's ID is
+// the offset of its format. An argument of %s is looked up in the sections of the ELF file
+// that are loaded, which is where string literals are.
+//
+// Each message is printed after the time in microseconds since the first record, and the
+// thread that logged it: its index in omp_threads, "isr" for an interrupt handler, or "-" for
+// a thread that is not an OpenMP thread. The time is kept from the cycle counter, which wraps,
+// so records more than one wrap apart (about 17 seconds at 250 MHz) are misplaced.
+//
+// usage: logdecode <elf> [<log>]      the log is read from stdin if not given
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <elf.h>
+#include "binlog.hpp"
+
+
+// a section of the ELF file
+struct Section
+    {
+    std::string name;
+    uint64_t address;
+    uint64_t size;
+    const char *data;                       // 0 if it has no contents in the file
+    bool loaded;
+    };
+
+static std::vector<char> elf;
+static std::vector<Section> sections;
+static const Section *formats;
+
+
+template<typename Ehdr, typename Shdr>
+static bool read_sections()
+    {
+    const Ehdr &eh = *(const Ehdr *)elf.data();
+
+    if(eh.e_shoff == 0 || eh.e_shoff + (uint64_t)eh.e_shnum * sizeof(Shdr) > elf.size() || eh.e_shstrndx >= eh.e_shnum)
+        {
+        return false;
+        }
+
+    const Shdr *sh = (const Shdr *)(elf.data() + eh.e_shoff);
+    const char *names = elf.data() + sh[eh.e_shstrndx].sh_offset;
+
+    for(unsigned i=0; i<eh.e_shnum; i++)
+        {
+        bool contents = sh[i].sh_type != SHT_NOBITS && sh[i].sh_offset + sh[i].sh_size <= elf.size();
+
+        sections.push_back({names + sh[i].sh_name, sh[i].sh_addr, sh[i].sh_size,
+                            contents ? elf.data() + sh[i].sh_offset : 0, (sh[i].sh_flags & SHF_ALLOC) != 0});
+        }
+    return true;
+    }
+
+
+static bool read_elf(const char *path)
+    {
+    FILE *f = fopen(path, "rb");
+
+    if(f == 0)
+        {
+        return false;
+        }
+    fseek(f, 0, SEEK_END);
+    elf.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    bool ok = fread(elf.data(), 1, elf.size(), f) == elf.size();
+    fclose(f);
+
+    if(!ok || elf.size() < EI_NIDENT || memcmp(elf.data(), ELFMAG, SELFMAG) != 0)
+        {
+        return false;
+        }
+    if(elf[EI_CLASS] == ELFCLASS32)
+        {
+        return read_sections<Elf32_Ehdr, Elf32_Shdr>();
+        }
+    return read_sections<Elf64_Ehdr, Elf64_Shdr>();
+    }
+
+
+// a string at an address in the program, or 0 if it isn't in the file
+static const char *string_at(uint64_t address)
+    {
+    for(const Section &s : sections)
+        {
+        if(s.loaded && s.data && address >= s.address && address < s.address + s.size
+        && memchr(s.data + (address - s.address), 0, s.address + s.size - address))
+            {
+            return s.data + (address - s.address);
+            }
+        }
+    return 0;
+    }
+
+
+// format one record's message, the arguments are taken from args, and wide says which are two words
+static std::string render(const char *format, const uint32_t *args, unsigned words, unsigned wide)
+    {
+    std::string text;
+    unsigned used = 0;
+    unsigned argument = 0;
+
+    while(*format)
+        {
+        if(format[0] != '%' || format[1] == '%')
+            {
+            text += *format;
+            format += 1 + (format[0] == '%');
+            continue;
+            }
+
+        // the conversion, without the size modifiers, which come from the record
+        std::string spec = "%";
+
+        ++format;
+        while(strchr("-0123456789", *format) && *format)
+            {
+            spec += *format++;
+            }
+        while(*format == 'l' || *format == 'h' || *format == 'z')
+            {
+            ++format;
+            }
+
+        char conversion = *format ? *format++ : '?';
+        bool two = (wide >> argument++) & 1;
+        uint64_t value = 0;
+        char buf[64];
+
+        if(used + 1 + two > words)
+            {
+            text += "<missing>";
+            continue;
+            }
+        value = args[used++];
+        if(two)
+            {
+            value |= (uint64_t)args[used++] << 32;
+            }
+
+        switch(conversion)
+            {
+        case 'd':
+        case 'i':
+            snprintf(buf, sizeof(buf), (spec + "lld").c_str(), two ? (long long)value : (long long)(int32_t)value);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            snprintf(buf, sizeof(buf), (spec + "ll" + conversion).c_str(), (unsigned long long)value);
+            break;
+        case 'p':
+            snprintf(buf, sizeof(buf), (spec + "llX").c_str(), (unsigned long long)value);
+            break;
+        case 'c':
+            snprintf(buf, sizeof(buf), (spec + "c").c_str(), (char)value);
+            break;
+        case 's':
+            {
+            const char *s = string_at(value);
+            char address[32];
+
+            if(s == 0)
+                {
+                snprintf(address, sizeof(address), "<string at %llx>", (unsigned long long)value);
+                s = address;
+                }
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(), s);
+            if(strlen(s) >= sizeof(buf))
+                {
+                text += s;                  // too long to pad, and needs no padding
+                continue;
+                }
+            break;
+            }
+        default:
+            snprintf(buf, sizeof(buf), "<bad conversion %c>", conversion);
+            break;
+            }
+        text += buf;
+        }
+
+    return text;
+    }
+
+
+int main(int argc, char **argv)
+    {
+    if(argc < 2 || argc > 3)
+        {
+        fprintf(stderr, "usage: logdecode <elf> [<log>]\n");
+        return 1;
+        }
+
+    if(!read_elf(argv[1]))
+        {
+        fprintf(stderr, "logdecode: can't read the ELF file %s\n", argv[1]);
+        return 1;
+        }
+    for(const Section &s : sections)
+        {
+        if(s.name == "binlog" && s.data)
+            {
+            formats = &s;
+            }
+        }
+    if(formats == 0)
+        {
+        fprintf(stderr, "logdecode: %s has no binlog section\n", argv[1]);
+        return 1;
+        }
+
+    FILE *in = argc == 3 ? fopen(argv[2], "r") : stdin;
+
+    if(in == 0)
+        {
+        fprintf(stderr, "logdecode: can't open %s\n", argv[2]);
+        return 1;
+        }
+
+    // find the log and read its words
+    char line[256];
+    unsigned mhz = 0;
+    unsigned lost = 0;
+    std::vector<uint32_t> log;
+
+    while(fgets(line, sizeof(line), in) && sscanf(line, "binlog %u MHz, %*u words, %u records lost", &mhz, &lost) < 1)
+        {
+        }
+    while(fgets(line, sizeof(line), in) && strncmp(line, "end", 3) != 0)
+        {
+        char *p = line;
+        char *end;
+
+        for(unsigned long word; word = strtoul(p, &end, 16), end != p; p = end)
+            {
+            log.push_back(word);
+            }
+        }
+    if(mhz == 0)
+        {
+        fprintf(stderr, "logdecode: no log found\n");
+        return 1;
+        }
+    if(lost)
+        {
+        printf("(%u records lost before these)\n", lost);
+        }
+
+    // print the records
+    uint64_t time = 0;
+    uint32_t last = 0;
+
+    for(unsigned i=0; i+3 <= log.size(); )
+        {
+        uint32_t header = log[i];
+        uint32_t id = log[i + 1];
+        uint32_t stamp = log[i + 2];
+        unsigned words = BINLOG_WORDS_OF(header);
+        unsigned thread = BINLOG_THREAD_OF(header);
+        char who[8];
+
+        if(i + 3 + words > log.size() || words > 2 * BINLOG_MAX_ARGS || id >= formats->size)
+            {
+            printf("bad record at word %u: %08x %08x\n", i, header, id);
+            return 1;
+            }
+
+        time += i ? stamp - last : 0;
+        last = stamp;
+
+        if(thread == BINLOG_ISR)
+            strcpy(who, "isr");
+        else if(thread == BINLOG_OTHER)
+            strcpy(who, "-");
+        else
+            snprintf(who, sizeof(who), "t%u", thread);
+
+        printf("%12.3f %-4s %s\n", (double)time / mhz, who,
+               render(formats->data + id, &log[i + 3], words, BINLOG_WIDE_OF(header)).c_str());
+        i += 3 + words;
+        }
+
+    return 0;
+    }
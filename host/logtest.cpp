@@ -0,0 +1,93 @@
+// logtest.cpp
+//
+// Test binlog.hpp and host/logdecode together. Messages of every kind are logged, from every
+// thread of a parallel region, after enough others to wrap the ring many times, and the log
+// is printed as the "log" command prints it. With -e the same messages are printed instead by
+// format.hpp, which is what logdecode must turn the log back into. The check target of the
+// Makefile compares the two.
+//
+// The program is linked without PIE, so the addresses of the strings logged with %s are the
+// same as in the ELF file.
+//
+// usage: logtest [-e]
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "format.hpp"
+#include "binlog.hpp"
+
+// where PRINT sends the console output
+extern "C" int _write(int, const char *ptr, int len)
+    {
+    return write(1, ptr, len);
+    }
+
+static bool expect = false;
+
+// log a message, or print what the decoder should make of it
+#define SAY(f, ...)                                 \
+    do  {                                           \
+        if(expect)                                  \
+            {                                       \
+            PRINT(f "\n", ##__VA_ARGS__);           \
+            }                                       \
+        LOG(f, ##__VA_ARGS__);                      \
+        } while(0)
+
+enum colour {RED, GREEN, BLUE};
+
+
+int omptest(int argc, char **argv)
+    {
+    expect = argc > 1 && strcmp(argv[1], "-e") == 0;
+
+    for(unsigned i=0; i<1000; i++)
+        {
+        LOG("filler %u", i);
+        }
+
+    int minus = -12345;
+    unsigned big = 0xFEDCBA98;
+    int64_t wide = -1234567890123456789;
+    uint64_t uwide = 0xFEDCBA9876543210;
+    short s = -2;
+    unsigned char c = 200;
+    const char *name = "a string literal";
+
+    SAY("no arguments");
+    SAY("%d %i %u", minus, minus, big);
+    SAY("%x %X %o", big, big, big);
+    SAY("[%8d] [%-8d] [%08d] [%3d]", minus, minus, minus, minus);
+    SAY("%08x: %08x %08x", 0x1234u, big, 0u);
+    SAY("%lld %llu", wide, uwide);
+    SAY("%llx %016llX %llo", uwide, uwide, uwide);
+    SAY("%d before, %lld, and %u after", 1, wide, 2u);
+    SAY("short %d, char %u, letter %c, colour %d", s, c, 'x', BLUE);
+    SAY("%s, [%20s], [%-20s]", name, name, name);
+    SAY("%s", "another literal");
+    SAY("100%% %d%%", 50);
+    SAY("%d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+    SAY("%p", (void *)0x20001234);
+
+    #pragma omp parallel num_threads(4)
+        {
+        #pragma omp critical
+        SAY("thread %d of %d", omp_get_thread_num(), omp_get_num_threads());
+        }
+
+    SAY("done");
+
+    if(!expect)
+        {
+        binlog_dump();
+        }
+
+    return 0;
+    }
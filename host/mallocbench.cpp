@@ -0,0 +1,466 @@
+// mallocbench.cpp
+//
+// Replay an allocation trace against the allocator of Core/MyLib/malloc.cpp (TLSF), and against
+// the power-of-two bucket allocator it replaced, and compare the heap each one needs and its speed.
+//
+// The trace is either a log captured from the board with "verbose 1", whose "malloc", "memalign",
+// and "free" lines are replayed and all other lines ignored, or by default a synthetic trace of
+// the firmware's kinds of allocations: libgomp task arguments, taskgroups, and taskloops in short
+// lived bursts, FatFs LFN buffers and file objects, and I/O buffers, some of them aligned for DMA.
+//
+// Each allocator gets a heap of the given size. A request it can't satisfy is counted as failed,
+// as are requests over 1024 bytes for the bucket allocator, which asserted on them. "peak" is the
+// highest address of the heap that was used, which is what the heap must be sized for; "live" is
+// the most memory the program had allocated at once, the least that any allocator could need.
+// Each block is filled with a pattern, which is checked when it is freed, to catch overlaps.
+//
+// With -p, the heap profile of the TLSF replay is printed, and every block it allocated is checked
+// to have been freed. That needs mallocbench-prof, which is built with MALLOC_PROFILE set.
+//
+// usage: mallocbench [-h <heap size>] [-n <events>] [-r <repeat>] [-p] [<trace file>]
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <unordered_map>
+
+// the allocator of Core/MyLib/malloc.cpp, renamed by the Makefile so it doesn't replace the host's malloc
+extern "C" void *tlsf_malloc(size_t size);
+extern "C" void *tlsf_memalign(size_t align, size_t size);
+extern "C" void tlsf_free(void *ptr);
+#include "heap.hpp"
+
+// symbols that malloc.cpp expects from the firmware, unused once malloc_pool has been called
+int omp_verbose = 0;
+unsigned _heap_start;
+unsigned _heap_end;
+uintptr_t _break;
+
+
+// one event of a trace
+struct Event
+    {
+    bool alloc;                             // malloc or memalign, else free
+    unsigned id;                            // the allocation, numbered in the order they were made
+    unsigned size;                          // bytes requested
+    unsigned align;                         // alignment requested, 0 for malloc
+    };
+
+static std::vector<Event> trace;
+static unsigned allocations = 0;            // the number of allocation events, ids are less than this
+
+
+//////////////////////////////////////////////////////////////////////////////
+// the bucket allocator that TLSF replaced, as it was, but with its own heap and
+// returning 0 rather than asserting
+//////////////////////////////////////////////////////////////////////////////
+
+struct BucketBlock
+    {
+    union
+        {
+        BucketBlock *next;
+        unsigned bucket;
+        };
+    uintptr_t useable;
+    };
+
+static const unsigned MINSIZE = 8;
+static const unsigned MAXSIZE = 1024;
+static const unsigned SIZES = 9;            // it had 8, but a 1024 byte request maps to bucket 8
+
+static BucketBlock *bucket_free_blocks[SIZES];
+static uintptr_t bucket_break;
+static uintptr_t bucket_end;
+
+static void bucket_pool(void *start, uintptr_t size)
+    {
+    memset(bucket_free_blocks, 0, sizeof(bucket_free_blocks));
+    bucket_break = (uintptr_t)start;
+    bucket_end = (uintptr_t)start + size;
+    }
+
+static void *bucket_malloc(size_t size)
+    {
+    BucketBlock *blk;
+    unsigned bucket;
+
+    size = (size+7) & -8;
+    if(size < MINSIZE)
+        {
+        size = MINSIZE;
+        }
+    if(size > MAXSIZE)
+        {
+        return 0;
+        }
+    bucket = 31-__builtin_clz(size>>2);
+
+    blk = bucket_free_blocks[bucket];
+    if(blk != 0)
+        {
+        bucket_free_blocks[bucket] = blk->next;
+        }
+    else
+        {
+        if(bucket_break + (1<<(bucket+3)) + sizeof(uintptr_t) > bucket_end)
+            {
+            return 0;
+            }
+        blk = (BucketBlock *)bucket_break;
+        bucket_break += (1<<(bucket+3))+sizeof(uintptr_t);     // the header is a word, 4 bytes on the target
+        }
+
+    blk->bucket = bucket;
+    return (void *)&(blk->useable);
+    }
+
+static void bucket_free(void *ptr)
+    {
+    BucketBlock *blk = (BucketBlock *)((uintptr_t)ptr - sizeof(uintptr_t));
+    unsigned bucket = blk->bucket;
+
+    blk->next = bucket_free_blocks[bucket];
+    bucket_free_blocks[bucket] = blk;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// traces
+//////////////////////////////////////////////////////////////////////////////
+
+static uint32_t seed = 12345;
+
+static unsigned rnd(unsigned n)             // a pseudo-random number less than n
+    {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+    }
+
+
+// a synthetic trace of n events
+static void synthetic(unsigned n)
+    {
+    std::vector<unsigned> live;             // ids of the blocks that have not been freed
+    std::vector<unsigned> tasks;            // the short lived ones among them
+
+    auto alloc = [&](unsigned size, unsigned align, bool transient)
+        {
+        trace.push_back(Event{true, allocations, size, align});
+        (transient ? tasks : live).push_back(allocations++);
+        };
+
+    auto release = [&](std::vector<unsigned> &v, unsigned i)
+        {
+        trace.push_back(Event{false, v[i], 0, 0});
+        v[i] = v.back();
+        v.pop_back();
+        };
+
+    while(trace.size() < n)
+        {
+        unsigned what = rnd(100);
+
+        if(what < 50)                                   // a parallel region's tasks and their taskgroup
+            {
+            unsigned burst = 1 + rnd(16);
+            alloc(12, 0, true);
+            for(unsigned i=0; i<burst; i++)
+                {
+                alloc(rnd(4) ? 16 + rnd(49) : 64 + rnd(100), 0, true);
+                }
+            while(tasks.size() > rnd(4))
+                {
+                release(tasks, rnd(tasks.size()));
+                }
+            }
+        else if(what < 60)                              // a taskloop
+            {
+            alloc(60 + rnd(64), 0, true);
+            }
+        else if(what < 75)                              // open a file: the LFN buffer and the file object
+            {
+            alloc(322, 0, false);
+            alloc(560, 0, false);
+            }
+        else                                            // an I/O buffer, some of them aligned for DMA
+            {
+            static const unsigned sizes[] = {64, 256, 512, 1024, 2048};
+            alloc(sizes[rnd(5)], rnd(2) ? 32 : 0, false);
+            }
+
+        while(live.size() > 4 + rnd(8))               // close files and release buffers, a few stay open
+            {
+            release(live, rnd(live.size()));
+            }
+        }
+
+    while(!tasks.empty())
+        {
+        release(tasks, tasks.size() - 1);
+        }
+    while(!live.empty())
+        {
+        release(live, live.size() - 1);
+        }
+    }
+
+
+// read the malloc, memalign, and free lines of a log captured with "verbose 1"
+static bool read_log(const char *path)
+    {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    std::unordered_map<unsigned long, unsigned> ids;   // the id of the block at each address
+
+    if(f == 0)
+        {
+        return false;
+        }
+
+    while(fgets(line, sizeof(line), f))
+        {
+        unsigned long addr;
+        unsigned size, align;
+
+        if(sscanf(line, "malloc %lx %u", &addr, &size) == 2)
+            {
+            ids[addr] = allocations;
+            trace.push_back(Event{true, allocations++, size, 0});
+            }
+        else if(sscanf(line, "memalign %lx %u %u", &addr, &align, &size) == 3)
+            {
+            ids[addr] = allocations;
+            trace.push_back(Event{true, allocations++, size, align});
+            }
+        else if(sscanf(line, "free %lx", &addr) == 1 && ids.count(addr))
+            {
+            trace.push_back(Event{false, ids[addr], 0, 0});
+            ids.erase(addr);
+            }
+        }
+
+    fclose(f);
+    return true;
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// replay
+//////////////////////////////////////////////////////////////////////////////
+
+struct Allocator
+    {
+    const char *name;
+    void (*pool)(void *start, uintptr_t size);
+    void *(*malloc)(size_t size);
+    void *(*memalign)(size_t align, size_t size);  // 0 if there is none, the caller aligns within a bigger block
+    void (*free)(void *ptr);
+    };
+
+static Allocator allocators[] =
+    {
+    {"bucket", bucket_pool, [](size_t size){ return bucket_malloc(size); }, 0, bucket_free},
+    {"tlsf", malloc_pool, tlsf_malloc, tlsf_memalign, tlsf_free},
+    };
+
+
+static double now()
+    {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+
+// replay the trace once, and return the number of failed requests
+// if check is set, fill and check the blocks, and measure the peak and live heap
+static unsigned replay(Allocator &a, char *heap, unsigned heap_size, bool check, unsigned &peak, unsigned &live, unsigned &errors)
+    {
+    static std::vector<char *> ptrs;        // the address returned for each id
+    static std::vector<char *> blocks;      // the address allocated, which differs if the caller aligned it
+    static std::vector<unsigned> sizes;     // the size of each id
+    unsigned failed = 0;
+    unsigned in_use = 0;
+
+    ptrs.assign(allocations, 0);
+    blocks.assign(allocations, 0);
+    sizes.assign(allocations, 0);
+    peak = live = errors = 0;
+    a.pool(heap, heap_size);
+
+    for(auto &e : trace)
+        {
+        if(e.alloc)
+            {
+            char *block;
+            char *p;
+
+            if(e.align && a.memalign == 0)
+                {
+                block = (char *)a.malloc(e.size + e.align);
+                p = (char *)(((uintptr_t)block + e.align - 1) & -(uintptr_t)e.align);
+                }
+            else
+                {
+                block = p = (char *)(e.align ? a.memalign(e.align, e.size) : a.malloc(e.size));
+                }
+
+            if(block == 0)
+                {
+                ++failed;
+                continue;
+                }
+            ptrs[e.id] = p;
+            blocks[e.id] = block;
+            sizes[e.id] = e.size;
+
+            if(check)
+                {
+                if(e.align && ((uintptr_t)p & (e.align - 1)))
+                    {
+                    ++errors;
+                    }
+                memset(p, (char)e.id, e.size);
+                in_use += e.size;
+                if(in_use > live)
+                    {
+                    live = in_use;
+                    }
+                if(p + e.size - heap > (long)peak)
+                    {
+                    peak = p + e.size - heap;
+                    }
+                }
+            }
+        else
+            {
+            char *p = ptrs[e.id];
+            if(p == 0)
+                {
+                continue;
+                }
+
+            if(check)
+                {
+                for(unsigned i=0; i<sizes[e.id]; i++)
+                    {
+                    if(p[i] != (char)e.id)
+                        {
+                        ++errors;
+                        break;
+                        }
+                    }
+                in_use -= sizes[e.id];
+                }
+
+            a.free(blocks[e.id]);
+            ptrs[e.id] = 0;
+            }
+        }
+
+    if(a.pool == bucket_pool)               // the bucket allocator never returns memory, its peak is its break
+        {
+        peak = bucket_break - (uintptr_t)heap;
+        }
+
+    return failed;
+    }
+
+
+int main(int argc, char **argv)
+    {
+    unsigned heap_size = 16384;
+    unsigned events = 20000;
+    int repeat = 100;
+    const char *path = 0;
+    bool profile = false;
+
+    for(int i=1; i<argc; i++)
+        {
+        if(strcmp(argv[i], "-h") == 0 && i+1 < argc)
+            {
+            heap_size = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            {
+            events = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            {
+            repeat = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-p") == 0)
+            {
+            profile = true;
+            }
+        else
+            {
+            path = argv[i];
+            }
+        }
+
+    if(path)
+        {
+        if(!read_log(path))
+            {
+            printf("can't open %s\n", path);
+            return 1;
+            }
+        }
+    else
+        {
+        synthetic(events);
+        }
+
+    char *heap = (char *)aligned_alloc(64, heap_size);
+    int status = 0;
+
+    printf("%u events, %u allocations, %u byte heap\n", (unsigned)trace.size(), allocations, heap_size);
+    printf("allocator     failed     peak     live   errors    ns/op\n");
+
+    for(auto &a : allocators)
+        {
+        unsigned peak, live, errors, failed;
+
+        if(profile && a.pool == malloc_pool)
+            {
+            heap_snapshot();
+            }
+
+        failed = replay(a, heap, heap_size, true, peak, live, errors);
+
+        if(profile && a.pool == malloc_pool)
+            {
+            heap_report(10);
+            heap_diff();
+            }
+
+        double start = now();
+        for(int r=0; r<repeat; r++)
+            {
+            unsigned p, l, e;
+            replay(a, heap, heap_size, false, p, l, e);
+            }
+        double ns = (now() - start) * 1e9 / repeat / trace.size();
+
+        printf("%-10s %9u %8u %8u %8u %8.1f\n", a.name, failed, peak, live, errors, ns);
+
+        if(errors)
+            {
+            status = 1;
+            }
+        }
+
+    free(heap);
+    return status;
+    }
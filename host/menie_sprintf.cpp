@@ -0,0 +1,17 @@
+// Core/Sprintf/sprintf.cpp with its names prefixed "menie_", so that fmttest can call it beside
+// glibc's. The C library headers are included first, so only the definitions are renamed.
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define sprintf   menie_sprintf
+#define snprintf  menie_snprintf
+#define vsprintf  menie_vsprintf
+#define vsnprintf menie_vsnprintf
+
+#include "../Core/Sprintf/sprintf.cpp"
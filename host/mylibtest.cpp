@@ -0,0 +1,456 @@
+// mylibtest.cpp
+//
+// Test the routines of Core/MyLib against glibc, and time both.
+//
+// Every routine is compiled by the Makefile with its name and the names of the others prefixed
+// with "mylib_", so they don't replace the host's, and they call each other rather than glibc.
+// Each test draws random buffers at every alignment and of every length up to MAXLEN, from a few
+// byte values chosen to find the edge cases: 0, the character searched for, both cases of a
+// letter, the characters on either side of the letters, and bytes with the high bit set. The
+// results, and the whole of any buffer written, with a guard band around it, must match glibc.
+// Comparisons only need the same sign. strnchr and memcpy32 are not in glibc, so they are
+// checked against byte loops.
+//
+// strtol only handles what the firmware needs: no overflow, no "0X", and whitespace is only
+// spaces and tabs. It is tested on numbers of that kind, which always have at least one digit,
+// since with none glibc sets endptr back to the start and MyLib does not.
+//
+// With -b the routines and glibc's are timed over aligned and misaligned buffers. The time is in
+// cycles of the time stamp counter per byte, or nanoseconds per byte on hosts that have none.
+//
+// usage: mylibtest [-n <iterations>] [-s <seed>] [-b]
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "testutil.hpp"
+
+// the routines of Core/MyLib, renamed by the Makefile
+extern "C"
+    {
+    void *mylib_memcpy(void *dest, const void *src, unsigned n);
+    void mylib_memcpy32(uint32_t *dst, uint32_t *src, uint32_t size);
+    void *mylib_memmove(void *dest, const void *src, unsigned n);
+    void *mylib_memset(void *dest, int c, unsigned n);
+    int mylib_memcmp(const void *s1, const void *s2, unsigned n);
+    void *mylib_memchr(const void *s, int c, unsigned n);
+    unsigned mylib_strlen(const char *s);
+    unsigned mylib_strnlen(const char *s, unsigned n);
+    char *mylib_strchr(const char *s, int c);
+    const char *mylib_strchrnul(const char *s, int c);
+    const char *mylib_strnchr(const char *s, int n, int c);
+    char *mylib_strrchr(const char *s, int c);
+    int mylib_strcmp(const char *s1, const char *s2);
+    int mylib_strncmp(const char *s1, const char *s2, unsigned n);
+    int mylib_strcasecmp(const char *s1, const char *s2);
+    int mylib_strncasecmp(const char *s1, const char *s2, unsigned n);
+    char *mylib_strcpy(char *dest, const char *src);
+    char *mylib_strncpy(char *dest, const char *src, unsigned n);
+    char *mylib_strcat(char *dest, const char *src);
+    char *mylib_strncat(char *dest, const char *src, unsigned n);
+    unsigned mylib_strspn(const char *s, const char *accept);
+    unsigned mylib_strcspn(const char *s, const char *reject);
+    char *mylib_strstr(const char *haystack, const char *needle);
+    long mylib_strtol(const char *p, char **endptr, int base);
+    int mylib_atoi(const char *p);
+    }
+
+static const unsigned MAXLEN = 300;
+static const unsigned GUARD = 16;                       // bytes either side of a buffer, which must not change
+static const unsigned SIZE = 2*MAXLEN + 2*GUARD;            // room for strcat to double a string
+static const unsigned char alphabet[] = {0, 1, 'a', 'A', 'x', 'X', '@', '[', '`', '{', 0x7F, 0x80, 0xC1, 0xFF};
+
+alignas(8) static char src[SIZE];                       // what the routines read
+alignas(8) static char src2[SIZE];
+alignas(8) static char mine[SIZE];                      // what MyLib writes
+alignas(8) static char theirs[SIZE];                    // what glibc writes
+
+static char random_char(bool zeros) { char c; do c = alphabet[rnd(sizeof(alphabet))]; while(c == 0 && !zeros); return c; }
+
+static long pos(const void *p, const void *base) { return p ? (const char *)p - (const char *)base : -1; }
+
+static int sign(long x) { return (x > 0) - (x < 0); }
+
+
+static void fail(const char *name, unsigned offset, unsigned len, long got, long want)
+    {
+    if(++failures <= 20)
+        {
+        printf("%s: offset %u length %u: got %ld, want %ld\n", name, offset, len, got, want);
+        }
+    }
+
+#define CHECK(name, got, want) do { ++tests; long g_ = (got), w_ = (want); if(g_ != w_) fail(name, offset, len, g_, w_); } while(0)
+
+// the output buffers must match, guard bands and all
+#define CHECK_BUFFERS(name) CHECK(name, memcmp(mine, theirs, SIZE), 0)
+
+
+// a random string at offset, of len characters without a 0, then 0
+static char *make_string(char *buf, unsigned offset, unsigned len)
+    {
+    char *s = buf + GUARD + offset;
+
+    for(unsigned i=0; i<len; i++)
+        {
+        s[i] = random_char(false);
+        }
+    s[len] = 0;
+    return s;
+    }
+
+
+// the same string at another offset, perhaps changed in one place, perhaps only in case, perhaps shortened
+static char *make_similar(char *buf, const char *s, unsigned len)
+    {
+    char *t = buf + GUARD + rnd(8);
+
+    memcpy(t, s, len + 1);
+    if(len && rnd(2))
+        {
+        unsigned i = rnd(len);
+
+        switch(rnd(3))
+            {
+        case 0: t[i] = random_char(true); break;
+        case 1: t[i] ^= 0x20; break;
+        case 2: t[i] = 0; break;
+            }
+        }
+    return t;
+    }
+
+
+static void reset_outputs()
+    {
+    for(unsigned i=0; i<SIZE; i++)
+        {
+        mine[i] = theirs[i] = (char)(i * 7 + 3);
+        }
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// memory routines
+//////////////////////////////////////////////////////////////////////////////
+
+static void test_memory()
+    {
+    unsigned offset = rnd(8);
+    unsigned len = rnd(MAXLEN);
+    unsigned dst = rnd(8);
+    int c = random_char(true);
+
+    for(unsigned i=0; i<SIZE; i++)
+        {
+        src[i] = random_char(true);
+        }
+    char *s = src + GUARD + offset;
+
+    reset_outputs();
+    mylib_memcpy(mine + GUARD + dst, s, len);
+    memcpy(theirs + GUARD + dst, s, len);
+    CHECK_BUFFERS("memcpy");
+    CHECK("memcpy return", pos(mylib_memcpy(mine + GUARD + dst, s, len), mine), GUARD + dst);
+
+    reset_outputs();
+    mylib_memcpy32((uint32_t *)(mine + GUARD), (uint32_t *)(src + GUARD), len & ~3u);
+    for(unsigned i=0; i<(len & ~3u); i++)
+        {
+        theirs[GUARD + i] = src[GUARD + i];
+        }
+    CHECK_BUFFERS("memcpy32");
+
+    reset_outputs();                                    // overlapping, either way
+    int shift = (int)rnd(2*GUARD) - (int)GUARD;
+    mylib_memmove(mine + GUARD + offset + shift, mine + GUARD + offset, len);
+    memmove(theirs + GUARD + offset + shift, theirs + GUARD + offset, len);
+    CHECK_BUFFERS("memmove");
+
+    reset_outputs();
+    mylib_memset(mine + GUARD + dst, c, len);
+    memset(theirs + GUARD + dst, c, len);
+    CHECK_BUFFERS("memset");
+
+    char *t = make_similar(src2, s, len);
+    CHECK("memcmp", sign(mylib_memcmp(s, t, len)), sign(memcmp(s, t, len)));
+    CHECK("memchr", pos(mylib_memchr(s, c, len), s), pos(memchr(s, c, len), s));
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// string routines
+//////////////////////////////////////////////////////////////////////////////
+
+static const char *ref_strnchr(const char *s, int n, int c)
+    {
+    for(; n > 0 && *s != 0; n--, s++)
+        {
+        if(*s == (char)c)
+            {
+            return s;
+            }
+        }
+    return 0;
+    }
+
+
+static void test_strings()
+    {
+    unsigned offset = rnd(8);
+    unsigned len = rnd(MAXLEN / 2);
+    char *s = make_string(src, offset, len);
+    char *t = make_similar(src2, s, len);
+    unsigned n = rnd(len + 4);
+    int c = random_char(true);
+
+    CHECK("strlen", mylib_strlen(s), strlen(s));
+    CHECK("strnlen", mylib_strnlen(s, n), strnlen(s, n));
+    CHECK("strchr", pos(mylib_strchr(s, c), s), pos(strchr(s, c), s));
+    CHECK("strchrnul", pos(mylib_strchrnul(s, c), s), pos(strchrnul(s, c), s));
+    CHECK("strnchr", pos(mylib_strnchr(s, n, c), s), pos(ref_strnchr(s, n, c), s));
+    CHECK("strrchr", pos(mylib_strrchr(s, c), s), pos(strrchr(s, c), s));
+
+    CHECK("strcmp", sign(mylib_strcmp(s, t)), sign(strcmp(s, t)));
+    CHECK("strncmp", sign(mylib_strncmp(s, t, n)), sign(strncmp(s, t, n)));
+    CHECK("strcasecmp", sign(mylib_strcasecmp(s, t)), sign(strcasecmp(s, t)));
+    CHECK("strncasecmp", sign(mylib_strncasecmp(s, t, n)), sign(strncasecmp(s, t, n)));
+
+    unsigned dst = rnd(8);
+    reset_outputs();
+    mylib_strcpy(mine + GUARD + dst, s);
+    strcpy(theirs + GUARD + dst, s);
+    CHECK_BUFFERS("strcpy");
+
+    reset_outputs();
+    mylib_strncpy(mine + GUARD + dst, s, n);
+    strncpy(theirs + GUARD + dst, s, n);
+    CHECK_BUFFERS("strncpy");
+
+    unsigned half = rnd(MAXLEN / 2 - 8);                // a string already in the destination
+    reset_outputs();
+    mine[GUARD + dst + half] = theirs[GUARD + dst + half] = 0;
+    for(unsigned i=0; i<half; i++)
+        {
+        mine[GUARD + dst + i] = theirs[GUARD + dst + i] = random_char(false);
+        }
+    mylib_strcat(mine + GUARD + dst, s);
+    strcat(theirs + GUARD + dst, s);
+    CHECK_BUFFERS("strcat");
+    mylib_strncat(mine + GUARD + dst, t, n / 4);
+    strncat(theirs + GUARD + dst, t, n / 4);
+    CHECK_BUFFERS("strncat");
+
+    char set[5];                                        // a few characters to accept or reject
+    unsigned setlen = rnd(sizeof(set));
+    for(unsigned i=0; i<setlen; i++)
+        {
+        set[i] = random_char(false);
+        }
+    set[setlen] = 0;
+    CHECK("strspn", mylib_strspn(s, set), strspn(s, set));
+    CHECK("strcspn", mylib_strcspn(s, set), strcspn(s, set));
+
+    unsigned start = rnd(len + 1);                      // a needle that is in the haystack, or nearly
+    unsigned nlen = rnd(len - start + 1) % 6;
+    char needle[8];
+    memcpy(needle, s + start, nlen);
+    needle[nlen] = 0;
+    if(nlen && rnd(2))
+        {
+        needle[rnd(nlen)] = random_char(false);
+        }
+    CHECK("strstr", pos(mylib_strstr(s, needle), s), pos(strstr(s, needle), s));
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// numbers
+//////////////////////////////////////////////////////////////////////////////
+
+static void test_numbers()
+    {
+    static const int bases[] = {0, 8, 10, 16};
+    static const char digits[] = "0123456789abcdefABCDEF";
+    static const char after[] = " 9zgX-";              // not 'x', glibc reads "0x" with no digits after as 0
+    char number[32];
+    unsigned len = 0;
+    unsigned offset = 0;
+    int base = bases[rnd(4)];
+    int radix = base ? base : 10;
+
+    for(unsigned i=rnd(3); i>0; i--)
+        {
+        number[len++] = rnd(2) ? ' ' : '\t';
+        }
+    if(rnd(3) == 0)
+        {
+        number[len++] = rnd(2) ? '-' : '+';
+        }
+    if((base == 0 || base == 16) && rnd(2))
+        {
+        number[len++] = '0';
+        number[len++] = 'x';
+        radix = 16;
+        }
+    else if(base == 0 && rnd(2))
+        {
+        number[len++] = '0';
+        radix = 8;
+        }
+    for(unsigned i=rnd(7)+1; i>0; i--)                  // no more than 7 digits, which fit in 32 bits
+        {
+        char d;
+        do d = digits[rnd(sizeof(digits) - 1)];
+        while(!(d <= '9' ? d - '0' < radix : radix == 16));
+        number[len++] = d;
+        }
+    number[len++] = after[rnd(sizeof(after))];
+    number[len] = 0;
+
+    char *mine_end, *their_end;
+    CHECK("strtol", mylib_strtol(number, &mine_end, base), strtol(number, &their_end, base));
+    CHECK("strtol end", pos(mine_end, number), pos(their_end, number));
+    CHECK("atoi", mylib_atoi(number), atoi(number));
+    }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// timing
+//////////////////////////////////////////////////////////////////////////////
+
+static volatile long sink;
+
+// ticks per byte of f over len bytes, the best of several tries
+template<typename F>
+static double time_one(F f, unsigned len)
+    {
+    double best = 1e30;
+    unsigned reps = 200000 / (len + 8) + 10;
+
+    for(int tries=0; tries<5; tries++)
+        {
+        uint64_t start = ticks();
+        for(unsigned i=0; i<reps; i++)
+            {
+            sink = f();
+            }
+        double t = (double)(ticks() - start) / reps / len;
+        if(t < best)
+            {
+            best = t;
+            }
+        }
+    return best;
+    }
+
+
+// the functions are called through volatile pointers, so the compiler can't expand the glibc calls inline
+template<typename T> using function = T;
+
+static void bench()
+    {
+    static const unsigned sizes[] = {4, 16, 64, 256};
+    static function<void *(void *, const void *, unsigned)> *volatile my_memcpy = mylib_memcpy;
+    static function<void *(void *, const void *, unsigned)> *volatile my_memmove = mylib_memmove;
+    static function<void *(void *, int, unsigned)> *volatile my_memset = mylib_memset;
+    static function<int (const void *, const void *, unsigned)> *volatile my_memcmp = mylib_memcmp;
+    static function<void *(const void *, int, unsigned)> *volatile my_memchr = mylib_memchr;
+    static function<unsigned (const char *)> *volatile my_strlen = mylib_strlen;
+    static function<char *(const char *, int)> *volatile my_strchr = mylib_strchr;
+    static function<int (const char *, const char *)> *volatile my_strcmp = mylib_strcmp;
+    static function<char *(char *, const char *)> *volatile my_strcpy = mylib_strcpy;
+    static function<void *(void *, const void *, size_t)> *volatile gnu_memcpy = memcpy;
+    static function<void *(void *, const void *, size_t)> *volatile gnu_memmove = memmove;
+    static function<void *(void *, int, size_t)> *volatile gnu_memset = memset;
+    static function<int (const void *, const void *, size_t)> *volatile gnu_memcmp = memcmp;
+    static function<const void *(const void *, int, size_t)> *volatile gnu_memchr = memchr;
+    static function<size_t (const char *)> *volatile gnu_strlen = strlen;
+    static function<const char *(const char *, int)> *volatile gnu_strchr = strchr;
+    static function<int (const char *, const char *)> *volatile gnu_strcmp = strcmp;
+    static function<char *(char *, const char *)> *volatile gnu_strcpy = strcpy;
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("time stamp counter cycles per byte, MyLib / glibc\n");
+#else
+    printf("nanoseconds per byte, MyLib / glibc\n");
+#endif
+    printf("size off       memcpy         memmove          memset          memcmp          memchr"
+           "          strlen          strchr          strcmp          strcpy\n");
+
+    for(unsigned len : sizes)
+        {
+        for(unsigned offset=0; offset<2; offset++)
+            {
+            char *s = src + GUARD + offset;
+            char *t = src2 + GUARD + 1 - offset;
+            char *d = mine + GUARD;
+
+            memset(s, 'a', len);
+            s[len] = 0;
+            memcpy(t, s, len + 1);
+
+            printf("%4u %3u", len, offset);
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_memcpy(d, s, len); }, len), time_one([&]{ return (long)gnu_memcpy(d, s, len); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_memmove(s + 4, s, len); }, len), time_one([&]{ return (long)gnu_memmove(s + 4, s, len); }, len));
+            s[len] = 0;
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_memset(d, 'a', len); }, len), time_one([&]{ return (long)gnu_memset(d, 'a', len); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_memcmp(s, t, len); }, len), time_one([&]{ return (long)gnu_memcmp(s, t, len); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_memchr(s, 'x', len); }, len), time_one([&]{ return (long)gnu_memchr(s, 'x', len); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_strlen(s); }, len), time_one([&]{ return (long)gnu_strlen(s); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_strchr(s, 'x'); }, len), time_one([&]{ return (long)gnu_strchr(s, 'x'); }, len));
+            printf("  %6.2f %6.2f", time_one([&]{ return (long)my_strcmp(s, t); }, len), time_one([&]{ return (long)gnu_strcmp(s, t); }, len));
+            printf("  %6.2f %6.2f\n", time_one([&]{ return (long)my_strcpy(d, s); }, len), time_one([&]{ return (long)gnu_strcpy(d, s); }, len));
+            }
+        }
+    }
+
+
+int main(int argc, char **argv)
+    {
+    unsigned iterations = 100000;
+    bool timing = false;
+
+    for(int i=1; i<argc; i++)
+        {
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            {
+            iterations = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            {
+            seed = atoi(argv[++i]);
+            }
+        else if(strcmp(argv[i], "-b") == 0)
+            {
+            timing = true;
+            }
+        else
+            {
+            fprintf(stderr, "usage: mylibtest [-n <iterations>] [-s <seed>] [-b]\n");
+            return 1;
+            }
+        }
+
+    for(unsigned i=0; i<iterations; i++)
+        {
+        test_memory();
+        test_strings();
+        test_numbers();
+        }
+
+    printf("mylibtest: %u checks, %u failures\n", tests, failures);
+
+    if(timing)
+        {
+        bench();
+        }
+
+    return failures != 0;
+    }
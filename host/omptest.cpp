@@ -0,0 +1,608 @@
+// omptest.cpp
+//
+// A test and benchmark program for libgomp.
+//
+// The same program is linked against the bare metal libgomp (omptest) and against GNU libgomp
+// (omptest-gnu). Each test checks its own result, and prints one line:
+//      name  config  result  ok/FAIL  time
+// The first four columns must be identical for both runtimes ("make check" compares them),
+// the last column is the average time per run, for comparing the runtimes.
+//
+// usage: omptest [-v] [-r <repeat>]
+//      -v  also run the printing tests from omp.cpp, as the omp command does on the target
+//      -r  number of times each test is run for timing (default 10)
+
+// Copyright (c) 2023 Jonathan Engdahl
+// BSD license -- see the accompanying LICENSE file
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <omp.h>
+#include "ordered.hpp"
+#include "palgo.hpp"
+#include "arena.hpp"
+
+extern void omp_hello(int);
+extern void omp_for(int);
+extern void omp_single(int);
+extern int permute(int colors_arg, int balls, int plevel_arg, int verbose_arg);
+extern int search(int n, int pos, bool cancel, int *scanned);
+extern long taskloop_sum(int n, int grainsize);
+extern long parallel_for_sum(int n);
+
+static const int MAXTEAM = 4;               // largest team tested, the bare metal runtime has 4 free threads on the host
+static const int NFOR = 1000;               // iterations in the "for" test
+static const int ROUNDS = 100;              // number of singles in the "single" test
+
+uint32_t qbuf[512/4];                       // the file commands' buffer, which palgo.cpp borrows
+
+static int repeat = 10;                     // number of runs of each test to average
+static int failures = 0;                    // number of failed tests
+
+
+// print a result line
+static void report(const char *name, const char *config, long result, bool ok, double seconds)
+    {
+    printf("%-10s %-10s %12ld %-4s %12.1f us\n", name, config, result, ok ? "ok" : "FAIL", seconds*1000000.0/repeat);
+    fflush(stdout);
+
+    if(!ok)
+        {
+        ++failures;
+        }
+    }
+
+
+// discard stdout while running code that prints, such as permute
+static int saved_stdout = -1;
+
+static void quiet()
+    {
+    fflush(stdout);
+    saved_stdout = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+    }
+
+static void unquiet()
+    {
+    fflush(stdout);
+    dup2(saved_stdout, 1);
+    close(saved_stdout);
+    }
+
+
+// parallel: every member of the team runs once, and sees the right team size
+static long test_hello(int n, bool &ok)
+    {
+    int seen[MAXTEAM] = {};
+    int nthreads = 0;
+
+    #pragma omp parallel num_threads(n)
+        {
+        ++seen[omp_get_thread_num()];       // each thread only touches its own slot
+        if(omp_get_thread_num() == 0)
+            {
+            nthreads = omp_get_num_threads();
+            }
+        }
+
+    ok = nthreads == n;
+    for(int i=0; i<n; i++)
+        {
+        ok = ok && seen[i] == 1;
+        }
+
+    return nthreads;
+    }
+
+
+// parallel for: every iteration runs exactly once, and the static schedule gives the same
+// partition on both runtimes. The result is a checksum of which thread ran which iteration.
+static long test_for(int n, bool &ok)
+    {
+    static int owner[NFOR];
+    long sum = 0;
+
+    for(auto &x : owner) x = -1;
+
+    #pragma omp parallel for num_threads(n)
+    for(int i=0; i<NFOR; i++)
+        {
+        owner[i] = omp_get_thread_num();
+        }
+
+    ok = true;
+    for(int i=0; i<NFOR; i++)
+        {
+        ok = ok && owner[i] >= 0 && owner[i] < n;
+        sum += (long)owner[i] * (i+1);
+        }
+
+    return sum;
+    }
+
+
+// single: exactly one thread runs each single, and all threads pass each one
+static long test_single(int n, bool &ok)
+    {
+    int singles = 0;
+    int arrivals = 0;
+
+    #pragma omp parallel num_threads(n)
+    for(int k=0; k<ROUNDS; k++)
+        {
+        #pragma omp single
+        ++singles;
+
+        #pragma omp atomic
+        ++arrivals;
+        }
+
+    ok = singles == ROUNDS && arrivals == n*ROUNDS;
+
+    return singles;
+    }
+
+
+// ordered: the ordered regions run in iteration order whatever the schedule, including a loop
+// that counts down, and a nowait loop can be followed directly by another
+static long test_ordered(int n, bool &ok)
+    {
+    int next = 0;
+    int bad = 0;
+
+    #pragma omp parallel num_threads(n)
+        {
+        #pragma omp for ordered schedule(dynamic, 3) nowait
+        for(int i=0; i<NFOR; i++)
+            {
+            #pragma omp ordered
+            bad += i != next++;
+            }
+
+        #pragma omp for ordered schedule(static, 2)
+        for(int i=NFOR; i<2*NFOR; i++)
+            {
+            if(i % 3)                       // an iteration need not run the ordered region
+                {
+                #pragma omp ordered
+                    {
+                    bad += i != next;
+                    next += i % 3 == 2 ? 2 : 1;
+                    }
+                }
+            }
+
+        #pragma omp for ordered
+        for(int i=3*NFOR; i>2*NFOR; i--)
+            {
+            #pragma omp ordered
+            bad += i != 5*NFOR - next++;
+            }
+        }
+
+    ok = bad == 0;
+
+    return next;
+    }
+
+
+// doacross: a wavefront over a grid, each element depends on the one above and the one to the left
+static const int GRID = 32;
+
+static long test_doacross(int n, bool &ok)
+    {
+    static unsigned a[GRID][GRID];
+    static unsigned b[GRID][GRID];
+
+    for(int i=0; i<GRID; i++)
+        {
+        for(int j=0; j<GRID; j++)
+            {
+            a[i][j] = b[i][j] = i*GRID + j;
+            }
+        }
+
+    for(int i=1; i<GRID; i++)
+        {
+        for(int j=1; j<GRID; j++)
+            {
+            b[i][j] = (b[i][j] + b[i-1][j]) * 3 + b[i][j-1];
+            }
+        }
+
+    #pragma omp parallel for ordered(2) schedule(dynamic, 2) num_threads(n)
+    for(int i=1; i<GRID; i++)
+        {
+        for(int j=1; j<GRID; j++)
+            {
+            #pragma omp ordered depend(sink: i-1, j) depend(sink: i, j-1)
+            a[i][j] = (a[i][j] + a[i-1][j]) * 3 + a[i][j-1];
+            #pragma omp ordered depend(source)
+            }
+        }
+
+    long sum = 0;
+    ok = true;
+    for(int i=0; i<GRID; i++)
+        {
+        for(int j=0; j<GRID; j++)
+            {
+            ok = ok && a[i][j] == b[i][j];
+            sum += a[i][j];
+            }
+        }
+
+    return sum & 0x7FFFFFFF;
+    }
+
+
+// final: a binary tree of tasks, which become final below a depth. A final task and all its
+// descendants must report omp_in_final, and run on the thread that created them.
+static const int TREE = 6;                  // depth of the tree
+static const int FINAL = 3;                 // depth at which the tasks are final
+
+static void tree(int depth, int parent, int &finals, int &strays)
+    {
+    if(omp_in_final())
+        {
+        #pragma omp atomic
+        ++finals;
+
+        if(omp_get_thread_num() != parent)
+            {
+            #pragma omp atomic
+            ++strays;
+            }
+        }
+
+    if(depth < TREE)
+        {
+        int me = omp_get_thread_num();
+
+        for(int i=0; i<2; i++)
+            {
+            #pragma omp task final(depth+1 >= FINAL) mergeable shared(finals, strays)
+            tree(depth+1, me, finals, strays);
+            }
+        }
+    }
+
+static long test_final(int n, bool &ok)
+    {
+    int finals = 0;
+    int strays = 0;
+
+    #pragma omp parallel num_threads(n)
+    #pragma omp single
+    tree(0, 0, finals, strays);
+
+    ok = strays == 0 && finals == (1<<(TREE+1)) - (1<<FINAL);
+
+    return finals;
+    }
+
+
+// the number of permutations of balls of each of several colors: (colors*balls)! / (balls!)^colors
+static long multinomial(int colors, int balls)
+    {
+    long result = 1;
+    int n = 0;
+
+    for(int c=0; c<colors; c++)
+        {
+        for(int k=1; k<=balls; k++)         // multiply by binomial(n+balls, balls), one factor at a time
+            {
+            ++n;
+            result = result * n / k;
+            }
+        }
+
+    return result;
+    }
+
+
+typedef long TESTFN(int, bool &);
+
+static void run(const char *name, TESTFN *fn)
+    {
+    for(int n=1; n<=MAXTEAM; n++)
+        {
+        char config[16];
+        bool ok = true;
+        long result = 0;
+
+        snprintf(config, sizeof(config), "t=%d", n);
+
+        double start = omp_get_wtime();
+        for(int r=0; r<repeat; r++)
+            {
+            bool rok;
+            result = fn(n, rok);
+            ok = ok && rok;
+            }
+        report(name, config, result, ok, omp_get_wtime() - start);
+        }
+    }
+
+
+static void run_permute(int colors, int balls, int plevel)
+    {
+    char config[16];
+    long result = 0;
+
+    snprintf(config, sizeof(config), "%dx%d/%d", colors, balls, plevel);
+
+    quiet();
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = permute(colors, balls, plevel, 0);
+        }
+    double elapsed = omp_get_wtime() - start;
+    unquiet();
+
+    report("permute", config, result, result == multinomial(colors, balls), elapsed);
+    }
+
+
+// find first match, with and without cancellation
+// the number of keys scanned depends on the scheduling, so it is not part of the result
+static void run_search(int n, int pos, bool cancel)
+    {
+    char config[16];
+    long result = 0;
+
+    snprintf(config, sizeof(config), "%d/%s", pos, cancel ? "cancel" : "full");
+
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = search(n, pos, cancel, 0);
+        }
+
+    report("search", config, result, result == pos, omp_get_wtime() - start);
+    }
+
+
+// checksum a stream of blocks in parallel, and write the checksums in order
+// the digest of the output must be the same as the serial one
+static void run_ordered(int blocks, int mode)
+    {
+    static uint32_t expect = 0;
+    long result = 0;
+
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = crc_stream(blocks, mode, MAXTEAM);
+        }
+    double elapsed = omp_get_wtime() - start;
+
+    if(mode == CRC_SERIAL)
+        {
+        expect = result;
+        }
+
+    report("ordered", crc_stream_modes[mode], result, result == expect, elapsed);
+    }
+
+
+// a loop of uneven cost, as a taskloop with the given grainsize, or as a parallel for if grainsize < 0
+// the result must be the same either way
+static void run_taskloop(int n, int grainsize)
+    {
+    static long expect = 0;
+    char config[16];
+    long result = 0;
+
+    if(grainsize < 0)
+        {
+        snprintf(config, sizeof(config), "for");
+        }
+    else
+        {
+        snprintf(config, sizeof(config), "grain=%d", grainsize);
+        }
+
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = grainsize < 0 ? parallel_for_sum(n) : taskloop_sum(n, grainsize);
+        }
+    double elapsed = omp_get_wtime() - start;
+
+    if(grainsize < 0)
+        {
+        expect = result;
+        }
+
+    report("taskloop", config, result, result == expect, elapsed);
+    }
+
+
+// one of the algorithms of parallel.hpp, serially or in parallel
+// the result must be the same either way
+static void run_palgo(int algo, int n, bool parallel)
+    {
+    static uint32_t expect = 0;
+    long result = 0;
+
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = palgo_bench(algo, n, parallel);
+        }
+    double elapsed = omp_get_wtime() - start;
+
+    if(!parallel)
+        {
+        expect = result;
+        }
+
+    report(palgo_names[algo], parallel ? "parallel" : "serial", result, result != 0 && result == expect, elapsed);
+    }
+
+
+// create n small tasks in taskgroups of 8, so the cost is mostly in allocating and freeing their data
+static long task_burst(int n)
+    {
+    long sum = 0;
+
+    #pragma omp parallel num_threads(MAXTEAM)
+    #pragma omp single nowait
+    for(int i=0; i<n; i+=8)
+        {
+        #pragma omp taskgroup
+        for(int k=i; k<i+8 && k<n; k++)
+            {
+            #pragma omp task firstprivate(k) shared(sum)
+                {
+                #pragma omp atomic
+                sum += k;
+                }
+            }
+        }
+
+    return sum;
+    }
+
+
+// task heavy tests with the task data allocated from an arena, or from the heap
+// the results must be the same either way, and the arena must be empty afterwards
+static void run_arena(bool arena)
+    {
+    static char mem[4096];
+    Arena a(mem, sizeof(mem));
+    Arena *prev = arena_select(arena ? &a : 0);
+    long result = 0;
+
+    quiet();
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        result = task_burst(10000) + permute(3, 4, 32, 0);
+        }
+    double elapsed = omp_get_wtime() - start;
+    unquiet();
+
+    arena_select(prev);
+
+    report("arena", arena ? "arena" : "heap", result, a.used() == 0, elapsed);
+    }
+
+
+// a team of 4, then in an arena a team of 2 that creates tasks
+// The members of the first team that aren't in the second still help run its tasks, whose data
+// must go back to the arena it came from, rather than to the heap.
+static void run_arena_shrink()
+    {
+    static char mem[4096];
+    Arena a(mem, sizeof(mem));
+    long result = 0;
+
+    double start = omp_get_wtime();
+    for(int r=0; r<repeat; r++)
+        {
+        long sum = 0;
+
+        #pragma omp parallel num_threads(MAXTEAM)
+            {
+            }
+
+            {
+            ArenaScope scope(a);
+
+            #pragma omp parallel num_threads(2)
+            #pragma omp single
+            for(int k=0; k<200; k++)
+                {
+                #pragma omp task firstprivate(k) shared(sum)
+                    {
+                    #pragma omp atomic
+                    sum += k;
+                    }
+                }
+            }
+
+        result = sum;
+        }
+
+    report("arena", "shrink", result, result == 199*200/2 && a.used() == 0, omp_get_wtime() - start);
+    }
+
+
+int omptest(int argc, char **argv)
+    {
+    bool verbose = false;
+
+    for(int i=1; i<argc; i++)
+        {
+        if(strcmp(argv[i], "-v") == 0)
+            {
+            verbose = true;
+            }
+        else if(strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            {
+            repeat = atoi(argv[++i]);
+            }
+        }
+
+    if(verbose)
+        {
+        for(int n=1; n<=MAXTEAM; n++)
+            {
+            omp_hello(n);
+            omp_for(n);
+            omp_single(n);
+            }
+        }
+
+    run("hello", test_hello);
+    run("for", test_for);
+    run("single", test_single);
+    run("ordered", test_ordered);
+    run("doacross", test_doacross);
+    run("final", test_final);
+
+    run_permute(2, 4, 32);
+    run_permute(3, 3, 32);
+    run_permute(3, 3, 2);
+    run_permute(3, 4, 32);
+    run_permute(3, 4, 4);
+
+    run_search(1<<20, 1000, false);
+    run_search(1<<20, 1000, true);
+    run_search(1<<20, 600000, false);
+    run_search(1<<20, 600000, true);
+
+    run_taskloop(10000, -1);                // parallel for first, it provides the expected result
+    run_taskloop(10000, 0);
+    run_taskloop(10000, 100);
+    run_taskloop(10000, 1000);
+
+    for(int mode=0; mode<CRC_NUM_MODES; mode++)    // serial first, it provides the expected result
+        {
+        run_ordered(1000, mode);
+        }
+
+    run_arena(false);
+    run_arena(true);
+    run_arena_shrink();
+
+    for(int algo=0; algo<PALGO_NUM_ALGOS; algo++)  // serial first, it provides the expected result
+        {
+        run_palgo(algo, algo == PALGO_REDUCE ? 100000 : PALGO_MAX, false);
+        run_palgo(algo, algo == PALGO_REDUCE ? 100000 : PALGO_MAX, true);
+        }
+
+    printf("%d failures\n", failures);
+
+    return failures ? 1 : 0;
+    }